@@ -19,7 +19,8 @@ struct arena {
 
 #define DEFAULT_STORAGE_SIZE 8
 
-static arena *current_arena;
+//each thread driving an emulated system tracks code allocations in that system's arena
+static __thread arena *current_arena;
 
 arena *get_current_arena()
 {
@@ -87,3 +88,20 @@ void *try_alloc_arena()
 	track_block(ret);
 	return ret;
 }
+
+void release_block(void *block)
+{
+	arena *cur = get_current_arena();
+	for (size_t i = 0; i < cur->used_count; i++)
+	{
+		if (cur->used_blocks[i] == block) {
+			cur->used_blocks[i] = cur->used_blocks[--cur->used_count];
+			if (cur->free_count == cur->free_storage) {
+				cur->free_storage = cur->free_storage ? cur->free_storage * 2 : DEFAULT_STORAGE_SIZE;
+				cur->free_blocks = realloc(cur->free_blocks, cur->free_storage * sizeof(void *));
+			}
+			cur->free_blocks[cur->free_count++] = block;
+			return;
+		}
+	}
+}
@@ -14,5 +14,7 @@ arena *start_new_arena();
 void track_block(void *block);
 void mark_all_free();
 void *try_alloc_arena();
+//returns a single block to the free list so it can be reused before the arena is torn down
+void release_block(void *block);
 
 #endif //ARENA_H_
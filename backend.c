@@ -4,6 +4,7 @@
  BlastEm is free software distributed under the terms of the GNU General Public License version 3 or greater. See COPYING for full license text.
 */
 #include "backend.h"
+#include "arena.h"
 #include <stdlib.h>
 
 deferred_addr * defer_address(deferred_addr * old_head, uint32_t address, uint8_t *dest)
@@ -78,6 +79,38 @@ memmap_chunk const *find_map_chunk(uint32_t address, cpu_options *opts, uint16_t
 	return NULL;
 }
 
+memmap_chunk const *find_direct_chunk(uint32_t address, cpu_options *opts, uint8_t is_write, uint32_t *ram_flags_off)
+{
+	address &= opts->address_mask;
+	uint32_t flags_off = opts->ram_flags_off;
+	for (memmap_chunk const *cur = opts->memmap, *end = opts->memmap + opts->memmap_chunks; cur != end; cur++)
+	{
+		if (address >= cur->start && address < cur->end) {
+			if (!cur->buffer || !(cur->flags & (is_write ? MMAP_WRITE : MMAP_READ))) {
+				return NULL;
+			}
+			if (cur->flags & (MMAP_PTR_IDX | MMAP_ONLY_ODD | MMAP_ONLY_EVEN)) {
+				return NULL;
+			}
+			if (ram_flags_off) {
+				*ram_flags_off = flags_off;
+			}
+			return cur;
+		}
+		if (cur->flags & MMAP_CODE) {
+			//must match the layout used by gen_mem_fun
+			uint32_t added_offset;
+			if (cur->mask == opts->address_mask) {
+				added_offset = (cur->end - cur->start) / (1 << opts->ram_flags_shift) / 8;
+			} else {
+				added_offset = (cur->mask + 1) /  (1 << opts->ram_flags_shift) / 8;
+			}
+			flags_off += added_offset ? added_offset : 1;
+		}
+	}
+	return NULL;
+}
+
 void * get_native_pointer(uint32_t address, void ** mem_pointers, cpu_options * opts)
 {
 	memmap_chunk const * memmap = opts->memmap;
@@ -293,3 +326,85 @@ uint32_t ram_size(cpu_options *opts)
 	}
 	return size;
 }
+
+uint8_t tracks_dirty_pages(cpu_options *opts)
+{
+	for (int i = 0; i < opts->memmap_chunks; i++)
+	{
+		if ((opts->memmap[i].flags & (MMAP_CODE | MMAP_WRITE | MMAP_DIRTY_PAGES)) == (MMAP_CODE | MMAP_WRITE | MMAP_DIRTY_PAGES)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+uint8_t *get_dirty_flags(cpu_options *opts, void *context, uint32_t address)
+{
+	if (!opts->dirty_flags_off) {
+		return NULL;
+	}
+	uint32_t meta_off;
+	memmap_chunk const *chunk = find_map_chunk(address, opts, MMAP_CODE, &meta_off);
+	if (!chunk || (chunk->flags & (MMAP_CODE | MMAP_WRITE | MMAP_DIRTY_PAGES)) != (MMAP_CODE | MMAP_WRITE | MMAP_DIRTY_PAGES)) {
+		return NULL;
+	}
+	return (uint8_t *)context + opts->ram_flags_off + opts->dirty_flags_off + (meta_off >> opts->ram_flags_shift);
+}
+
+#define CODE_BLOCK_WORDS (CODE_ALLOC_SIZE / sizeof(code_word))
+
+void code_cache_init(cpu_options *opts)
+{
+	opts->cache.start = opts->code.cur;
+	opts->cache.start_last = opts->cache.cur_last = opts->code.last;
+}
+
+uint32_t code_cache_used(cpu_options *opts)
+{
+	code_cache *cache = &opts->cache;
+	if (!cache->num_blocks) {
+		return (opts->code.cur - cache->start) * sizeof(code_word);
+	}
+	return ((cache->start_last - cache->start) + (cache->num_blocks - 1) * CODE_BLOCK_WORDS
+		+ (opts->code.cur - cache->blocks[cache->num_blocks - 1])) * sizeof(code_word);
+}
+
+uint8_t code_cache_update(cpu_options *opts)
+{
+	code_cache *cache = &opts->cache;
+	if (opts->code.last != cache->cur_last) {
+		//check_alloc_code moved on to a new block
+		if (cache->num_blocks == cache->block_storage) {
+			cache->block_storage = cache->block_storage ? cache->block_storage * 2 : 8;
+			cache->blocks = realloc(cache->blocks, cache->block_storage * sizeof(code_ptr));
+		}
+		cache->blocks[cache->num_blocks++] = opts->code.last + RESERVE_WORDS - CODE_BLOCK_WORDS;
+		cache->cur_last = opts->code.last;
+	}
+	if (cache->budget && !cache->flush_pending && code_cache_used(opts) > cache->budget) {
+		cache->flush_pending = 1;
+		return 1;
+	}
+	return 0;
+}
+
+void code_cache_retranslated(cpu_options *opts, uint32_t dead_bytes)
+{
+	opts->cache.dead += dead_bytes;
+	opts->cache.retranslations++;
+}
+
+void code_cache_flush(cpu_options *opts)
+{
+	code_cache *cache = &opts->cache;
+	for (uint32_t i = 0; i < cache->num_blocks; i++)
+	{
+		release_block(cache->blocks[i]);
+	}
+	cache->num_blocks = 0;
+	cache->dead = 0;
+	cache->flush_pending = 0;
+	cache->flushes++;
+	opts->code.cur = cache->start;
+	opts->code.last = cache->cur_last = cache->start_last;
+}
@@ -43,11 +43,27 @@ typedef struct deferred_addr {
 #include "memmap.h"
 #include "system.h"
 
+//Tracks how much memory translated code is using so it can be thrown away once it gets too large
+typedef struct {
+	code_ptr start;          //translated code starts here, everything before it is shared helper code
+	code_ptr start_last;     //end of the block containing start
+	code_ptr cur_last;       //end of the block translated code was most recently written to
+	code_ptr *blocks;        //blocks allocated for translated code after the one containing start
+	uint32_t num_blocks;
+	uint32_t block_storage;
+	uint32_t budget;         //bytes of translated code allowed before a flush is requested, 0 for no limit
+	uint32_t dead;           //bytes of translated code that are no longer reachable due to retranslation
+	uint32_t retranslations;
+	uint32_t flushes;
+	uint8_t  flush_pending;
+} code_cache;
+
 typedef struct {
 	uint32_t flags;
 	native_map_slot    *native_code_map;
 	deferred_addr      *deferred;
 	code_info          code;
+	code_cache         cache;
 	uint8_t            **ram_inst_sizes;
 	memmap_chunk const *memmap;
 	code_ptr           save_context;
@@ -57,6 +73,7 @@ typedef struct {
 	code_ptr           handle_code_write;
 	code_ptr           handle_align_error_write;
 	code_ptr           handle_align_error_read;
+	code_ptr           run_fallback;
 	system_str_fun_r8  debug_cmd_handler;
 	uint32_t           memmap_chunks;
 	uint32_t           address_mask;
@@ -65,8 +82,13 @@ typedef struct {
 	uint32_t           clock_divider;
 	uint32_t           move_pc_off;
 	uint32_t           move_pc_size;
+	uint32_t           run_cycles;
+	uint32_t           run_check_cycles;
 	int32_t            mem_ptr_off;
 	int32_t            ram_flags_off;
+	//distance from the code flags to the flags for pages written since they were last cleared,
+	//which are a byte per page so they can be set with a single store, 0 if writes aren't tracked
+	int32_t            dirty_flags_off;
 	uint8_t            ram_flags_shift;
 	uint8_t            address_size;
 	uint8_t            byte_swap;
@@ -76,6 +98,7 @@ typedef struct {
 	int8_t             scratch1;
 	int8_t             scratch2;
 	uint8_t            align_error_mask;
+	uint8_t            in_run;
 } cpu_options;
 
 typedef uint8_t * (*native_addr_func)(void * context, uint32_t address);
@@ -86,14 +109,42 @@ void process_deferred(deferred_addr ** head_ptr, void * context, native_addr_fun
 
 void cycles(cpu_options *opts, uint32_t num);
 void check_cycles_int(cpu_options *opts, uint32_t address);
+//size of the code check_cycles_int would emit at the current position, nothing is emitted
+uint32_t check_cycles_int_size(cpu_options *opts, uint32_t address);
 void check_cycles(cpu_options * opts);
 void check_code_prologue(code_info *code);
+//A run is a straight-line sequence of instructions with a single cycle update and limit check.
+//Cycles and limit checks are collected between check_cycles_run and end_cycles_run and only this
+//fast body is translated up front. The first address of a run is mapped over all of its bytes, so
+//a write anywhere in it patches the run. If the limit would be hit inside the run, the check branches
+//to the stub from run_fallback_stub instead, which calls opts->run_fallback with the run address in
+//scratch1 and the stub address in scratch2. That translates the instructions again with the usual
+//per-instruction checks, so interrupts and syncs happen at exactly the same point, and returns the
+//new code in scratch1. The check for the first instruction has already been done at that point and
+//is skipped since a second check would take a pending interrupt early. patch_run_fallback then makes
+//the stub jump to the new code directly. The instructions after the first are mapped to this code,
+//jumps and interrupt returns into the middle of a run get the same per-instruction translation,
+//translated on demand until it reaches code that is already mapped
+code_ptr check_cycles_run(cpu_options *opts);
+void end_cycles_run(cpu_options *opts, code_ptr check);
+void run_fallback_stub(cpu_options *opts, code_ptr check, uint32_t address);
+void patch_run_fallback(code_ptr stub, code_ptr fallback);
+uint8_t run_covers_check(cpu_options *opts);
 void log_address(cpu_options *opts, uint32_t address, char * format);
 
+void code_cache_init(cpu_options *opts);
+uint32_t code_cache_used(cpu_options *opts);
+//call after translating, returns 1 when this translation pushed the cache over its budget
+uint8_t code_cache_update(cpu_options *opts);
+void code_cache_retranslated(cpu_options *opts, uint32_t dead_bytes);
+//discards all translated code, the caller is responsible for clearing anything that points into it
+void code_cache_flush(cpu_options *opts);
+
 void retranslate_calc(cpu_options *opts);
 void patch_for_retranslate(cpu_options *opts, code_ptr native_address, code_ptr handler);
 
 code_ptr gen_mem_fun(cpu_options * opts, memmap_chunk const * memmap, uint32_t num_chunks, ftype fun_type, code_ptr *after_inc);
+uint8_t gen_mem_direct(cpu_options *opts, ftype fun_type, uint32_t address);
 void * get_native_pointer(uint32_t address, void ** mem_pointers, cpu_options * opts);
 void * get_native_write_pointer(uint32_t address, void ** mem_pointers, cpu_options * opts);
 uint16_t read_word(uint32_t address, void **mem_pointers, cpu_options *opts, void *context);
@@ -101,8 +152,15 @@ void write_word(uint32_t address, uint16_t value, void **mem_pointers, cpu_optio
 uint8_t read_byte(uint32_t address, void **mem_pointers, cpu_options *opts, void *context);
 void write_byte(uint32_t address, uint8_t value, void **mem_pointers, cpu_options *opts, void *context);
 memmap_chunk const *find_map_chunk(uint32_t address, cpu_options *opts, uint16_t flags, uint32_t *size_sum);
+//returns the chunk for address if accesses to it can go straight to the chunk's buffer
+memmap_chunk const *find_direct_chunk(uint32_t address, cpu_options *opts, uint8_t is_write, uint32_t *ram_flags_off);
 uint32_t chunk_size(cpu_options *opts, memmap_chunk const *chunk);
 uint32_t ram_size(cpu_options *opts);
+//returns 1 if any chunk in the memory map has MMAP_DIRTY_PAGES set
+uint8_t tracks_dirty_pages(cpu_options *opts);
+//returns the dirty page flags for the RAM chunk containing address, byte n is set when the
+//page at chunk offset n << ram_flags_shift is written, NULL if writes to it aren't tracked
+uint8_t *get_dirty_flags(cpu_options *opts, void *context, uint32_t address);
 
 #endif //BACKEND_H_
 
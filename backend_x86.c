@@ -4,6 +4,10 @@
 
 void cycles(cpu_options *opts, uint32_t num)
 {
+	if (opts->in_run) {
+		opts->run_cycles += num*opts->clock_divider;
+		return;
+	}
 	if (opts->limit < 0) {
 		sub_ir(&opts->code, num*opts->clock_divider, opts->cycles, SZ_D);
 	} else {
@@ -11,8 +15,22 @@ void cycles(cpu_options *opts, uint32_t num)
 	}
 }
 
+uint8_t run_covers_check(cpu_options *opts)
+{
+	if (!opts->in_run) {
+		return 0;
+	}
+	if (opts->run_cycles > opts->run_check_cycles) {
+		opts->run_check_cycles = opts->run_cycles;
+	}
+	return 1;
+}
+
 void check_cycles_int(cpu_options *opts, uint32_t address)
 {
+	if (run_covers_check(opts)) {
+		return;
+	}
 	code_info *code = &opts->code;
 	uint8_t cc;
 	if (opts->limit < 0) {
@@ -29,6 +47,16 @@ void check_cycles_int(cpu_options *opts, uint32_t address)
 	*jmp_off = code->cur - (jmp_off+1);
 }
 
+uint32_t check_cycles_int_size(cpu_options *opts, uint32_t address)
+{
+	code_info *code = &opts->code;
+	code_info tmp = *code;
+	check_cycles_int(opts, address);
+	uint32_t size = code->cur - tmp.cur;
+	*code = tmp;
+	return size;
+}
+
 void retranslate_calc(cpu_options *opts)
 {
 	code_info *code = &opts->code;
@@ -66,6 +94,9 @@ void patch_for_retranslate(cpu_options *opts, code_ptr native_address, code_ptr
 
 void check_cycles(cpu_options * opts)
 {
+	if (run_covers_check(opts)) {
+		return;
+	}
 	code_info *code = &opts->code;
 	uint8_t cc;
 	if (opts->limit < 0) {
@@ -100,6 +131,80 @@ void check_code_prologue(code_info *code)
 	check_alloc_code(code, MAX_INST_LEN*4);
 }
 
+code_ptr check_cycles_run(cpu_options *opts)
+{
+	code_info *code = &opts->code;
+	check_alloc_code(code, MAX_INST_LEN*4);
+	//placeholder values are large enough to force 32-bit immediates and displacements
+	uint8_t cc;
+	if (opts->limit < 0) {
+		cmp_ir(code, 0x7FFFFFFF, opts->cycles, SZ_D);
+		cc = CC_L;
+	} else {
+		mov_rr(code, opts->cycles, opts->scratch1, SZ_D);
+		sub_rr(code, opts->limit, opts->scratch1, SZ_D);
+		add_ir(code, 0x7FFFFFFF, opts->scratch1, SZ_D);
+		cc = CC_NS;
+	}
+	jcc(code, cc, code->cur + 256);
+	opts->in_run = 1;
+	opts->run_cycles = opts->run_check_cycles = 0;
+	return code->cur - 4;
+}
+
+static void patch_disp32(code_ptr dst, int32_t value)
+{
+	*(dst++) = value;
+	value >>= 8;
+	*(dst++) = value;
+	value >>= 8;
+	*(dst++) = value;
+	value >>= 8;
+	*dst = value;
+}
+
+void end_cycles_run(cpu_options *opts, code_ptr check)
+{
+	opts->in_run = 0;
+	//the check is run before the first instruction, so it needs to succeed for the latest point
+	//in the run that would have checked the cycle count
+	patch_disp32(check - 6, opts->run_check_cycles + (opts->limit < 0 ? 1 : 0));
+	if (!opts->run_cycles) {
+		return;
+	}
+	if (opts->limit < 0) {
+		sub_ir(&opts->code, opts->run_cycles, opts->cycles, SZ_D);
+	} else {
+		add_ir(&opts->code, opts->run_cycles, opts->cycles, SZ_D);
+	}
+}
+
+void run_fallback_stub(cpu_options *opts, code_ptr check, uint32_t address)
+{
+	code_info *code = &opts->code;
+	check_alloc_code(code, MAX_INST_LEN*4);
+	patch_disp32(check, code->cur - (check + 4));
+	code_ptr stub = code->cur;
+	mov_ir(code, address, opts->scratch1, SZ_D);
+	mov_ir(code, (uintptr_t)stub, opts->scratch2, SZ_PTR);
+	call(code, opts->run_fallback);
+	jmp_r(code, opts->scratch1);
+}
+
+void patch_run_fallback(code_ptr stub, code_ptr fallback)
+{
+	//the stub is always bigger than a jump since it loads a pointer sized immediate
+	code_info code = {stub, stub + 2*sizeof(code_ptr), 0};
+	jmp(&code, fallback);
+}
+
+//dirty page flags are a byte per page rather than a bit, so a chunk's entries start 8 times
+//as far in as its code flags
+static int32_t dirty_flags_off(cpu_options *opts, uint32_t ram_flags_off)
+{
+	return opts->ram_flags_off + opts->dirty_flags_off + (ram_flags_off - opts->ram_flags_off) * 8;
+}
+
 code_ptr gen_mem_fun(cpu_options * opts, memmap_chunk const * memmap, uint32_t num_chunks, ftype fun_type, code_ptr *after_inc)
 {
 	code_info *code = &opts->code;
@@ -266,6 +371,13 @@ code_ptr gen_mem_fun(cpu_options * opts, memmap_chunk const * memmap, uint32_t n
 			if (is_write && (memmap[chunk].flags & MMAP_CODE)) {
 				mov_rr(code, opts->scratch2, opts->scratch1, opts->address_size);
 				shr_ir(code, opts->ram_flags_shift, opts->scratch1, opts->address_size);
+				if (memmap[chunk].flags & MMAP_DIRTY_PAGES) {
+					if (opts->address_size != SZ_D) {
+						//whole register is used as an index below
+						movzx_rr(code, opts->scratch1, opts->scratch1, opts->address_size, SZ_D);
+					}
+					mov_irindexdisp(code, 1, opts->context_reg, opts->scratch1, 1, dirty_flags_off(opts, ram_flags_off), SZ_B);
+				}
 				bt_rrdisp(code, opts->scratch1, opts->context_reg, ram_flags_off, opts->address_size);
 				code_ptr not_code = code->cur + 1;
 				jcc(code, CC_NC, code->cur + 2);
@@ -326,3 +438,75 @@ code_ptr gen_mem_fun(cpu_options * opts, memmap_chunk const * memmap, uint32_t n
 	retn(code);
 	return start;
 }
+
+//Emits an access to a fixed address inline when it maps to a plain buffer.
+//Behaves like the helper from gen_mem_fun for that address, including cycle
+//accounting and code write detection, but skips the chunk search. The value
+//is in scratch1 and for writes the address is expected in scratch2, which gets
+//clobbered. Returns 0 without emitting anything if the helper must be used
+uint8_t gen_mem_direct(cpu_options *opts, ftype fun_type, uint32_t address)
+{
+	uint8_t is_write = fun_type == WRITE_16 || fun_type == WRITE_8;
+	uint8_t size =  (fun_type == READ_16 || fun_type == WRITE_16) ? SZ_W : SZ_B;
+	if (size != SZ_B && (address & opts->align_error_mask)) {
+		return 0;
+	}
+	if (opts->in_run) {
+		return 0;
+	}
+	uint32_t ram_flags_off;
+	memmap_chunk const *chunk = find_direct_chunk(address, opts, is_write, &ram_flags_off);
+	if (!chunk) {
+		return 0;
+	}
+	address &= opts->address_mask;
+	uint32_t offset = address & chunk->mask;
+	if (size == SZ_B && (opts->byte_swap || chunk->flags & MMAP_BYTESWAP)) {
+		offset ^= 1;
+	}
+	code_info *code = &opts->code;
+	check_alloc_code(code, 10*MAX_INST_LEN);
+	//same check as the helper, call pads the stack based on stack_off so this
+	//stays aligned when the caller has something pushed
+	uint8_t cc;
+	if (opts->limit < 0) {
+		cmp_ir(code, 1, opts->cycles, SZ_D);
+		cc = CC_NS;
+	} else {
+		cmp_rr(code, opts->cycles, opts->limit, SZ_D);
+		cc = CC_A;
+	}
+	code_ptr no_sync = code->cur + 1;
+	jcc(code, cc, code->cur + 2);
+	call(code, opts->handle_cycle_limit);
+	*no_sync = code->cur - (no_sync+1);
+	cycles(opts, opts->bus_cycles);
+	if (is_write) {
+		mov_ir(code, (intptr_t)((uint8_t *)chunk->buffer + offset), opts->scratch2, SZ_PTR);
+		mov_rrind(code, opts->scratch1, opts->scratch2, size);
+		if (chunk->flags & MMAP_CODE) {
+			uint32_t bit = offset >> opts->ram_flags_shift;
+			if (chunk->flags & MMAP_DIRTY_PAGES) {
+				mov_irdisp(code, 1, opts->context_reg, dirty_flags_off(opts, ram_flags_off) + bit, SZ_B);
+			}
+			test_irdisp(code, 1 << (bit & 7), opts->context_reg, ram_flags_off + bit / 8, SZ_B);
+			code_ptr not_code = code->cur + 1;
+			jcc(code, CC_Z, code->cur + 2);
+			if (chunk->mask != opts->address_mask) {
+				offset |= chunk->start;
+			}
+			push_r(code, opts->scratch1);
+			call(code, opts->save_context);
+			mov_ir(code, offset, opts->scratch2, SZ_D);
+			call_args(code, opts->handle_code_write, 2, opts->scratch2, opts->context_reg);
+			mov_rr(code, RAX, opts->context_reg, SZ_PTR);
+			call(code, opts->load_context);
+			pop_r(code, opts->scratch1);
+			*not_code = code->cur - (not_code+1);
+		}
+	} else {
+		mov_ir(code, (intptr_t)((uint8_t *)chunk->buffer + offset), opts->scratch1, SZ_PTR);
+		mov_rindr(code, opts->scratch1, opts->scratch1, size);
+	}
+	return 1;
+}
@@ -0,0 +1,779 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "system.h"
+#include "util.h"
+#include "vdp.h"
+#include "render.h"
+#include "render_audio.h"
+#include "io.h"
+#include "arena.h"
+#include "hash.h"
+#include "rewind.h"
+
+//globals expected by the emulation core, the batch runner never changes them after startup
+char *save_filename           = NULL;
+tern_node *config             = NULL;
+int headless                  = 0;
+int exit_after                = 0;
+int z80_enabled               = 1;
+uint8_t use_native_states     = 1;
+system_header *current_system = NULL;
+
+#define DEFAULT_FRAMES 600
+#define DEFAULT_REWIND_MB 4
+#define FRAME_HEIGHT_PAL 294
+
+typedef struct {
+	uint32_t frame;
+	uint32_t line;
+	uint8_t  port;
+	uint8_t  button;
+	uint8_t  down;
+} input_event;
+
+typedef struct {
+	char        *rom;
+	char        *state;
+	input_event *events;
+	char        *status;
+	uint64_t    video_hash;
+	uint64_t    audio_hash;
+	uint64_t    total_ns;
+	uint64_t    max_frame_ns;
+	uint64_t    snapshot_ns;
+	uint64_t    restore_ns;
+	uint64_t    delta_bytes;
+	uint64_t    checkpoint_ns;
+	uint64_t    checkpoint_bytes;
+	size_t      full_checkpoint_bytes;
+	uint32_t    checkpoints;
+	uint32_t    snapshots;
+	uint32_t    restores;
+	uint32_t    rewind_frames;
+	uint32_t    num_events;
+	uint32_t    frames;
+	uint32_t    frames_run;
+} batch_job;
+
+//a full checkpoint followed by the incremental ones taken on top of it
+//when full is set every checkpoint is a full one and only the latest is kept
+typedef struct {
+	uint8_t  **states;
+	size_t   *sizes;
+	uint8_t  *scratch;
+	size_t   scratch_size;
+	uint32_t num_states;
+	uint32_t storage;
+	uint8_t  full;
+} checkpoint_chain;
+
+typedef struct {
+	batch_job     *job;
+	system_header *system;
+	audio_mixer   *mixer;
+	uint8_t       last_fb;
+	uint32_t      fb[LINEBUF_SIZE * FRAME_HEIGHT_PAL * 2];
+} batch_worker;
+
+static batch_job *jobs;
+static uint32_t num_jobs;
+static uint32_t next_job;
+static uint32_t rewind_interval;
+static size_t rewind_budget = DEFAULT_REWIND_MB * 1024 * 1024;
+static uint32_t checkpoint_interval;
+//system allocation touches lazily initialized tables (ROM DB, YM2612 and VDP lookup tables) so it's serialized
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread batch_worker *worker;
+
+static void frame_hashed(system_header *system, uint32_t frame, uint64_t video_hash, uint64_t audio_hash)
+{
+	batch_job *job = worker->job;
+	job->video_hash = xxhash64(&video_hash, sizeof(video_hash), job->video_hash);
+	job->audio_hash = xxhash64(&audio_hash, sizeof(audio_hash), job->audio_hash);
+}
+
+static const char *button_names[] = {
+	"up", "down", "left", "right", "a", "b", "c", "start", "x", "y", "z", "mode"
+};
+static const uint8_t button_values[] = {
+	DPAD_UP, DPAD_DOWN, DPAD_LEFT, DPAD_RIGHT, BUTTON_A, BUTTON_B, BUTTON_C, BUTTON_START, BUTTON_X, BUTTON_Y, BUTTON_Z, BUTTON_MODE
+};
+
+static int compare_events(const void *a, const void *b)
+{
+	const input_event *ea = a, *eb = b;
+	if (ea->frame != eb->frame) {
+		return ea->frame < eb->frame ? -1 : 1;
+	}
+	//qsort isn't stable, events on the same frame keep the order they had in the script
+	return ea->line < eb->line ? -1 : ea->line > eb->line;
+}
+
+//input scripts have one event per line in the form: FRAME PORT BUTTON down|up
+static void load_input_script(batch_job *job, char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		fatal_error("Failed to open input script %s\n", path);
+	}
+	uint32_t storage = 0;
+	char line[256];
+	for (int line_num = 1; fgets(line, sizeof(line), f); line_num++)
+	{
+		char *start = line;
+		while (*start == ' ' || *start == '\t')
+		{
+			start++;
+		}
+		if (*start == '#' || *start == '\n' || !*start) {
+			continue;
+		}
+		unsigned frame, port;
+		char button[16], state[8];
+		if (sscanf(start, "%u %u %15s %7s", &frame, &port, button, state) != 4 || !port) {
+			fatal_error("Invalid input event on line %d of %s\n", line_num, path);
+		}
+		uint8_t i;
+		for (i = 0; i < sizeof(button_values); i++)
+		{
+			if (!strcasecmp(button, button_names[i])) {
+				break;
+			}
+		}
+		if (i == sizeof(button_values)) {
+			fatal_error("Unknown button %s on line %d of %s\n", button, line_num, path);
+		}
+		uint8_t down = !strcasecmp(state, "down");
+		if (!down && strcasecmp(state, "up")) {
+			fatal_error("Invalid button state %s on line %d of %s, expected down or up\n", state, line_num, path);
+		}
+		if (job->num_events == storage) {
+			storage = storage ? storage * 2 : 16;
+			job->events = realloc(job->events, storage * sizeof(input_event));
+		}
+		input_event *event = job->events + job->num_events++;
+		event->frame = frame;
+		event->line = line_num;
+		event->port = port;
+		event->button = button_values[i];
+		event->down = down;
+	}
+	fclose(f);
+	qsort(job->events, job->num_events, sizeof(input_event), compare_events);
+}
+
+//each line of the job list is a ROM path optionally followed by frames=N, state=PATH and input=PATH
+static void load_job_list(char *path, uint32_t default_frames)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		fatal_error("Failed to open job list %s\n", path);
+	}
+	uint32_t storage = 0;
+	char line[4096];
+	while (fgets(line, sizeof(line), f))
+	{
+		char *state;
+		char *token = strtok_r(line, " \t\r\n", &state);
+		if (!token || *token == '#') {
+			continue;
+		}
+		if (num_jobs == storage) {
+			storage = storage ? storage * 2 : 64;
+			jobs = realloc(jobs, storage * sizeof(batch_job));
+		}
+		batch_job *job = jobs + num_jobs++;
+		memset(job, 0, sizeof(batch_job));
+		job->rom = strdup(token);
+		job->frames = default_frames;
+		while ((token = strtok_r(NULL, " \t\r\n", &state)))
+		{
+			if (!strncmp(token, "frames=", strlen("frames="))) {
+				job->frames = atoi(token + strlen("frames="));
+			} else if (!strncmp(token, "state=", strlen("state="))) {
+				job->state = strdup(token + strlen("state="));
+			} else if (!strncmp(token, "input=", strlen("input="))) {
+				load_input_script(job, token + strlen("input="));
+			} else {
+				fatal_error("Unrecognized option %s for %s in %s\n", token, job->rom, path);
+			}
+		}
+	}
+	fclose(f);
+}
+
+static uint8_t load_media(char *path, system_media *media)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		return 0;
+	}
+	long size = file_size(f);
+	if (size <= 0) {
+		fclose(f);
+		return 0;
+	}
+	media->buffer = calloc(1, nearest_pow2(size));
+	media->size = size;
+	if (fread(media->buffer, 1, size, f) != size) {
+		free(media->buffer);
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+	media->dir = path_dirname(path);
+	media->name = basename_no_extension(path);
+	media->extension = path_extension(path);
+	return 1;
+}
+
+static void take_checkpoint(batch_job *job, system_header *system, checkpoint_chain *chain)
+{
+	uint8_t incremental = !chain->full && chain->num_states;
+	uint64_t start = get_time_ns();
+	size_t size = system->serialize_checkpoint(system, chain->scratch, chain->scratch_size, incremental);
+	uint64_t elapsed = get_time_ns() - start;
+	if (!size) {
+		fatal_error("Checkpoint for %s did not fit in %d bytes\n", job->rom, (int)chain->scratch_size);
+	}
+	if (chain->full && chain->num_states) {
+		free(chain->states[--chain->num_states]);
+	}
+	if (chain->num_states == chain->storage) {
+		chain->storage = chain->storage ? chain->storage * 2 : 16;
+		chain->states = realloc(chain->states, chain->storage * sizeof(uint8_t *));
+		chain->sizes = realloc(chain->sizes, chain->storage * sizeof(size_t));
+	}
+	chain->states[chain->num_states] = malloc(size);
+	memcpy(chain->states[chain->num_states], chain->scratch, size);
+	chain->sizes[chain->num_states++] = size;
+	if (incremental) {
+		job->checkpoint_ns += elapsed;
+		job->checkpoint_bytes += size;
+		job->checkpoints++;
+	} else {
+		job->full_checkpoint_bytes = size;
+	}
+}
+
+static void free_checkpoints(checkpoint_chain *chain)
+{
+	for (uint32_t i = 0; i < chain->num_states; i++)
+	{
+		free(chain->states[i]);
+	}
+	free(chain->states);
+	free(chain->sizes);
+	free(chain->scratch);
+}
+
+static system_header *alloc_job_system(system_media *media, uint32_t opts)
+{
+	pthread_mutex_lock(&alloc_lock);
+		system_type stype = detect_system_type(media);
+		system_header *system = stype == SYSTEM_UNKNOWN ? NULL : alloc_config_system(stype, media, opts, 0);
+	pthread_mutex_unlock(&alloc_lock);
+	return system;
+}
+
+static void free_job_system(system_header *system)
+{
+	pthread_mutex_lock(&alloc_lock);
+		system->free_context(system);
+	pthread_mutex_unlock(&alloc_lock);
+}
+
+static void run_frames(batch_job *job, system_header *system, rewind_buffer *rw, checkpoint_chain *chain)
+{
+	uint32_t cur_event = 0, last_checkpoint = 0;
+	for (uint32_t frame = 0; frame < job->frames; frame++)
+	{
+		for (; cur_event < job->num_events && job->events[cur_event].frame <= frame; cur_event++)
+		{
+			input_event *event = job->events + cur_event;
+			if (event->down) {
+				system->gamepad_down(system, event->port, event->button);
+			} else {
+				system->gamepad_up(system, event->port, event->button);
+			}
+		}
+		uint64_t start = get_time_ns();
+		if (frame) {
+			system->resume_context(system);
+		} else {
+			system->start_context(system, job->state);
+		}
+		uint64_t elapsed = get_time_ns() - start;
+		job->total_ns += elapsed;
+		if (elapsed > job->max_frame_ns) {
+			job->max_frame_ns = elapsed;
+		}
+		if (system->should_exit) {
+			break;
+		}
+		if (rw) {
+			start = get_time_ns();
+			rewind_frame(rw);
+			job->snapshot_ns += get_time_ns() - start;
+		}
+		if (chain->scratch && (!frame || frame - last_checkpoint >= checkpoint_interval)) {
+			take_checkpoint(job, system, chain);
+			last_checkpoint = frame;
+		}
+	}
+	if (chain->num_states && last_checkpoint + 1 < job->frames_run) {
+		//make sure the check covers the frames run since the last one
+		take_checkpoint(job, system, chain);
+	}
+}
+
+static uint8_t *load_copy(system_header *system, uint8_t *state, size_t size, uint8_t *scratch, size_t scratch_size, size_t *size_out)
+{
+	if (!system->deserialize(system, state, size)) {
+		return NULL;
+	}
+	*size_out = system->serialize_into(system, scratch, scratch_size);
+	if (!*size_out) {
+		return NULL;
+	}
+	uint8_t *copy = malloc(*size_out);
+	memcpy(copy, scratch, *size_out);
+	return copy;
+}
+
+//Saving a running system has to step it to a point where its state can be captured, so a full
+//state can't be taken at the same point as the final incremental one. Emulation is deterministic
+//though, so the job is run again taking full checkpoints at the same frames instead. Both the
+//final full checkpoint and the chain are then loaded and saved again, which doesn't step the
+//system, and the results compared
+static uint8_t check_checkpoints(batch_job *job, checkpoint_chain *chain)
+{
+	system_media media;
+	memset(&media, 0, sizeof(media));
+	if (!load_media(job->rom, &media)) {
+		return 0;
+	}
+	system_header *system = alloc_job_system(&media, OPT_CHECKPOINTS);
+	if (!system) {
+		free(media.buffer);
+		return 0;
+	}
+	//frames run here shouldn't count towards the job's results
+	batch_job check_job = {
+		.rom = job->rom,
+		.state = job->state,
+		.events = job->events,
+		.num_events = job->num_events,
+		.frames = job->frames
+	};
+	worker->job = &check_job;
+	worker->system = system;
+	system->frame_hash = frame_hashed;
+	rewind_buffer *rw = rewind_interval ? rewind_new(system, rewind_budget, rewind_interval) : NULL;
+	checkpoint_chain full = {
+		.scratch = malloc(chain->scratch_size),
+		.scratch_size = chain->scratch_size,
+		.full = 1
+	};
+	run_frames(&check_job, system, rw, &full);
+	if (rw) {
+		rewind_free(rw);
+	}
+	size_t expected_size, size;
+	uint8_t *expected = NULL;
+	uint8_t ok = full.num_states && check_job.frames_run == job->frames_run
+		&& check_job.video_hash == job->video_hash && check_job.audio_hash == job->audio_hash;
+	if (ok) {
+		expected = load_copy(system, full.states[0], full.sizes[0], full.scratch, full.scratch_size, &expected_size);
+		ok = expected != NULL;
+	}
+	for (uint32_t i = 0; ok && i + 1 < chain->num_states; i++)
+	{
+		ok = system->deserialize(system, chain->states[i], chain->sizes[i]);
+	}
+	if (ok) {
+		uint8_t *last = chain->states[chain->num_states - 1];
+		size_t last_size = chain->sizes[chain->num_states - 1];
+		uint8_t *replayed = load_copy(system, last, last_size, full.scratch, full.scratch_size, &size);
+		ok = replayed && size == expected_size && !memcmp(replayed, expected, size);
+		free(replayed);
+		//the last checkpoint is based on the one before it, which the system is no longer at
+		ok = ok && (chain->num_states < 2 || !system->deserialize(system, last, last_size));
+	}
+	free(expected);
+	free_checkpoints(&full);
+	free_job_system(system);
+	free(media.dir);
+	free(media.name);
+	free(media.extension);
+	worker->job = job;
+	return ok;
+}
+
+static void run_job(batch_job *job)
+{
+	system_media media;
+	memset(&media, 0, sizeof(media));
+	if (!load_media(job->rom, &media)) {
+		job->status = "load_failed";
+		return;
+	}
+	system_header *system = alloc_job_system(&media, checkpoint_interval ? OPT_CHECKPOINTS : 0);
+	if (!system) {
+		job->status = "unsupported";
+		free(media.buffer);
+	} else {
+		worker->job = job;
+		worker->system = system;
+		system->frame_hash = frame_hashed;
+		rewind_buffer *rw = rewind_interval ? rewind_new(system, rewind_budget, rewind_interval) : NULL;
+		checkpoint_chain chain = {0};
+		if (checkpoint_interval && system->serialize_checkpoint) {
+			chain.scratch_size = system->serialize_size(system);
+			chain.scratch = malloc(chain.scratch_size);
+		}
+		run_frames(job, system, rw, &chain);
+		job->status = job->frames_run >= job->frames ? "ok" : "exited";
+		if (rw) {
+			job->snapshots = rw->snapshots;
+			job->delta_bytes = rw->delta_bytes;
+			job->rewind_frames = rewind_frames_available(rw);
+			//walk all the way back through the history to measure restore cost
+			uint64_t start = get_time_ns();
+			while (rewind_step(rw))
+			{
+				job->restores++;
+			}
+			job->restore_ns = get_time_ns() - start;
+			rewind_free(rw);
+		}
+		free_job_system(system);
+		if (chain.num_states && !check_checkpoints(job, &chain)) {
+			job->status = "checkpoint_mismatch";
+		}
+		free_checkpoints(&chain);
+		worker->system = NULL;
+		worker->job = NULL;
+		//let the next system on this thread reuse the translated code buffers
+		mark_all_free();
+	}
+	free(media.dir);
+	free(media.name);
+	free(media.extension);
+}
+
+static void *worker_main(void *data)
+{
+	worker = calloc(1, sizeof(batch_worker));
+	worker->mixer = render_new_audio_mixer();
+	render_set_audio_mixer(worker->mixer);
+	render_set_audio_hashing(1);
+	for (;;)
+	{
+		uint32_t index = __sync_fetch_and_add(&next_job, 1);
+		if (index >= num_jobs) {
+			break;
+		}
+		run_job(jobs + index);
+	}
+	render_free_audio_mixer(worker->mixer);
+	free(worker);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t num_threads = 0, frames = DEFAULT_FRAMES;
+	char *list_path = NULL, *out_path = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-' && argv[i][1] && !argv[i][2] && i + 1 < argc) {
+			switch (argv[i][1])
+			{
+			case 'j':
+				num_threads = atoi(argv[++i]);
+				continue;
+			case 'f':
+				frames = atoi(argv[++i]);
+				continue;
+			case 'o':
+				out_path = argv[++i];
+				continue;
+			case 'r':
+				rewind_interval = atoi(argv[++i]);
+				continue;
+			case 'c':
+				checkpoint_interval = atoi(argv[++i]);
+				continue;
+			case 'm': {
+				int megabytes = atoi(argv[++i]);
+				if (megabytes < 0) {
+					//leaves the switch so the usage message gets printed
+					break;
+				}
+				rewind_budget = (size_t)megabytes * 1024 * 1024;
+				continue;
+			}
+			}
+		} else if (!list_path && argv[i][0] != '-') {
+			list_path = argv[i];
+			continue;
+		}
+		list_path = NULL;
+		break;
+	}
+	if (!list_path) {
+		fatal_error(
+			"Usage: blastem-batch [OPTIONS] JOB_LIST\n"
+			"Options:\n"
+			"	-j THREADS  Number of worker threads (defaults to the number of CPUs)\n"
+			"	-f FRAMES   Default number of frames to run each ROM for\n"
+			"	-o FILE     Write results to FILE instead of stdout\n"
+			"	-r FRAMES   Take a rewind snapshot every FRAMES frames and report its cost\n"
+			"	-m MB       Rewind buffer budget in megabytes (defaults to 4)\n"
+			"	-c FRAMES   Take an incremental checkpoint every FRAMES frames, report their size\n"
+			"	            and cost and check that loading them gives the same state as a\n"
+			"	            second run of the job that takes full checkpoints instead\n"
+			"Each line of JOB_LIST is a ROM path optionally followed by frames=N,\n"
+			"state=SAVESTATE and input=SCRIPT. Input scripts contain lines of the form\n"
+			"FRAME PORT BUTTON down|up\n"
+		);
+	}
+	load_job_list(list_path, frames);
+	if (!num_threads) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = cpus > 0 ? cpus : 1;
+	}
+	if (num_threads > num_jobs) {
+		num_threads = num_jobs ? num_jobs : 1;
+	}
+	FILE *out = stdout;
+	if (out_path) {
+		out = fopen(out_path, "w");
+		if (!out) {
+			fatal_error("Failed to open %s for writing\n", out_path);
+		}
+	}
+	render_audio_initialized(RENDER_AUDIO_S16, 53693175 / (7 * 6 * 24), 2, 4, sizeof(int16_t));
+
+	pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+	for (uint32_t i = 0; i < num_threads; i++)
+	{
+		if (pthread_create(threads + i, NULL, worker_main, NULL)) {
+			fatal_error("Failed to create worker thread\n");
+		}
+	}
+	for (uint32_t i = 0; i < num_threads; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	uint32_t failed = 0;
+	fputs("rom\tstatus\tframes\tvideo_hash\taudio_hash\tavg_frame_us\tmax_frame_us", out);
+	if (rewind_interval) {
+		fputs("\trewind_frames\tavg_delta_bytes\tavg_snapshot_us\tavg_restore_us", out);
+	}
+	if (checkpoint_interval) {
+		fputs("\tfull_checkpoint_bytes\tavg_checkpoint_bytes\tavg_checkpoint_us", out);
+	}
+	fputc('\n', out);
+	for (uint32_t i = 0; i < num_jobs; i++)
+	{
+		batch_job *job = jobs + i;
+		if (strcmp(job->status, "ok")) {
+			failed++;
+		}
+		fprintf(out, "%s\t%s\t%u\t%016llX\t%016llX\t%.1f\t%.1f", job->rom, job->status, job->frames_run,
+			(unsigned long long)job->video_hash, (unsigned long long)job->audio_hash,
+			job->frames_run ? job->total_ns / (1000.0 * job->frames_run) : 0.0, job->max_frame_ns / 1000.0);
+		if (rewind_interval) {
+			fprintf(out, "\t%u\t%.0f\t%.1f\t%.1f", job->rewind_frames,
+				job->snapshots > 1 ? (double)job->delta_bytes / (job->snapshots - 1) : 0.0,
+				job->snapshots ? job->snapshot_ns / (1000.0 * job->snapshots) : 0.0,
+				job->restores ? job->restore_ns / (1000.0 * job->restores) : 0.0);
+		}
+		if (checkpoint_interval) {
+			fprintf(out, "\t%u\t%.0f\t%.1f", (uint32_t)job->full_checkpoint_bytes,
+				job->checkpoints ? (double)job->checkpoint_bytes / job->checkpoints : 0.0,
+				job->checkpoints ? job->checkpoint_ns / (1000.0 * job->checkpoints) : 0.0);
+		}
+		fputc('\n', out);
+	}
+	if (out != stdout) {
+		fclose(out);
+	}
+	return failed ? 1 : 0;
+}
+
+/* render backend API implementation */
+uint32_t render_map_color(uint8_t r, uint8_t g, uint8_t b)
+{
+	return r << 16 | g << 8 | b;
+}
+
+uint8_t render_create_window(char *caption, uint32_t width, uint32_t height, window_close_handler close_handler, void *close_data)
+{
+	return 0;
+}
+
+void render_destroy_window(uint8_t which)
+{
+}
+
+uint32_t *render_get_framebuffer(uint8_t which, int *pitch)
+{
+	*pitch = LINEBUF_SIZE * sizeof(uint32_t);
+	if (which != worker->last_fb) {
+		*pitch = *pitch * 2;
+	}
+	if (which) {
+		return worker->fb + LINEBUF_SIZE;
+	}
+	return worker->fb;
+}
+
+void render_framebuffer_updated(uint8_t which, int width)
+{
+	//frame contents are hashed by the VDP through the system's frame_hash hook
+	worker->last_fb = which;
+	worker->job->frames_run++;
+	system_request_exit(worker->system, 0);
+}
+
+uint8_t render_get_active_framebuffer(void)
+{
+	return 0;
+}
+
+void render_set_video_standard(vid_std std)
+{
+}
+
+int render_fullscreen(void)
+{
+	return 1;
+}
+
+uint32_t render_overscan_top(void)
+{
+	return 0;
+}
+
+uint32_t render_overscan_bot(void)
+{
+	return 0;
+}
+
+void process_events(void)
+{
+}
+
+void render_errorbox(char *title, char *message)
+{
+}
+
+void render_warnbox(char *title, char *message)
+{
+}
+
+void render_infobox(char *title, char *message)
+{
+}
+
+uint8_t render_is_audio_sync(void)
+{
+	return 1;
+}
+
+uint8_t render_should_release_on_exit(void)
+{
+	return 0;
+}
+
+void render_buffer_consumed(audio_source *src)
+{
+}
+
+void *render_new_audio_opaque(void)
+{
+	return NULL;
+}
+
+void render_free_audio_opaque(void *opaque)
+{
+}
+
+void render_lock_audio(void)
+{
+}
+
+void render_unlock_audio(void)
+{
+}
+
+uint32_t render_min_buffered(void)
+{
+	return 4;
+}
+
+uint32_t render_audio_syncs_per_sec(void)
+{
+	return 0;
+}
+
+void render_audio_created(audio_source *src)
+{
+}
+
+void render_do_audio_ready(audio_source *src)
+{
+	int16_t *tmp = src->front;
+	src->front = src->back;
+	src->back = tmp;
+	src->front_populated = 1;
+	src->buffer_pos = 0;
+	if (all_sources_ready()) {
+		int16_t buffer[8];
+		mix_and_convert((uint8_t *)buffer, sizeof(buffer), NULL);
+	}
+}
+
+void render_source_paused(audio_source *src, uint8_t remaining_sources)
+{
+}
+
+void render_source_resumed(audio_source *src)
+{
+}
+
+void render_set_external_sync(uint8_t ext_sync_on)
+{
+}
+
+void bindings_set_mouse_mode(uint8_t mode)
+{
+}
+
+void bindings_release_capture(void)
+{
+}
+
+void bindings_reacquire_capture(void)
+{
+}
+
+extern const char rom_db_data[];
+char *read_bundled_file(char *name, uint32_t *sizeret)
+{
+	if (!strcmp(name, "rom.db")) {
+		*sizeret = strlen(rom_db_data);
+		char *ret = malloc(*sizeret+1);
+		memcpy(ret, rom_db_data, *sizeret + 1);
+		return ret;
+	}
+	return NULL;
+}
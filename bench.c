@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "util.h"
+
+static const char *component_names[BENCH_NUM_COMPONENTS] = {
+	"m68k", "z80", "vdp", "ym2612", "psg", "io"
+};
+
+bench_state *bench_start(uint32_t frames, char *json_path)
+{
+	bench_state *bench = calloc(1, sizeof(bench_state));
+	bench->frames = frames;
+	bench->json_path = json_path;
+	bench->current = BENCH_M68K;
+	bench->start_ns = bench->last_ns = get_time_ns();
+	return bench;
+}
+
+bench_component bench_switch(bench_state *bench, bench_component component)
+{
+	uint64_t now = get_time_ns();
+	bench->component_ns[bench->current] += now - bench->last_ns;
+	bench->last_ns = now;
+	bench_component prev = bench->current;
+	bench->current = component;
+	bench->component_calls[component]++;
+	return prev;
+}
+
+static void write_json(bench_state *bench, char *rom_name, double wall, double fps)
+{
+	FILE *f = fopen(bench->json_path, "w");
+	if (!f) {
+		warning("Failed to open %s for writing\n", bench->json_path);
+		return;
+	}
+	fputs("{\n\t\"rom\": \"", f);
+	for (char *cur = rom_name; cur && *cur; cur++)
+	{
+		if (*cur == '"' || *cur == '\\') {
+			fputc('\\', f);
+		}
+		fputc(*cur, f);
+	}
+	fprintf(f, "\",\n\t\"frames\": %u,\n\t\"wall_seconds\": %.6f,\n\t\"fps\": %.3f,\n\t\"components\": {\n", bench->frames, wall, fps);
+	for (int i = 0; i < BENCH_NUM_COMPONENTS; i++)
+	{
+		double secs = bench->component_ns[i] / 1000000000.0;
+		fprintf(f, "\t\t\"%s\": {\"seconds\": %.6f, \"percent\": %.3f, \"calls\": %llu}%s\n",
+			component_names[i], secs, wall > 0 ? 100.0 * secs / wall : 0.0,
+			(unsigned long long)bench->component_calls[i], i == BENCH_NUM_COMPONENTS - 1 ? "" : ","
+		);
+	}
+	fputs("\t}\n}\n", f);
+	fclose(f);
+}
+
+void bench_finish(bench_state *bench, char *rom_name)
+{
+	if (!bench) {
+		return;
+	}
+	bench_switch(bench, bench->current);
+	double wall = (bench->last_ns - bench->start_ns) / 1000000000.0;
+	double fps = wall > 0 ? bench->frames / wall : 0;
+	printf("Benchmark: %u frames in %.3f seconds, %.2f frames per second\n", bench->frames, wall, fps);
+	for (int i = 0; i < BENCH_NUM_COMPONENTS; i++)
+	{
+		double secs = bench->component_ns[i] / 1000000000.0;
+		printf("\t%-8s %9.3f s %6.2f%% %12llu calls\n", component_names[i], secs, wall > 0 ? 100.0 * secs / wall : 0.0, (unsigned long long)bench->component_calls[i]);
+	}
+	if (bench->json_path) {
+		write_json(bench, rom_name, wall, fps);
+	}
+	free(bench);
+}
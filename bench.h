@@ -0,0 +1,46 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+
+typedef enum {
+	BENCH_M68K,
+	BENCH_Z80,
+	BENCH_VDP,
+	BENCH_YM,
+	BENCH_PSG,
+	BENCH_IO,
+	BENCH_NUM_COMPONENTS
+} bench_component;
+
+typedef struct {
+	uint64_t        component_ns[BENCH_NUM_COMPONENTS];
+	uint64_t        component_calls[BENCH_NUM_COMPONENTS];
+	uint64_t        start_ns;
+	uint64_t        last_ns;
+	char            *json_path;
+	uint32_t        frames;
+	bench_component current;
+} bench_state;
+
+//Starts collecting timing information, frames is the number of frames that will be run
+bench_state *bench_start(uint32_t frames, char *json_path);
+//Switches the component time is being charged to, returns the previously active component
+bench_component bench_switch(bench_state *bench, bench_component component);
+//Stops collecting timing information, prints a report to stdout (and optionally a JSON file) and frees bench
+void bench_finish(bench_state *bench, char *rom_name);
+
+//Time spent outside of any instrumented component (translated 68K code and sync glue) is charged to BENCH_M68K
+static inline bench_component bench_enter(bench_state *bench, bench_component component)
+{
+	return bench ? bench_switch(bench, component) : component;
+}
+
+static inline void bench_leave(bench_state *bench, bench_component previous)
+{
+	if (bench) {
+		bench_switch(bench, previous);
+	}
+}
+
+#endif //BENCH_H_
@@ -26,6 +26,7 @@ typedef enum {
 	UI_DEBUG_MODE_INC,
 	UI_ENTER_DEBUGGER,
 	UI_SAVE_STATE,
+	UI_REWIND,
 	UI_SET_SPEED,
 	UI_NEXT_SPEED,
 	UI_PREV_SPEED,
@@ -209,6 +210,11 @@ void handle_binding_down(keybinding * binding)
 	{
 		current_system->mouse_down(current_system, binding->subtype_a, binding->subtype_b);
 	}
+	else if (binding->bind_type == BIND_UI && binding->subtype_a == UI_REWIND && content_binds_enabled)
+	{
+		//held rather than triggered on release like the other UI bindings
+		current_system->rewinding = 1;
+	}
 }
 
 static uint8_t keyboard_captured;
@@ -325,6 +331,11 @@ void handle_binding_up(keybinding * binding)
 				current_system->save_state = QUICK_SAVE_SLOT+1;
 			}
 			break;
+		case UI_REWIND:
+			if (current_system) {
+				current_system->rewinding = 0;
+			}
+			break;
 		case UI_NEXT_SPEED:
 			if (allow_content_binds) {
 				current_speed++;
@@ -630,6 +641,8 @@ int parse_binding_target(int device_num, char * target, tern_node * padbuttons,
 			*subtype_a = UI_ENTER_DEBUGGER;
 		} else if(!strcmp(target + 3, "save_state")) {
 			*subtype_a = UI_SAVE_STATE;
+		} else if(!strcmp(target + 3, "rewind")) {
+			*subtype_a = UI_REWIND;
 		} else if(startswith(target + 3, "set_speed.")) {
 			*subtype_a = UI_SET_SPEED;
 			*subtype_b = atoi(target + 3 + strlen("set_speed."));
@@ -19,6 +19,7 @@
 #include "mem.h"
 #include "vdp.h"
 #include "render.h"
+#include "render_audio.h"
 #include "genesis.h"
 #include "gdb_remote.h"
 #include "gst.h"
@@ -31,6 +32,8 @@
 #include "menu.h"
 #include "zip.h"
 #include "event_log.h"
+#include "bench.h"
+#include "rewind.h"
 #ifndef DISABLE_NUKLEAR
 #include "nuklear_ui/blastem_nuklear.h"
 #endif
@@ -292,6 +295,35 @@ const char *get_save_fname(uint8_t save_type)
 	}
 }
 
+static FILE *frame_hash_log;
+static void log_frame_hash(system_header *system, uint32_t frame, uint64_t video_hash, uint64_t audio_hash)
+{
+	fprintf(frame_hash_log, "%u %016llX %016llX\n", frame, (unsigned long long)video_hash, (unsigned long long)audio_hash);
+}
+
+static void setup_frame_hash(system_header *context)
+{
+	if (frame_hash_log) {
+		context->frame_hash = log_frame_hash;
+	}
+}
+
+static void setup_rewind(system_header *context)
+{
+	int megabytes = atoi(tern_find_path_default(config, "system\0rewind_buffer\0", (tern_val){.ptrval = "0"}, TVAL_PTR).ptrval);
+	if (megabytes > 0) {
+		//the system snapshots itself at the end of every frame while this is set
+		context->rewind = rewind_new(context, (size_t)megabytes * 1024 * 1024, 1);
+	}
+}
+
+static void setup_run_ahead(system_header *context)
+{
+	int frames = atoi(tern_find_path_default(config, "system\0run_ahead\0", (tern_val){.ptrval = "0"}, TVAL_PTR).ptrval);
+	//same range the libretro core offers, every extra frame costs a full frame of emulation
+	context->run_ahead = frames < 0 ? 0 : frames > 4 ? 4 : frames;
+}
+
 void setup_saves(system_media *media, system_header *context)
 {
 	static uint8_t persist_save_registered;
@@ -406,6 +438,9 @@ void init_system_with_media(const char *path, system_type force_stype)
 			current_system->arena = set_current_arena(game_system->arena);
 		}
 		mark_all_free();
+		if (game_system->rewind) {
+			rewind_free(game_system->rewind);
+		}
 		game_system->free_context(game_system);
 	} else if(current_system) {
 		//start a new arena and save old one in suspended system context
@@ -440,6 +475,9 @@ void init_system_with_media(const char *path, system_type force_stype)
 	}
 	game_system->next_context = menu_system;
 	setup_saves(&cart, game_system);
+	setup_frame_hash(game_system);
+	setup_rewind(game_system);
+	setup_run_ahead(game_system);
 	update_title(game_system->info.name);
 }
 
@@ -471,6 +509,7 @@ int main(int argc, char ** argv)
 	system_type stype = SYSTEM_UNKNOWN, force_stype = SYSTEM_UNKNOWN;
 	char * romfname = NULL;
 	char * statefile = NULL;
+	char *bench_json = NULL;
 	char *reader_addr = NULL, *reader_port = NULL;
 	event_reader reader = {0};
 	debugger_type dtype = DEBUGGER_NATIVE;
@@ -581,6 +620,24 @@ int main(int argc, char ** argv)
 				cart.chain = &lock_on;
 				break;
 			}
+			case 'j':
+				i++;
+				if (i >= argc) {
+					fatal_error("-j must be followed by a file name\n");
+				}
+				bench_json = argv[i];
+				break;
+			case 'H':
+				i++;
+				if (i >= argc) {
+					fatal_error("-H must be followed by a file name\n");
+				}
+				frame_hash_log = fopen(argv[i], "w");
+				if (!frame_hash_log) {
+					fatal_error("Failed to open %s for writing\n", argv[i]);
+				}
+				render_set_audio_hashing(1);
+				break;
 			case 'h':
 				info_message(
 					"Usage: blastem [OPTIONS] ROMFILE [WIDTH] [HEIGHT]\n"
@@ -594,6 +651,9 @@ int main(int argc, char ** argv)
 					"	-f          Toggles fullscreen mode\n"
 					"	-g          Disable OpenGL rendering\n"
 					"	-s FILE     Load a GST format savestate from FILE\n"
+					"	-b FRAMES   Run FRAMES frames headless and print a timing breakdown\n"
+					"	-j FILE     Write -b timing results to FILE in JSON format\n"
+					"	-H FILE     Write per-frame video and audio hashes to FILE\n"
 					"	-o FILE     Load FILE as a lock-on cartridge\n"
 					"	-d          Enter debugger on startup\n"
 					"	-n          Disable Z80\n"
@@ -717,6 +777,9 @@ int main(int argc, char ** argv)
 			menu_system = current_system;
 		} else {
 			game_system = current_system;
+			setup_frame_hash(game_system);
+			setup_rewind(game_system);
+			setup_run_ahead(game_system);
 		}
 	}
 	
@@ -738,11 +801,15 @@ int main(int argc, char ** argv)
 		//free inflate stream as it was inflateCopied to an internal event reader in the player
 		inflateEnd(&reader.input_stream);
 		setup_saves(&cart, current_system);
+		setup_frame_hash(current_system);
 		update_title(current_system->info.name);
 	}
 	
 	current_system->debugger_type = dtype;
 	current_system->enter_debugger = start_in_debugger && menu == debug_target;
+	if (exit_after) {
+		current_system->bench = bench_start(exit_after, bench_json);
+	}
 	current_system->start_context(current_system,  menu ? NULL : statefile);
 	render_video_loop();
 	for(;;)
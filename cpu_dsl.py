@@ -1,5 +1,13 @@
 #!/usr/bin/env python3
 
+#raised while generating a predecoded handler when a dispatch depends on a stream byte that isn't fixed yet
+class PredecodeFork(Exception):
+	def __init__(self, index):
+		self.index = index
+
+#raised when an instruction can't get a predecoded handler and has to use the normal fetch path
+class PredecodeStop(Exception):
+	pass
 
 class Block:
 	def addOp(self, op):
@@ -27,6 +35,9 @@ class Block:
 			else:
 				flagUpdates = None
 			oplist[i].generate(prog, self, fieldVals, output, otype, flagUpdates)
+			if prog.predecodeDispatched and i + 1 < len(oplist):
+				#an inlined dispatch doesn't jump away, so nothing can follow it
+				raise PredecodeStop()
 		
 	def resolveLocal(self, name):
 		return None
@@ -175,6 +186,22 @@ class Instruction(Block):
 		if prog.dispatch == 'goto':
 			output += prog.nextInstruction(otype)
 		return begin + ''.join(output) + '\n}'
+	
+	#generates the body in place of a dispatch for a predecoded handler
+	def inlineBody(self, value, prog, otype, output):
+		prog.meta = {}
+		prog.pushScope(self)
+		self.regValues = {}
+		self.newLocals = []
+		fieldVals,_ = self.getFieldVals(value)
+		body = []
+		self.processOps(prog, fieldVals, body, otype, self.implementation)
+		prog.popScope()
+		output.append('\n\t{')
+		for var in self.locals:
+			output.append('\n\tuint{sz}_t {name};'.format(sz=self.locals[var], name=var))
+		output += body
+		output.append('\n\t}')
 		
 	def __str__(self):
 		pieces = [self.name + ' ' + hex(self.value) + ' ' + str(self.fields)]
@@ -406,11 +433,13 @@ def _xchgCImpl(prog, params, rawParams):
 	decl,name = prog.getTemp(size)
 	return decl + '\n\t{tmp} = {a};\n\t{a} = {b};\n\t{b} = {tmp};'.format(a = params[0], b = params[1], tmp = name)
 
-def _dispatchCImpl(prog, params):
+def _dispatchCImpl(prog, params, rawParams):
 	if len(params) == 1:
 		table = 'main'
 	else:
 		table = params[1]
+	if not prog.predecodeFixed is None:
+		return prog.predecodeDispatch(params[0], rawParams[0], table)
 	if prog.dispatch == 'call':
 		return '\n\timpl_{tbl}[{op}](context, target_cycle);'.format(tbl = table, op = params[0])
 	elif prog.dispatch == 'goto':
@@ -904,6 +933,8 @@ class NormalOp:
 		elif self.op == 'dis':
 			#TODO: Disassembler
 			pass
+		elif self.op == 'predecoded':
+			prog.predecodedByte(self.params[0], parent, fieldVals, output, otype)
 		elif not opDef is None:
 			if opDef.numParams() > len(procParams):
 				raise Exception('Insufficient params for ' + self.op + ' (' + ', '.join(self.params) + ')')
@@ -1475,6 +1506,16 @@ class Program:
 		self.conditional = False
 		self.declares = []
 		self.lastSize = None
+		self.tableMaps = {}
+		predecode = info.get('predecode')
+		if predecode:
+			self.predecodeBytes = int(predecode[0])
+			self.predecodeLookup = predecode[1]
+			self.predecodeFill = predecode[2]
+		else:
+			self.predecodeBytes = 0
+		self.predecodeFixed = None
+		self.predecodeDispatched = False
 		
 	def __str__(self):
 		pieces = []
@@ -1492,6 +1533,11 @@ class Program:
 		hFile.write('#ifndef {0}_'.format(macro))
 		hFile.write('\n#define {0}_'.format(macro))
 		hFile.write('\n#include "backend.h"')
+		if self.predecodeBytes:
+			hFile.write('\n\ntypedef struct {')
+			hFile.write('\n\tint32_t handler;')
+			hFile.write('\n\tuint{sz}_t stream[{n}];'.format(sz = self.opsize, n = self.predecodeBytes))
+			hFile.write('\n}} {0}decoded;'.format(self.prefix))
 		hFile.write('\n\ntypedef struct {')
 		hFile.write('\n\tcpu_options gen;')
 		hFile.write('\n}} {0}options;'.format(self.prefix))
@@ -1507,16 +1553,28 @@ class Program:
 		hFile.write('\n')
 		hFile.close()
 		
+	def _tableInstructions(self, table):
+		if not table in self.tableMaps:
+			instmap = [None] * (1 << self.opsize)
+			if table in self.instructions:
+				instructions = self.instructions[table]
+				instructions.sort()
+				for inst in instructions:
+					for val in inst.allValues():
+						if instmap[val] is None:
+							instmap[val] = inst
+			self.tableMaps[table] = instmap
+		return self.tableMaps[table]
+		
 	def _buildTable(self, otype, table, body, lateBody):
 		pieces = []
 		opmap = [None] * (1 << self.opsize)
 		bodymap = {}
+		instmap = self._tableInstructions(table)
 		if table in self.instructions:
-			instructions = self.instructions[table]
-			instructions.sort()
-			for inst in instructions:
+			for inst in self.instructions[table]:
 				for val in inst.allValues():
-					if opmap[val] is None:
+					if opmap[val] is None and instmap[val] is inst:
 						self.meta = {}
 						self.temp = {}
 						self.needFlagCoalesce = False
@@ -1563,10 +1621,156 @@ class Program:
 			
 			self.meta = {}
 			self.temp = {}
-			self.subroutines[self.body].inline(self, [], output, otype, None)
+			if self.predecodeBytes:
+				output.append('\n\tdecoded = {fun}(context);'.format(fun = self.predecodeLookup))
+				output.append('\n\tif (!decoded) { goto predecode_slow; }')
+				output.append('\n\tgoto *(&&predecode_fill + decoded->handler);')
+			else:
+				self.subroutines[self.body].inline(self, [], output, otype, None)
 		return output
 	
+	def _predecodeHandler(self, otype, fixed, lateBody):
+		self.meta = {}
+		self.temp = {}
+		self.needFlagCoalesce = False
+		self.needFlagDisperse = False
+		self.lastOp = None
+		self.predecodeFixed = fixed
+		self.predecodeIndex = 0
+		self.predecodeSources = {}
+		self.predecodeTables = []
+		self.predecodeDispatched = False
+		self.booleans['predecode'] = True
+		output = []
+		body = self.subroutines[self.body]
+		body.regValues = {}
+		try:
+			body.inline(self, [], output, otype, None)
+		finally:
+			#generation can stop anywhere, so put back everything that assumes it ran to the end
+			self.predecodeFixed = None
+			self.predecodeDispatched = False
+			self.booleans['predecode'] = False
+			self.scopes = []
+			self.currentScope = None
+			self.conditional = False
+			body.regValues = {}
+		name = 'predecode_' + '_'.join(['{0:02X}'.format(fixed[index]) for index in sorted(fixed)])
+		begin = '\n' + name + ': {'
+		if self.needFlagCoalesce:
+			begin += self.flags.coalesceFlags(self, otype)
+		if self.needFlagDisperse:
+			output.append(self.flags.disperseFlags(self, otype))
+		for size in self.temp:
+			begin += '\n\tuint{sz}_t gen_tmp{sz}__;'.format(sz=size)
+		output += self.nextInstruction(otype)
+		lateBody.append(begin + ''.join(output) + '\n}')
+		return name
+	
+	#returns the handler name for an instruction, None if it has to use the normal fetch path
+	#or a (stream index, children) tuple if the handler depends on another stream byte
+	def _predecodeNode(self, otype, fixed, lateBody):
+		try:
+			return self._predecodeHandler(otype, fixed, lateBody)
+		except PredecodeFork as fork:
+			children = []
+			for value in range(0, 1 << self.opsize):
+				childFixed = dict(fixed)
+				childFixed[fork.index] = value
+				children.append(self._predecodeNode(otype, childFixed, lateBody))
+			return (fork.index, children)
+		except PredecodeStop:
+			return None
+	
+	def _predecodeLookup(self, node, tables, output):
+		index,children = node
+		tableName = 'predecode_table{0}'.format(len(tables))
+		entries = []
+		tables.append((tableName, entries))
+		subNodes = []
+		for value in range(0, len(children)):
+			child = children[value]
+			if type(child) is str:
+				entries.append(child)
+			else:
+				entries.append('predecode_slow')
+				if not child is None:
+					subNodes.append((value, child))
+		lookup = '\n\tdecoded->handler = {tbl}[decoded->stream[{idx}]];'.format(tbl = tableName, idx = index)
+		if subNodes:
+			output.append('\n\tswitch(decoded->stream[{0}])'.format(index))
+			output.append('\n\t{')
+			for value,child in subNodes:
+				output.append('\n\tcase {0}U:'.format(value))
+				self._predecodeLookup(child, tables, output)
+				output.append('\n\tbreak;')
+			output.append('\n\tdefault:')
+			output.append(lookup)
+			output.append('\n\t}')
+		else:
+			output.append(lookup)
+	
+	def _buildPredecode(self, otype, body, lateBody):
+		root = self._predecodeNode(otype, {}, lateBody)
+		fill = []
+		if type(root) is tuple:
+			tables = []
+			self._predecodeLookup(root, tables, fill)
+			for tableName,entries in tables:
+				body.append('\n\tstatic const int32_t {name}[{sz}] = {{'.format(name = tableName, sz = len(entries)))
+				for entry in entries:
+					body.append('\n\t\t&&{0} - &&predecode_fill,'.format(entry))
+				body.append('\n\t};')
+		else:
+			fill.append('\n\tdecoded->handler = &&{0} - &&predecode_fill;'.format(root or 'predecode_slow'))
+		
+		lateBody.append('\npredecode_slow:')
+		self.meta = {}
+		self.temp = {}
+		self.subroutines[self.body].regValues = {}
+		self.subroutines[self.body].inline(self, [], lateBody, otype, None)
+		lateBody.append('\npredecode_fill:')
+		lateBody.append('\n\tif ({fun}(context, decoded)) {{'.format(fun = self.predecodeFill))
+		lateBody += fill
+		lateBody.append('\n\t} else {')
+		lateBody.append('\n\tdecoded->handler = &&predecode_slow - &&predecode_fill;')
+		lateBody.append('\n\t}')
+		lateBody.append('\n\tgoto *(&&predecode_fill + decoded->handler);')
+	
+	def predecodedByte(self, dst, parent, fieldVals, output, otype):
+		if self.predecodeFixed is None:
+			raise Exception('predecoded can only be used when generating predecoded handlers')
+		index = self.predecodeIndex
+		self.predecodeIndex += 1
+		if index >= self.predecodeBytes or self.conditional:
+			raise PredecodeStop()
+		if index in self.predecodeFixed:
+			src = str(self.predecodeFixed[index])
+		else:
+			src = 'decoded->stream[{0}]'.format(index)
+			self.predecodeSources[dst] = index
+		NormalOp(['mov', src, dst]).generate(self, parent, fieldVals, output, otype, None)
+	
+	def predecodeDispatch(self, value, rawValue, table):
+		if not type(value) is int:
+			index = self.predecodeSources.get(rawValue)
+			if index is None or index in self.predecodeFixed:
+				raise PredecodeStop()
+			raise PredecodeFork(index)
+		if table in self.predecodeTables:
+			raise PredecodeStop()
+		inst = self._tableInstructions(table)[value]
+		if inst is None:
+			raise PredecodeStop()
+		self.predecodeTables.append(table)
+		output = []
+		inst.inlineBody(value, self, 'c', output)
+		self.predecodeDispatched = True
+		return ''.join(output)
+	
 	def build(self, otype):
+		if self.predecodeBytes and self.dispatch != 'goto':
+			raise Exception('predecode requires goto dispatch')
 		body = []
 		pieces = []
 		for include in self.includes:
@@ -1609,6 +1813,9 @@ class Program:
 			pieces.append('\n\t}')
 			pieces.append('\n}')
 		elif self.dispatch == 'goto':
+			if self.predecodeBytes:
+				self._buildPredecode(otype, body, pieces)
+				body.append('\n\t{pre}decoded *decoded;'.format(pre = self.prefix))
 			body.append('\n\t{sync}(context, target_cycle);'.format(sync=self.sync_cycle))
 			body += self.nextInstruction(otype)
 			pieces.append('\nunimplemented:')
@@ -1846,6 +2053,7 @@ def parse(args):
 		p.declares = declares
 		p.booleans['dynarec'] = False
 		p.booleans['interp'] = True
+		p.booleans['predecode'] = False
 		if args.define:
 			for define in args.define:
 				name,sep,val = define.partition('=')
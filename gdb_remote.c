@@ -141,6 +141,9 @@ static uint8_t m68k_read_byte(m68k_context *context, uint32_t address)
 void m68k_write_byte(m68k_context * context, uint32_t address, uint8_t value)
 {
 	genesis_context *gen = context->system;
+	//these writes don't go through the dirty page tracking, so an incremental state
+	//can no longer be loaded on top of the current checkpoint
+	gen->checkpoint_id = 0;
 	//TODO: Use generated read/write functions so that memory map is properly respected
 	uint16_t * word = get_native_pointer(address & 0xFFFFFFFE, (void **)context->mem_pointers, &context->options->gen);
 	if (word) {
@@ -197,9 +200,9 @@ void gdb_run_command(m68k_context * context, uint32_t pc, char * command)
 		uint32_t after = pc + (after_pc-pc_ptr)*2;
 
 		if (inst.op == M68K_RTS) {
-			after = (read_dma_value(context->aregs[7]/2) << 16) | read_dma_value(context->aregs[7]/2 + 1);
+			after = (read_dma_value(&gen->header, context->aregs[7]/2) << 16) | read_dma_value(&gen->header, context->aregs[7]/2 + 1);
 		} else if (inst.op == M68K_RTE || inst.op == M68K_RTR) {
-			after = (read_dma_value((context->aregs[7]+2)/2) << 16) | read_dma_value((context->aregs[7]+2)/2 + 1);
+			after = (read_dma_value(&gen->header, (context->aregs[7]+2)/2) << 16) | read_dma_value(&gen->header, (context->aregs[7]+2)/2 + 1);
 		} else if(m68k_is_branch(&inst)) {
 			if (inst.op == M68K_BCC && inst.extra.cond != COND_TRUE) {
 				branch_f = after;
@@ -425,9 +428,9 @@ void gdb_run_command(m68k_context * context, uint32_t pc, char * command)
 				uint32_t after = pc + (after_pc-pc_ptr)*2;
 
 				if (inst.op == M68K_RTS) {
-					after = (read_dma_value(context->aregs[7]/2) << 16) | read_dma_value(context->aregs[7]/2 + 1);
+					after = (read_dma_value(&gen->header, context->aregs[7]/2) << 16) | read_dma_value(&gen->header, context->aregs[7]/2 + 1);
 				} else if (inst.op == M68K_RTE || inst.op == M68K_RTR) {
-					after = (read_dma_value((context->aregs[7]+2)/2) << 16) | read_dma_value((context->aregs[7]+2)/2 + 1);
+					after = (read_dma_value(&gen->header, (context->aregs[7]+2)/2) << 16) | read_dma_value(&gen->header, (context->aregs[7]+2)/2 + 1);
 				} else if(m68k_is_branch(&inst)) {
 					if (inst.op == M68K_BCC && inst.extra.cond != COND_TRUE) {
 						branch_f = after;
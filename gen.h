@@ -7,7 +7,7 @@ typedef uint8_t code_word;
 #define RESERVE_WORDS 5 //opcode + 4-byte displacement
 #else
 typedef uint32_t code_word;
-#define RESERVE_WORDS 4 //1 push + 1 ldr + 1bx + 1 constant
+#define RESERVE_WORDS 4 //ARM: 1 push + 1 ldr + 1bx + 1 constant, AArch64: 1 ldr + 1 br + 2 word constant
 #endif
 typedef code_word * code_ptr;
 #define CODE_ALLOC_SIZE (1024*1024)
@@ -0,0 +1,662 @@
+#include "gen_arm64.h"
+#include "mem.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+//Data processing, shifted register form with a shift of 0
+#define OP_AND  0x0A000000u
+#define OP_BIC  0x0A200000u
+#define OP_ORR  0x2A000000u
+#define OP_ORN  0x2A200000u
+#define OP_EOR  0x4A000000u
+#define OP_ANDS 0x6A000000u
+#define OP_BICS 0x6A200000u
+#define OP_ADD  0x0B000000u
+#define OP_SUB  0x4B000000u
+#define OP_ADC  0x1A000000u
+#define OP_SBC  0x5A000000u
+
+//Data processing, immediate form
+#define OP_ADDI  0x11000000u
+#define OP_SUBI  0x51000000u
+#define OP_ANDI  0x12000000u
+#define OP_ORRI  0x32000000u
+#define OP_EORI  0x52000000u
+#define OP_ANDSI 0x72000000u
+#define OP_MOVN  0x12800000u
+#define OP_MOVZ  0x52800000u
+#define OP_MOVK  0x72800000u
+#define OP_SBFM  0x13000000u
+#define OP_UBFM  0x53000000u
+#define SHIFT_12 0x400000u
+#define N_BIT    0x400000u
+
+//Data processing, two and three source
+#define OP_LSLV  0x1AC02000u
+#define OP_LSRV  0x1AC02400u
+#define OP_ASRV  0x1AC02800u
+#define OP_RORV  0x1AC02C00u
+#define OP_UDIV  0x1AC00800u
+#define OP_SDIV  0x1AC00C00u
+#define OP_MADD  0x1B000000u
+#define OP_CSEL  0x1A800000u
+#define OP_CSINC 0x1A800400u
+
+//branch instructions
+#define OP_B     0x14000000u
+#define OP_BL    0x94000000u
+#define OP_BCC   0x54000000u
+#define OP_CBZ   0x34000000u
+#define OP_CBNZ  0x35000000u
+#define OP_BR    0xD61F0000u
+#define OP_BLR   0xD63F0000u
+#define OP_RET   0xD65F0000u
+
+//load/store, the size is in the top two bits
+#define OP_STR    0x39000000u
+#define OP_LDR    0x39400000u
+//clearing this bit selects the unscaled and indexed forms which take a signed 9-bit offset
+#define UNSIGNED_OFF 0x01000000u
+#define PRE_IND   0x00000C00u
+#define POST_IND  0x00000400u
+#define MEM_B     0x00000000u
+#define MEM_H     0x40000000u
+#define MEM_W     0x80000000u
+#define MEM_X     0xC0000000u
+#define OP_LDR_LIT 0x58000000u
+#define OP_STP_PRE 0xA9800000u
+#define OP_LDP_POST 0xA8C00000u
+
+//pushes and pops move sp by 16 bytes so it stays aligned as the ABI requires
+#define STACK_SLOT 16
+
+//returns the N:immr:imms fields for a bitmask immediate or INVALID_IMMED if val can't be encoded as one
+uint32_t make_logical_immed(uint64_t val, uint32_t size)
+{
+	if (size == SZ_W) {
+		val &= 0xFFFFFFFF;
+		val |= val << 32;
+	}
+	if (!val || val == 0xFFFFFFFFFFFFFFFFull) {
+		return INVALID_IMMED;
+	}
+	//find the smallest element that repeats to make up the whole value
+	uint32_t elsize = 64;
+	while (elsize > 2)
+	{
+		uint32_t half = elsize / 2;
+		uint64_t mask = (1ull << half) - 1;
+		if ((val & mask) != (val >> half & mask)) {
+			break;
+		}
+		elsize = half;
+	}
+	uint64_t mask = elsize == 64 ? 0xFFFFFFFFFFFFFFFFull : (1ull << elsize) - 1;
+	uint64_t elem = val & mask;
+	//the element has to be a run of ones rotated right by immr
+	for (uint32_t rot = 0; rot < elsize; rot++)
+	{
+		uint64_t ones = rot ? (elem << rot | elem >> (elsize - rot)) & mask : elem;
+		if (!(ones & (ones + 1))) {
+			uint32_t count = 0;
+			for (; ones; ones >>= 1)
+			{
+				count++;
+			}
+			uint32_t imms = (~(elsize * 2 - 1) & 0x3F) | (count - 1);
+			return (elsize == 64 ? N_BIT : 0) | rot << 16 | imms << 10;
+		}
+	}
+	return INVALID_IMMED;
+}
+
+static void emit(code_info *code, uint32_t instruction)
+{
+	check_alloc_code(code, 1);
+	*(code->cur++) = instruction;
+}
+
+static void far_jump(uint32_t *from, uint32_t *dst)
+{
+	ptrdiff_t disp = dst - from;
+	if (disp < 0x2000000 && disp >= -0x2000000) {
+		*from = OP_B | (disp & 0x3FFFFFF);
+	} else {
+		//load the target from the two words after the br
+		uint64_t target = (uint64_t)dst;
+		from[0] = OP_LDR_LIT | 2 << 5 | SCRATCH1;
+		from[1] = OP_BR | SCRATCH1 << 5;
+		from[2] = target;
+		from[3] = target >> 32;
+	}
+}
+
+void check_alloc_code(code_info *code, uint32_t inst_size)
+{
+	if (code->cur + inst_size > code->last) {
+		size_t size = CODE_ALLOC_SIZE;
+		uint32_t *next_code = alloc_code(&size);
+		if (!next_code) {
+			fatal_error("Failed to allocate memory for generated code\n");
+		}
+		if (next_code != code->last + RESERVE_WORDS) {
+			//new chunk is not contiguous with the current one
+			far_jump(code->cur, next_code);
+			code->cur = next_code;
+		}
+		code->last = next_code + size/sizeof(code_word) - RESERVE_WORDS;
+	}
+}
+
+static uint32_t data_proc(code_info *code, uint32_t op, uint32_t size, uint32_t dst, uint32_t src1, uint32_t src2)
+{
+	emit(code, op | size | src2 << 16 | src1 << 5 | dst);
+	return CODE_OK;
+}
+
+static uint32_t data_proci(code_info *code, uint32_t op, uint32_t size, uint32_t dst, uint32_t src1, uint32_t immed)
+{
+	if (immed >= 0x1000) {
+		if (immed & 0xFFF || immed >= 0x1000000) {
+			return INVALID_IMMED;
+		}
+		immed = immed >> 12;
+		op |= SHIFT_12;
+	}
+	emit(code, op | size | immed << 10 | src1 << 5 | dst);
+	return CODE_OK;
+}
+
+static uint32_t logical_immed(code_info *code, uint32_t op, uint32_t size, uint32_t dst, uint32_t src1, uint64_t immed)
+{
+	uint32_t fields = make_logical_immed(immed, size);
+	if (fields == INVALID_IMMED) {
+		return fields;
+	}
+	emit(code, op | size | fields | src1 << 5 | dst);
+	return CODE_OK;
+}
+
+static uint32_t add_sub_immed(code_info *code, uint32_t op, uint32_t neg_op, uint32_t dst, uint32_t src1, int32_t immed, uint32_t size, uint32_t set_cond)
+{
+	if (immed < 0) {
+		op = neg_op;
+		immed = -immed;
+	}
+	return data_proci(code, op | set_cond, size, dst, src1, immed);
+}
+
+//TODO: support shifted and extended register forms for op2
+
+uint32_t and(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond)
+{
+	return data_proc(code, set_cond ? OP_ANDS : OP_AND, size, dst, src1, src2);
+}
+
+uint32_t andi(code_info *code, uint32_t dst, uint32_t src1, uint64_t immed, uint32_t size, uint32_t set_cond)
+{
+	return logical_immed(code, set_cond ? OP_ANDSI : OP_ANDI, size, dst, src1, immed);
+}
+
+uint32_t bic(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond)
+{
+	return data_proc(code, set_cond ? OP_BICS : OP_BIC, size, dst, src1, src2);
+}
+
+uint32_t orr(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size)
+{
+	return data_proc(code, OP_ORR, size, dst, src1, src2);
+}
+
+uint32_t orri(code_info *code, uint32_t dst, uint32_t src1, uint64_t immed, uint32_t size)
+{
+	return logical_immed(code, OP_ORRI, size, dst, src1, immed);
+}
+
+uint32_t eor(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size)
+{
+	return data_proc(code, OP_EOR, size, dst, src1, src2);
+}
+
+uint32_t eori(code_info *code, uint32_t dst, uint32_t src1, uint64_t immed, uint32_t size)
+{
+	return logical_immed(code, OP_EORI, size, dst, src1, immed);
+}
+
+uint32_t add(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond)
+{
+	return data_proc(code, OP_ADD | set_cond, size, dst, src1, src2);
+}
+
+uint32_t addi(code_info *code, uint32_t dst, uint32_t src1, int32_t immed, uint32_t size, uint32_t set_cond)
+{
+	return add_sub_immed(code, OP_ADDI, OP_SUBI, dst, src1, immed, size, set_cond);
+}
+
+uint32_t sub(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond)
+{
+	return data_proc(code, OP_SUB | set_cond, size, dst, src1, src2);
+}
+
+uint32_t subi(code_info *code, uint32_t dst, uint32_t src1, int32_t immed, uint32_t size, uint32_t set_cond)
+{
+	return add_sub_immed(code, OP_SUBI, OP_ADDI, dst, src1, immed, size, set_cond);
+}
+
+uint32_t adc(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond)
+{
+	return data_proc(code, OP_ADC | set_cond, size, dst, src1, src2);
+}
+
+uint32_t sbc(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond)
+{
+	return data_proc(code, OP_SBC | set_cond, size, dst, src1, src2);
+}
+
+uint32_t tst(code_info *code, uint32_t src1, uint32_t src2, uint32_t size)
+{
+	return data_proc(code, OP_ANDS, size, zr, src1, src2);
+}
+
+uint32_t tsti(code_info *code, uint32_t src1, uint64_t immed, uint32_t size)
+{
+	return logical_immed(code, OP_ANDSI, size, zr, src1, immed);
+}
+
+uint32_t cmp(code_info *code, uint32_t src1, uint32_t src2, uint32_t size)
+{
+	return data_proc(code, OP_SUB | SET_COND, size, zr, src1, src2);
+}
+
+uint32_t cmpi(code_info *code, uint32_t src1, int32_t immed, uint32_t size)
+{
+	return add_sub_immed(code, OP_SUBI, OP_ADDI, zr, src1, immed, size, SET_COND);
+}
+
+uint32_t cmn(code_info *code, uint32_t src1, uint32_t src2, uint32_t size)
+{
+	return data_proc(code, OP_ADD | SET_COND, size, zr, src1, src2);
+}
+
+uint32_t cmni(code_info *code, uint32_t src1, int32_t immed, uint32_t size)
+{
+	return add_sub_immed(code, OP_ADDI, OP_SUBI, zr, src1, immed, size, SET_COND);
+}
+
+uint32_t mov(code_info *code, uint32_t dst, uint32_t src, uint32_t size)
+{
+	if (dst == sp || src == sp) {
+		//orr treats register 31 as the zero register, add #0 treats it as sp
+		return data_proci(code, OP_ADDI, size, dst, src, 0);
+	}
+	return data_proc(code, OP_ORR, size, dst, zr, src);
+}
+
+uint32_t movi(code_info *code, uint32_t dst, uint64_t immed, uint32_t size)
+{
+	uint32_t chunks = size == SZ_X ? 4 : 2;
+	if (size == SZ_W) {
+		immed &= 0xFFFFFFFF;
+	}
+	uint32_t zeros = 0, ones = 0;
+	for (uint32_t i = 0; i < chunks; i++)
+	{
+		uint16_t chunk = immed >> (i * 16);
+		zeros += chunk == 0;
+		ones += chunk == 0xFFFF;
+	}
+	//start from all ones with movn when that leaves fewer chunks to fill in with movk
+	uint16_t fill = ones > zeros ? 0xFFFF : 0;
+	uint32_t op = ones > zeros ? OP_MOVN : OP_MOVZ;
+	uint8_t first = 1;
+	for (uint32_t i = 0; i < chunks; i++)
+	{
+		uint16_t chunk = immed >> (i * 16);
+		if (chunk != fill) {
+			if (first) {
+				emit(code, op | size | i << 21 | (uint16_t)(chunk ^ fill) << 5 | dst);
+				first = 0;
+			} else {
+				emit(code, OP_MOVK | size | i << 21 | chunk << 5 | dst);
+			}
+		}
+	}
+	if (first) {
+		//every chunk matches the fill so a single movz or movn of 0 does it
+		emit(code, op | size | dst);
+	}
+	return CODE_OK;
+}
+
+uint32_t mvn(code_info *code, uint32_t dst, uint32_t src, uint32_t size)
+{
+	return data_proc(code, OP_ORN, size, dst, zr, src);
+}
+
+uint32_t lsl(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size)
+{
+	return data_proc(code, OP_LSLV, size, dst, src, amount);
+}
+
+static uint32_t bitfield(code_info *code, uint32_t op, uint32_t dst, uint32_t src, uint32_t immr, uint32_t imms, uint32_t size)
+{
+	emit(code, op | size | (size == SZ_X ? N_BIT : 0) | immr << 16 | imms << 10 | src << 5 | dst);
+	return CODE_OK;
+}
+
+uint32_t lsli(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size)
+{
+	uint32_t bits = size == SZ_X ? 64 : 32;
+	if (amount >= bits) {
+		return INVALID_IMMED;
+	}
+	return bitfield(code, OP_UBFM, dst, src, (bits - amount) & (bits - 1), bits - 1 - amount, size);
+}
+
+uint32_t lsr(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size)
+{
+	return data_proc(code, OP_LSRV, size, dst, src, amount);
+}
+
+uint32_t lsri(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size)
+{
+	uint32_t bits = size == SZ_X ? 64 : 32;
+	if (amount >= bits) {
+		return INVALID_IMMED;
+	}
+	return bitfield(code, OP_UBFM, dst, src, amount, bits - 1, size);
+}
+
+uint32_t asr(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size)
+{
+	return data_proc(code, OP_ASRV, size, dst, src, amount);
+}
+
+uint32_t asri(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size)
+{
+	uint32_t bits = size == SZ_X ? 64 : 32;
+	if (amount >= bits) {
+		return INVALID_IMMED;
+	}
+	return bitfield(code, OP_SBFM, dst, src, amount, bits - 1, size);
+}
+
+uint32_t ror(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size)
+{
+	return data_proc(code, OP_RORV, size, dst, src, amount);
+}
+
+uint32_t mul(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size)
+{
+	emit(code, OP_MADD | size | src2 << 16 | zr << 10 | src1 << 5 | dst);
+	return CODE_OK;
+}
+
+uint32_t udiv(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size)
+{
+	return data_proc(code, OP_UDIV, size, dst, src1, src2);
+}
+
+uint32_t sdiv(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size)
+{
+	return data_proc(code, OP_SDIV, size, dst, src1, src2);
+}
+
+uint32_t csel(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t cc, uint32_t size)
+{
+	return data_proc(code, OP_CSEL | cc << 12, size, dst, src1, src2);
+}
+
+uint32_t cset(code_info *code, uint32_t dst, uint32_t cc, uint32_t size)
+{
+	//csinc dst, zr, zr with the inverted condition
+	return data_proc(code, OP_CSINC | (cc ^ 1) << 12, size, dst, zr, zr);
+}
+
+static uint32_t branchi(code_info *code, uint32_t op, uint32_t *dst)
+{
+	check_alloc_code(code, 1);
+	ptrdiff_t disp = dst - code->cur;
+	if (disp >= 0x2000000 || disp < -0x2000000) {
+		return INVALID_IMMED;
+	}
+	*(code->cur++) = op | (disp & 0x3FFFFFF);
+	return CODE_OK;
+}
+
+static uint32_t branchi19(code_info *code, uint32_t op, uint32_t *dst)
+{
+	check_alloc_code(code, 1);
+	ptrdiff_t disp = dst - code->cur;
+	if (disp >= 0x40000 || disp < -0x40000) {
+		return INVALID_IMMED;
+	}
+	*(code->cur++) = op | (disp & 0x7FFFF) << 5;
+	return CODE_OK;
+}
+
+uint32_t b(code_info *code, uint32_t *dst)
+{
+	return branchi(code, OP_B, dst);
+}
+
+uint32_t b_cc(code_info *code, uint32_t *dst, uint32_t cc)
+{
+	return branchi19(code, OP_BCC | cc, dst);
+}
+
+uint32_t bl(code_info *code, uint32_t *dst)
+{
+	return branchi(code, OP_BL, dst);
+}
+
+uint32_t cbz(code_info *code, uint32_t src, uint32_t *dst, uint32_t size)
+{
+	return branchi19(code, OP_CBZ | size | src, dst);
+}
+
+uint32_t cbnz(code_info *code, uint32_t src, uint32_t *dst, uint32_t size)
+{
+	return branchi19(code, OP_CBNZ | size | src, dst);
+}
+
+uint32_t br(code_info *code, uint32_t dst)
+{
+	emit(code, OP_BR | dst << 5);
+	return CODE_OK;
+}
+
+uint32_t blr(code_info *code, uint32_t dst)
+{
+	emit(code, OP_BLR | dst << 5);
+	return CODE_OK;
+}
+
+uint32_t ret(code_info *code)
+{
+	emit(code, OP_RET | lr << 5);
+	return CODE_OK;
+}
+
+uint32_t push(code_info *code, uint32_t reg)
+{
+	emit(code, (OP_STR & ~UNSIGNED_OFF) | MEM_X | PRE_IND | (-STACK_SLOT & 0x1FF) << 12 | sp << 5 | reg);
+	code->stack_off += STACK_SLOT;
+	return CODE_OK;
+}
+
+uint32_t pushp(code_info *code, uint32_t reg1, uint32_t reg2)
+{
+	emit(code, OP_STP_PRE | (-STACK_SLOT / 8 & 0x7F) << 15 | reg2 << 10 | sp << 5 | reg1);
+	code->stack_off += STACK_SLOT;
+	return CODE_OK;
+}
+
+uint32_t pop(code_info *code, uint32_t reg)
+{
+	emit(code, (OP_LDR & ~UNSIGNED_OFF) | MEM_X | POST_IND | STACK_SLOT << 12 | sp << 5 | reg);
+	code->stack_off -= STACK_SLOT;
+	return CODE_OK;
+}
+
+uint32_t popp(code_info *code, uint32_t reg1, uint32_t reg2)
+{
+	emit(code, OP_LDP_POST | (STACK_SLOT / 8) << 15 | reg2 << 10 | sp << 5 | reg1);
+	code->stack_off -= STACK_SLOT;
+	return CODE_OK;
+}
+
+static uint32_t load_store_immoff(code_info *code, uint32_t op, uint32_t mem_size, uint32_t reg, uint32_t base, int32_t offset)
+{
+	uint32_t scale = mem_size >> 30;
+	if (offset >= 0 && !(offset & ((1 << scale) - 1)) && offset >> scale < 0x1000) {
+		emit(code, op | mem_size | (offset >> scale) << 10 | base << 5 | reg);
+	} else if (offset >= -0x100 && offset < 0x100) {
+		emit(code, (op & ~UNSIGNED_OFF) | mem_size | (offset & 0x1FF) << 12 | base << 5 | reg);
+	} else {
+		return INVALID_IMMED;
+	}
+	return CODE_OK;
+}
+
+uint32_t ldr(code_info *code, uint32_t dst, uint32_t base, int32_t offset, uint32_t size)
+{
+	return load_store_immoff(code, OP_LDR, size == SZ_X ? MEM_X : MEM_W, dst, base, offset);
+}
+
+uint32_t ldrh(code_info *code, uint32_t dst, uint32_t base, int32_t offset)
+{
+	return load_store_immoff(code, OP_LDR, MEM_H, dst, base, offset);
+}
+
+uint32_t ldrb(code_info *code, uint32_t dst, uint32_t base, int32_t offset)
+{
+	return load_store_immoff(code, OP_LDR, MEM_B, dst, base, offset);
+}
+
+uint32_t str(code_info *code, uint32_t src, uint32_t base, int32_t offset, uint32_t size)
+{
+	return load_store_immoff(code, OP_STR, size == SZ_X ? MEM_X : MEM_W, src, base, offset);
+}
+
+uint32_t strh(code_info *code, uint32_t src, uint32_t base, int32_t offset)
+{
+	return load_store_immoff(code, OP_STR, MEM_H, src, base, offset);
+}
+
+uint32_t strb(code_info *code, uint32_t src, uint32_t base, int32_t offset)
+{
+	return load_store_immoff(code, OP_STR, MEM_B, src, base, offset);
+}
+
+void call(code_info *code, code_ptr fun)
+{
+	//make sure the far version doesn't get split across chunks, the jump between them uses SCRATCH1
+	check_alloc_code(code, 5);
+	if (bl(code, fun) != CODE_OK) {
+		movi(code, SCRATCH1, (uint64_t)fun, SZ_X);
+		blr(code, SCRATCH1);
+	}
+}
+
+void call_r(code_info *code, uint8_t dst)
+{
+	blr(code, dst);
+}
+
+void jmp(code_info *code, code_ptr dest)
+{
+	check_alloc_code(code, 5);
+	if (b(code, dest) != CODE_OK) {
+		movi(code, SCRATCH1, (uint64_t)dest, SZ_X);
+		br(code, SCRATCH1);
+	}
+}
+
+void jmp_r(code_info *code, uint8_t dst)
+{
+	br(code, dst);
+}
+
+void rts(code_info *code)
+{
+	ret(code);
+}
+
+static void prep_args(code_info *code, uint32_t num_args, va_list args)
+{
+	//the first 8 arguments go in r0-r7, nothing here needs more than that
+	if (num_args > 8) {
+		fatal_error("call_args: %d arguments were passed, only 8 are supported\n", num_args);
+	}
+	uint8_t arg_arr[8];
+	int8_t reg_swap[sp+1];
+	uint32_t usage = 0;
+	memset(reg_swap, -1, sizeof(reg_swap));
+	for (int i = 0; i < num_args; i ++)
+	{
+		arg_arr[i] = va_arg(args, int);
+		usage |= 1u << arg_arr[i];
+	}
+	for (int i = 0; i < num_args; i ++)
+	{
+		uint8_t reg_arg = arg_arr[i];
+		if (reg_swap[reg_arg] >= 0) {
+			reg_arg = reg_swap[reg_arg];
+		}
+		if (reg_arg != i) {
+			if (usage & (1u << i)) {
+				//there's no exchange instruction, swap through the scratch register
+				mov(code, SCRATCH1, i, SZ_X);
+				mov(code, i, reg_arg, SZ_X);
+				mov(code, reg_arg, SCRATCH1, SZ_X);
+				reg_swap[i] = reg_arg;
+			} else {
+				mov(code, i, reg_arg, SZ_X);
+			}
+		}
+	}
+}
+
+void call_args(code_info *code, code_ptr fun, uint32_t num_args, ...)
+{
+	va_list args;
+	va_start(args, num_args);
+	prep_args(code, num_args, args);
+	va_end(args);
+	call(code, fun);
+}
+
+void call_args_r(code_info *code, uint8_t fun_reg, uint32_t num_args, ...)
+{
+	//the function pointer might be in one of the argument registers
+	mov(code, SCRATCH2, fun_reg, SZ_X);
+	va_list args;
+	va_start(args, num_args);
+	prep_args(code, num_args, args);
+	va_end(args);
+	call_r(code, SCRATCH2);
+}
+
+void save_callee_save_regs(code_info *code)
+{
+	pushp(code, fp, lr);
+	pushp(code, r19, r20);
+	pushp(code, r21, r22);
+	pushp(code, r23, r24);
+	pushp(code, r25, r26);
+	pushp(code, r27, r28);
+}
+
+void restore_callee_save_regs(code_info *code)
+{
+	popp(code, r27, r28);
+	popp(code, r25, r26);
+	popp(code, r23, r24);
+	popp(code, r21, r22);
+	popp(code, r19, r20);
+	popp(code, fp, lr);
+}
@@ -0,0 +1,132 @@
+#ifndef GEN_ARM64_H_
+#define GEN_ARM64_H_
+
+#include <stdint.h>
+#include "gen.h"
+
+#define SET_COND 0x20000000u
+#define NO_COND  0u
+
+//operand size, this is the sf bit of most data processing instructions
+#define SZ_W 0u
+#define SZ_X 0x80000000u
+
+#define CC_EQ 0x0u
+#define CC_NE 0x1u
+#define CC_CS 0x2u
+#define CC_CC 0x3u
+#define CC_MI 0x4u
+#define CC_PL 0x5u
+#define CC_VS 0x6u
+#define CC_VC 0x7u
+#define CC_HI 0x8u
+#define CC_LS 0x9u
+#define CC_GE 0xAu
+#define CC_LT 0xBu
+#define CC_GT 0xCu
+#define CC_LE 0xDu
+#define CC_AL 0xEu
+
+#define INVALID_IMMED 0xFFFFFFFFu
+#define CODE_OK 0u
+
+enum {
+	r0,
+	r1,
+	r2,
+	r3,
+	r4,
+	r5,
+	r6,
+	r7,
+	r8,
+	r9,
+	r10,
+	r11,
+	r12,
+	r13,
+	r14,
+	r15,
+	r16,
+	r17,
+	r18,
+	r19,
+	r20,
+	r21,
+	r22,
+	r23,
+	r24,
+	r25,
+	r26,
+	r27,
+	r28,
+	fp,
+	lr,
+	sp,
+	//register 31 is the zero register everywhere sp isn't allowed
+	zr = sp
+};
+
+//r16 and r17 are the intra-procedure call scratch registers, far jumps and calls use them
+#define SCRATCH1 r16
+#define SCRATCH2 r17
+
+uint32_t and(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond);
+uint32_t andi(code_info *code, uint32_t dst, uint32_t src1, uint64_t immed, uint32_t size, uint32_t set_cond);
+uint32_t bic(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond);
+uint32_t orr(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size);
+uint32_t orri(code_info *code, uint32_t dst, uint32_t src1, uint64_t immed, uint32_t size);
+uint32_t eor(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size);
+uint32_t eori(code_info *code, uint32_t dst, uint32_t src1, uint64_t immed, uint32_t size);
+uint32_t add(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond);
+uint32_t addi(code_info *code, uint32_t dst, uint32_t src1, int32_t immed, uint32_t size, uint32_t set_cond);
+uint32_t sub(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond);
+uint32_t subi(code_info *code, uint32_t dst, uint32_t src1, int32_t immed, uint32_t size, uint32_t set_cond);
+uint32_t adc(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond);
+uint32_t sbc(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size, uint32_t set_cond);
+uint32_t tst(code_info *code, uint32_t src1, uint32_t src2, uint32_t size);
+uint32_t tsti(code_info *code, uint32_t src1, uint64_t immed, uint32_t size);
+uint32_t cmp(code_info *code, uint32_t src1, uint32_t src2, uint32_t size);
+uint32_t cmpi(code_info *code, uint32_t src1, int32_t immed, uint32_t size);
+uint32_t cmn(code_info *code, uint32_t src1, uint32_t src2, uint32_t size);
+uint32_t cmni(code_info *code, uint32_t src1, int32_t immed, uint32_t size);
+uint32_t mov(code_info *code, uint32_t dst, uint32_t src, uint32_t size);
+uint32_t movi(code_info *code, uint32_t dst, uint64_t immed, uint32_t size);
+uint32_t mvn(code_info *code, uint32_t dst, uint32_t src, uint32_t size);
+
+uint32_t lsl(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size);
+uint32_t lsli(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size);
+uint32_t lsr(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size);
+uint32_t lsri(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size);
+uint32_t asr(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size);
+uint32_t asri(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size);
+uint32_t ror(code_info *code, uint32_t dst, uint32_t src, uint32_t amount, uint32_t size);
+uint32_t mul(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size);
+uint32_t udiv(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size);
+uint32_t sdiv(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t size);
+uint32_t csel(code_info *code, uint32_t dst, uint32_t src1, uint32_t src2, uint32_t cc, uint32_t size);
+uint32_t cset(code_info *code, uint32_t dst, uint32_t cc, uint32_t size);
+
+uint32_t b(code_info *code, uint32_t *dst);
+uint32_t b_cc(code_info *code, uint32_t *dst, uint32_t cc);
+uint32_t bl(code_info *code, uint32_t *dst);
+uint32_t cbz(code_info *code, uint32_t src, uint32_t *dst, uint32_t size);
+uint32_t cbnz(code_info *code, uint32_t src, uint32_t *dst, uint32_t size);
+uint32_t br(code_info *code, uint32_t dst);
+uint32_t blr(code_info *code, uint32_t dst);
+uint32_t ret(code_info *code);
+
+uint32_t push(code_info *code, uint32_t reg);
+uint32_t pushp(code_info *code, uint32_t reg1, uint32_t reg2);
+uint32_t pop(code_info *code, uint32_t reg);
+uint32_t popp(code_info *code, uint32_t reg1, uint32_t reg2);
+uint32_t ldr(code_info *code, uint32_t dst, uint32_t base, int32_t offset, uint32_t size);
+uint32_t ldrh(code_info *code, uint32_t dst, uint32_t base, int32_t offset);
+uint32_t ldrb(code_info *code, uint32_t dst, uint32_t base, int32_t offset);
+uint32_t str(code_info *code, uint32_t src, uint32_t base, int32_t offset, uint32_t size);
+uint32_t strh(code_info *code, uint32_t src, uint32_t base, int32_t offset);
+uint32_t strb(code_info *code, uint32_t src, uint32_t base, int32_t offset);
+
+void call_r(code_info *code, uint8_t dst);
+
+#endif //GEN_ARM64_H_
@@ -1369,6 +1369,67 @@ void mov_irdisp(code_info *code, int32_t val, uint8_t dst, int32_t disp, uint8_t
 	code->cur = out;
 }
 
+void mov_irindexdisp(code_info *code, int32_t val, uint8_t dst_base, uint8_t dst_index, uint8_t scale, int32_t disp, uint8_t size)
+{
+	check_alloc_code(code, 13);
+	code_ptr out = code->cur;
+	if (size == SZ_W) {
+		*(out++) = PRE_SIZE;
+	}
+	if (size == SZ_Q || dst_base >= R8 || dst_index >= R8) {
+#ifdef X86_64
+		*out = PRE_REX;
+		if (size == SZ_Q) {
+			*out |= REX_QUAD;
+		}
+		if (dst_base >= R8) {
+			*out |= REX_RM_FIELD;
+			dst_base -= (R8 - X86_R8);
+		}
+		if (dst_index >= R8) {
+			*out |= REX_SIB_FIELD;
+			dst_index -= (R8 - X86_R8);
+		}
+		out++;
+#else
+		fatal_error("Instruction requires REX prefix but this is a 32-bit build | mov_irindexdisp, base: %s, index: %s, size: %s\n", x86_reg_names[dst_base], x86_reg_names[dst_index], x86_sizes[size]);
+#endif
+	}
+	*(out++) = OP_MOV_IEA | (size == SZ_B ? 0 : BIT_SIZE);
+	if (scale == 4) {
+		scale = 2;
+	} else if(scale == 8) {
+		scale = 3;
+	} else {
+		scale--;
+	}
+	if (disp < 128 && disp >= -128) {
+		*(out++) = MODE_REG_DISPLACE8 | RSP;
+		*(out++) = scale << 6 | (dst_index << 3) | dst_base;
+		*(out++) = disp;
+	} else {
+		*(out++) = MODE_REG_DISPLACE32 | RSP;
+		*(out++) = scale << 6 | (dst_index << 3) | dst_base;
+		*(out++) = disp;
+		*(out++) = disp >> 8;
+		*(out++) = disp >> 16;
+		*(out++) = disp >> 24;
+	}
+
+	*(out++) = val;
+	if (size != SZ_B) {
+		val >>= 8;
+		*(out++) = val;
+		if (size != SZ_W) {
+			val >>= 8;
+			*(out++) = val;
+			val >>= 8;
+			*(out++) = val;
+		}
+	}
+	code->cur = out;
+}
+
 void mov_irind(code_info *code, int32_t val, uint8_t dst, uint8_t size)
 {
 	check_alloc_code(code, 8);
@@ -185,6 +185,7 @@ void mov_rrind(code_info *code, uint8_t src, uint8_t dst, uint8_t size);
 void mov_rindr(code_info *code, uint8_t src, uint8_t dst, uint8_t size);
 void mov_ir(code_info *code, int64_t val, uint8_t dst, uint8_t size);
 void mov_irdisp(code_info *code, int32_t val, uint8_t dst, int32_t disp, uint8_t size);
+void mov_irindexdisp(code_info *code, int32_t val, uint8_t dst_base, uint8_t dst_index, uint8_t scale, int32_t disp, uint8_t size);
 void mov_irind(code_info *code, int32_t val, uint8_t dst, uint8_t size);
 void movsx_rr(code_info *code, uint8_t src, uint8_t dst, uint8_t src_size, uint8_t size);
 void movsx_rdispr(code_info *code, uint8_t src, int32_t disp, uint8_t dst, uint8_t src_size, uint8_t size);
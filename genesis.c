@@ -20,10 +20,12 @@
 #include "jcart.h"
 #include "config.h"
 #include "event_log.h"
+#include "bench.h"
+#include "paths.h"
+#include "rewind.h"
 #define MCLKS_NTSC 53693175
 #define MCLKS_PAL  53203395
 
-uint32_t MCLKS_PER_68K;
 #define MCLKS_PER_YM  7
 #define MCLKS_PER_Z80 15
 #define MCLKS_PER_PSG (MCLKS_PER_Z80*16)
@@ -44,14 +46,47 @@ uint32_t MCLKS_PER_68K;
 #ifdef NEW_CORE
 #define Z80_CYCLE cycles
 #define Z80_OPTS opts
-#define z80_handle_code_write(...)
 #else
 #define Z80_CYCLE current_cycle
 #define Z80_OPTS options
 #endif
 
+#define CHECKPOINT_NONE 0
+#define CHECKPOINT_FULL 1
+#define CHECKPOINT_INCREMENTAL 2
+//worst case growth of an incremental state with every page dirty over a full one
+#define CHECKPOINT_MAX_OVERHEAD 1024
+
+static void catch_up(genesis_context *gen, uint8_t component)
+{
+	deferred_component *comp = gen->deferred + component;
+	if (comp->cycle != CYCLE_NEVER) {
+		uint32_t cycle = comp->cycle;
+		comp->cycle = CYCLE_NEVER;
+		comp->run(gen, cycle);
+	}
+}
+
+static void catch_up_all(genesis_context *gen)
+{
+	for (int i = 0; i < DEFER_NUM; i++)
+	{
+		catch_up(gen, i);
+	}
+}
+
 void genesis_serialize(genesis_context *gen, serialize_buffer *buf, uint32_t m68k_pc, uint8_t all)
 {
+	catch_up_all(gen);
+	uint8_t incremental = 0;
+	if (all && gen->checkpoint_mode) {
+		//needs to come first so a load can be rejected before anything else is restored
+		incremental = gen->checkpoint_mode == CHECKPOINT_INCREMENTAL && gen->checkpoint_id;
+		start_section(buf, SECTION_CHECKPOINT);
+		save_int32(buf, gen->last_checkpoint_id + 1);
+		save_int32(buf, incremental ? gen->checkpoint_id : 0);
+		end_section(buf);
+	}
 	if (all) {
 		start_section(buf, SECTION_68000);
 		m68k_serialize(gen->m68k, m68k_pc, buf);
@@ -63,7 +98,14 @@ void genesis_serialize(genesis_context *gen, serialize_buffer *buf, uint32_t m68
 	}
 	
 	start_section(buf, SECTION_VDP);
-	vdp_serialize(gen->vdp, buf);
+	if (incremental) {
+		vdp_serialize_no_vram(gen->vdp, buf);
+		end_section(buf);
+		start_section(buf, SECTION_VRAM_PAGES);
+		vdp_serialize_vram_pages(gen->vdp, buf);
+	} else {
+		vdp_serialize(gen->vdp, buf);
+	}
 	end_section(buf);
 	
 	start_section(buf, SECTION_YM2612);
@@ -93,14 +135,24 @@ void genesis_serialize(genesis_context *gen, serialize_buffer *buf, uint32_t m68
 		io_serialize(gen->io.ports + 2, buf);
 		end_section(buf);
 		
-		start_section(buf, SECTION_MAIN_RAM);
-		save_int8(buf, RAM_WORDS * 2 / 1024);
-		save_buffer16(buf, gen->work_ram, RAM_WORDS);
+		if (incremental && gen->work_ram_dirty) {
+			start_section(buf, SECTION_MAIN_RAM_PAGES);
+			save_pages16(buf, gen->work_ram, RAM_WORDS, gen->work_ram_page_shift, gen->work_ram_dirty);
+		} else {
+			start_section(buf, SECTION_MAIN_RAM);
+			save_int8(buf, RAM_WORDS * 2 / 1024);
+			save_buffer16(buf, gen->work_ram, RAM_WORDS);
+		}
 		end_section(buf);
 		
-		start_section(buf, SECTION_SOUND_RAM);
-		save_int8(buf, Z80_RAM_BYTES / 1024);
-		save_buffer8(buf, gen->zram, Z80_RAM_BYTES);
+		if (incremental && gen->zram_dirty) {
+			start_section(buf, SECTION_SOUND_RAM_PAGES);
+			save_pages8(buf, gen->zram, Z80_RAM_BYTES, gen->zram_page_shift, gen->zram_dirty);
+		} else {
+			start_section(buf, SECTION_SOUND_RAM);
+			save_int8(buf, Z80_RAM_BYTES / 1024);
+			save_buffer8(buf, gen->zram, Z80_RAM_BYTES);
+		}
 		end_section(buf);
 		
 		if (gen->version_reg & 0xF) {
@@ -117,10 +169,16 @@ void genesis_serialize(genesis_context *gen, serialize_buffer *buf, uint32_t m68
 	}
 }
 
+static uint32_t reset_vector_pc(genesis_context *gen)
+{
+	uint32_t address = read_word(4, (void **)gen->m68k->mem_pointers, &gen->m68k->options->gen, gen->m68k) << 16;
+	address |= read_word(6, (void **)gen->m68k->mem_pointers, &gen->m68k->options->gen, gen->m68k);
+	return address;
+}
+
 static uint8_t *serialize(system_header *sys, size_t *size_out)
 {
 	genesis_context *gen = (genesis_context *)sys;
-	uint32_t address;
 	if (gen->m68k->resume_pc) {
 		gen->m68k->target_cycle = gen->m68k->current_cycle;
 		gen->header.save_state = SERIALIZE_SLOT+1;
@@ -132,9 +190,7 @@ static uint8_t *serialize(system_header *sys, size_t *size_out)
 	} else {
 		serialize_buffer state;
 		init_serialize(&state);
-		uint32_t address = read_word(4, (void **)gen->m68k->mem_pointers, &gen->m68k->options->gen, gen->m68k) << 16;
-		address |= read_word(6, (void **)gen->m68k->mem_pointers, &gen->m68k->options->gen, gen->m68k);
-		genesis_serialize(gen, &state, address, 1);
+		genesis_serialize(gen, &state, reset_vector_pc(gen), 1);
 		if (size_out) {
 			*size_out = state.size;
 		}
@@ -142,6 +198,89 @@ static uint8_t *serialize(system_header *sys, size_t *size_out)
 	}
 }
 
+static size_t serialize_into(system_header *sys, uint8_t *dest, size_t max_size)
+{
+	genesis_context *gen = (genesis_context *)sys;
+	serialize_buffer state;
+	if (gen->m68k->resume_pc) {
+		gen->serialize_dest = dest;
+		gen->serialize_dest_size = max_size;
+		gen->m68k->target_cycle = gen->m68k->current_cycle;
+		gen->header.save_state = SERIALIZE_SLOT+1;
+		resume_68k(gen->m68k);
+		gen->serialize_dest = NULL;
+		state.data = gen->serialize_tmp;
+		state.size = gen->serialize_size;
+	} else {
+		init_serialize_into(&state, dest, max_size);
+		genesis_serialize(gen, &state, reset_vector_pc(gen), 1);
+	}
+	if (state.data != dest) {
+		free(state.data);
+		return 0;
+	}
+	return state.size;
+}
+
+static size_t serialize_size(system_header *sys)
+{
+	genesis_context *gen = (genesis_context *)sys;
+	serialize_buffer state;
+	init_serialize(&state);
+	genesis_serialize(gen, &state, 0, 1);
+	free(state.data);
+	return state.size + VDP_MAX_FIFO_SERIALIZE_SIZE + CHECKPOINT_MAX_OVERHEAD;
+}
+
+static void clear_dirty_pages(genesis_context *gen)
+{
+	if (gen->work_ram_dirty) {
+		memset(gen->work_ram_dirty, 0, (RAM_WORDS * 2) >> gen->work_ram_page_shift);
+	}
+	if (gen->zram_dirty) {
+		memset(gen->zram_dirty, 0, Z80_RAM_BYTES >> gen->zram_page_shift);
+	}
+	memset(gen->vdp->vram_dirty, 0, sizeof(gen->vdp->vram_dirty));
+}
+
+static uint8_t any_dirty(uint8_t *dirty, uint32_t pages)
+{
+	for (uint32_t i = 0; i < pages; i++)
+	{
+		if (dirty[i]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//memory that isn't tracked is always saved in full, so it can't make an incremental state stale
+static uint8_t has_dirty_pages(genesis_context *gen)
+{
+	if (gen->work_ram_dirty && any_dirty(gen->work_ram_dirty, (RAM_WORDS * 2) >> gen->work_ram_page_shift)) {
+		return 1;
+	}
+	if (gen->zram_dirty && any_dirty(gen->zram_dirty, Z80_RAM_BYTES >> gen->zram_page_shift)) {
+		return 1;
+	}
+	return any_dirty(gen->vdp->vram_dirty, sizeof(gen->vdp->vram_dirty));
+}
+
+static size_t serialize_checkpoint(system_header *sys, uint8_t *dest, size_t max_size, uint8_t incremental)
+{
+	genesis_context *gen = (genesis_context *)sys;
+	gen->checkpoint_mode = incremental ? CHECKPOINT_INCREMENTAL : CHECKPOINT_FULL;
+	size_t size = serialize_into(sys, dest, max_size);
+	gen->checkpoint_mode = CHECKPOINT_NONE;
+	if (size) {
+		//nothing runs between taking the state and returning here, so the state matches memory as of now
+		++gen->last_checkpoint_id;
+		gen->checkpoint_id = gen->work_ram_exposed ? 0 : gen->last_checkpoint_id;
+		clear_dirty_pages(gen);
+	}
+	return size;
+}
+
 static void ram_deserialize(deserialize_buffer *buf, void *vgen)
 {
 	genesis_context *gen = vgen;
@@ -164,6 +303,43 @@ static void zram_deserialize(deserialize_buffer *buf, void *vgen)
 	z80_invalidate_code_range(gen->z80, 0, 0x4000);
 }
 
+static void ram_pages_deserialize(deserialize_buffer *buf, void *vgen)
+{
+	genesis_context *gen = vgen;
+	if (load_pages16(buf, gen->work_ram, RAM_WORDS)) {
+		m68k_invalidate_code_range(gen->m68k, 0xE00000, 0x1000000);
+	}
+}
+
+static void zram_pages_deserialize(deserialize_buffer *buf, void *vgen)
+{
+	genesis_context *gen = vgen;
+	if (load_pages8(buf, gen->zram, Z80_RAM_BYTES)) {
+		z80_invalidate_code_range(gen->z80, 0, 0x4000);
+	}
+}
+
+#define CHECKPOINT_MISMATCH 0xFFFFFFFF
+static void checkpoint_deserialize(deserialize_buffer *buf, void *vgen)
+{
+	genesis_context *gen = vgen;
+	uint32_t id = load_int32(buf);
+	uint32_t base = load_int32(buf);
+	if (base && (base != gen->checkpoint_id || has_dirty_pages(gen))) {
+		if (base != gen->checkpoint_id) {
+			warning("State is relative to checkpoint %u, but the current state is at checkpoint %u\n", base, gen->checkpoint_id);
+		} else {
+			//pages left out of the state would keep whatever was written after the checkpoint
+			warning("State is relative to checkpoint %u, but memory has changed since it was taken\n", base);
+		}
+		gen->loaded_checkpoint = CHECKPOINT_MISMATCH;
+		//this section always comes first so nothing has been restored yet
+		buf->cur_pos = buf->size;
+		return;
+	}
+	gen->loaded_checkpoint = id;
+}
+
 static void update_z80_bank_pointer(genesis_context *gen)
 {
 	if (gen->z80_bank_reg < 0x140) {
@@ -171,7 +347,8 @@ static void update_z80_bank_pointer(genesis_context *gen)
 	} else {
 		gen->z80->mem_pointers[1] = NULL;
 	}
-	z80_invalidate_code_range(gen->z80, 0x8000, 0xFFFF);
+	//nothing needs to be invalidated here, code in the bank area always runs through
+	//interpreter stubs that fetch the opcode through the current bank when they run
 }
 
 static void bus_arbiter_deserialize(deserialize_buffer *buf, void *vgen)
@@ -192,8 +369,9 @@ static void tmss_deserialize(deserialize_buffer *buf, void *vgen)
 static void adjust_int_cycle(m68k_context * context, vdp_context * v_context);
 static void check_tmss_lock(genesis_context *gen);
 static void toggle_tmss_rom(genesis_context *gen);
-void genesis_deserialize(deserialize_buffer *buf, genesis_context *gen)
+uint8_t genesis_deserialize(deserialize_buffer *buf, genesis_context *gen)
 {
+	register_section_handler(buf, (section_handler){.fun = checkpoint_deserialize, .data = gen}, SECTION_CHECKPOINT);
 	register_section_handler(buf, (section_handler){.fun = m68k_deserialize, .data = gen->m68k}, SECTION_68000);
 	register_section_handler(buf, (section_handler){.fun = z80_deserialize, .data = gen->z80}, SECTION_Z80);
 	register_section_handler(buf, (section_handler){.fun = vdp_deserialize, .data = gen->vdp}, SECTION_VDP);
@@ -207,13 +385,36 @@ void genesis_deserialize(deserialize_buffer *buf, genesis_context *gen)
 	register_section_handler(buf, (section_handler){.fun = zram_deserialize, .data = gen}, SECTION_SOUND_RAM);
 	register_section_handler(buf, (section_handler){.fun = cart_deserialize, .data = gen}, SECTION_MAPPER);
 	register_section_handler(buf, (section_handler){.fun = tmss_deserialize, .data = gen}, SECTION_TMSS);
+	register_section_handler(buf, (section_handler){.fun = ram_pages_deserialize, .data = gen}, SECTION_MAIN_RAM_PAGES);
+	register_section_handler(buf, (section_handler){.fun = zram_pages_deserialize, .data = gen}, SECTION_SOUND_RAM_PAGES);
+	register_section_handler(buf, (section_handler){.fun = vdp_deserialize_vram_pages, .data = gen->vdp}, SECTION_VRAM_PAGES);
 	uint8_t tmss_old = gen->tmss;
 	gen->tmss = 0xFF;
+	gen->loaded_checkpoint = 0;
 	while (buf->cur_pos < buf->size)
 	{
 		if (!load_section(buf))
 			break;
 	}
+	if (gen->loaded_checkpoint == CHECKPOINT_MISMATCH) {
+		gen->tmss = tmss_old;
+		free(buf->handlers);
+		buf->handlers = NULL;
+		return 0;
+	}
+	//time owed to the deferred components belongs to the state that was just replaced
+	for (int i = 0; i < DEFER_NUM; i++)
+	{
+		gen->deferred[i].cycle = CYCLE_NEVER;
+	}
+	//memory now matches the loaded checkpoint, anything else leaves nothing for an incremental state to refer to
+	gen->checkpoint_id = gen->work_ram_exposed ? 0 : gen->loaded_checkpoint;
+	if (gen->checkpoint_id) {
+		clear_dirty_pages(gen);
+		if (gen->checkpoint_id > gen->last_checkpoint_id) {
+			gen->last_checkpoint_id = gen->checkpoint_id;
+		}
+	}
 	if (gen->version_reg & 0xF) {
 		if (gen->tmss == 0xFF) {
 			//state lacked a TMSS section, assume that the game ROM is mapped in
@@ -228,25 +429,34 @@ void genesis_deserialize(deserialize_buffer *buf, genesis_context *gen)
 		check_tmss_lock(gen);
 	}
 	update_z80_bank_pointer(gen);
+	//these aren't part of the state, but are relative to the 68K cycle count so they need to be rebased
+	//otherwise the refresh delay estimate in sync_components sees a huge number of elapsed cycles
+	gen->last_sync_cycle = gen->m68k->current_cycle;
+	gen->last_flush_cycle = gen->m68k->current_cycle;
 	adjust_int_cycle(gen->m68k, gen->vdp);
 	free(buf->handlers);
 	buf->handlers = NULL;
+	return 1;
 }
 
 #include "m68k_internal.h" //needed for get_native_address_trans, should be eliminated once handling of PC is cleaned up
-static void deserialize(system_header *sys, uint8_t *data, size_t size)
+static uint8_t deserialize(system_header *sys, uint8_t *data, size_t size)
 {
 	genesis_context *gen = (genesis_context *)sys;
 	deserialize_buffer buffer;
 	init_deserialize(&buffer, data, size);
-	genesis_deserialize(&buffer, gen);
+	if (!genesis_deserialize(&buffer, gen)) {
+		return 0;
+	}
 	//HACK: Fix this once PC/IR is represented in a better way in 68K core
-	gen->m68k->resume_pc = get_native_address_trans(gen->m68k, gen->m68k->last_prefetch_address);
+	gen->m68k->resume_address = gen->m68k->last_prefetch_address;
+	gen->m68k->resume_pc = get_native_address_trans(gen->m68k, gen->m68k->resume_address);
+	return 1;
 }
 
-uint16_t read_dma_value(uint32_t address)
+uint16_t read_dma_value(system_header *system, uint32_t address)
 {
-	genesis_context *genesis = (genesis_context *)current_system;
+	genesis_context *genesis = (genesis_context *)system;
 	//TODO: Figure out what happens when you try to DMA from weird adresses like IO or banked Z80 area
 	if ((address >= 0xA00000 && address < 0xB00000) || (address >= 0xC00000 && address <= 0xE00000)) {
 		return 0;
@@ -259,7 +469,7 @@ uint16_t read_dma_value(uint32_t address)
 static uint16_t get_open_bus_value(system_header *system)
 {
 	genesis_context *genesis = (genesis_context *)system;
-	return read_dma_value(genesis->m68k->last_prefetch_address/2);
+	return read_dma_value(system, genesis->m68k->last_prefetch_address/2);
 }
 
 static void adjust_int_cycle(m68k_context * context, vdp_context * v_context)
@@ -376,7 +586,10 @@ static void sync_z80(z80_context * z_context, uint32_t mclks)
 			z80_next_int_pulse(z_context);
 		}
 #endif
+		bench_state *bench = ((genesis_context *)z_context->system)->header.bench;
+		bench_component prev = bench_enter(bench, BENCH_Z80);
 		z80_run(z_context, mclks);
+		bench_leave(bench, prev);
 	} else
 #endif
 	{
@@ -384,29 +597,62 @@ static void sync_z80(z80_context * z_context, uint32_t mclks)
 	}
 }
 
-static void sync_sound(genesis_context * gen, uint32_t target)
+static void run_sound(genesis_context * gen, uint32_t target)
 {
 	//printf("YM | Cycle: %d, bpos: %d, PSG | Cycle: %d, bpos: %d\n", gen->ym->current_cycle, gen->ym->buffer_pos, gen->psg->cycles, gen->psg->buffer_pos * 2);
+	bench_component prev = bench_enter(gen->header.bench, BENCH_PSG);
 	while (target > gen->psg->cycles && target - gen->psg->cycles > MAX_SOUND_CYCLES) {
 		uint32_t cur_target = gen->psg->cycles + MAX_SOUND_CYCLES;
 		//printf("Running PSG to cycle %d\n", cur_target);
 		psg_run(gen->psg, cur_target);
 		//printf("Running YM-2612 to cycle %d\n", cur_target);
+		bench_enter(gen->header.bench, BENCH_YM);
 		ym_run(gen->ym, cur_target);
+		bench_enter(gen->header.bench, BENCH_PSG);
 	}
 	psg_run(gen->psg, target);
+	bench_enter(gen->header.bench, BENCH_YM);
 	ym_run(gen->ym, target);
+	bench_leave(gen->header.bench, prev);
 
 	//printf("Target: %d, YM bufferpos: %d, PSG bufferpos: %d\n", target, gen->ym->buffer_pos, gen->psg->buffer_pos * 2);
 }
 
+static void sync_sound(genesis_context * gen, uint32_t target)
+{
+	catch_up(gen, DEFER_SOUND);
+	run_sound(gen, target);
+}
+
+static void flush_audio(system_header *system)
+{
+	catch_up((genesis_context *)system, DEFER_SOUND);
+}
+
+static void run_io(genesis_context *gen, uint32_t target)
+{
+	bench_component prev = bench_enter(gen->header.bench, BENCH_IO);
+	io_run(gen->io.ports, target);
+	io_run(gen->io.ports + 1, target);
+	io_run(gen->io.ports + 2, target);
+	bench_leave(gen->header.bench, prev);
+}
+
+//states can only be saved or restored once the 68K has returned, see handle_reset_requests
+static void request_frame_work(genesis_context *gen, uint8_t work)
+{
+	if (!gen->frame_work) {
+		gen->frame_work_return = gen->m68k->should_return;
+		gen->m68k->should_return = 1;
+	}
+	gen->frame_work |= work;
+}
+
 //My refresh emulation isn't currently good enough and causes more problems than it solves
 #define REFRESH_EMULATION
 #ifdef REFRESH_EMULATION
 #define REFRESH_INTERVAL 128
 #define REFRESH_DELAY 2
-uint32_t last_sync_cycle;
-uint32_t refresh_counter;
 #endif
 
 #include <limits.h>
@@ -420,20 +666,26 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 	z80_context * z_context = gen->z80;
 #ifdef REFRESH_EMULATION
 	//lame estimation of refresh cycle delay
-	refresh_counter += context->current_cycle - last_sync_cycle;
+	gen->refresh_counter += context->current_cycle - gen->last_sync_cycle;
 	if (!gen->bus_busy) {
-		context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
+		context->current_cycle += REFRESH_DELAY * gen->mclks_per_68k * (gen->refresh_counter / (gen->mclks_per_68k * REFRESH_INTERVAL));
 	}
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
+	gen->refresh_counter = gen->refresh_counter % (gen->mclks_per_68k * REFRESH_INTERVAL);
 #endif
 
 	uint32_t mclks = context->current_cycle;
 	sync_z80(z_context, mclks);
-	sync_sound(gen, mclks);
+	//sound and IO can't affect the 68K or Z80 other than through their own ports,
+	//so they're only run when those are accessed or at the end of the frame
+	gen->deferred[DEFER_SOUND].cycle = mclks;
+	gen->deferred[DEFER_IO].cycle = mclks;
+	if (!io_serial_idle(gen->io.ports) || !io_serial_idle(gen->io.ports + 1) || !io_serial_idle(gen->io.ports + 2)) {
+		//serial transfers can raise interrupts and talk to the outside world so they need to keep up
+		catch_up(gen, DEFER_IO);
+	}
+	bench_component prev = bench_enter(gen->header.bench, BENCH_VDP);
 	vdp_run_context(v_context, mclks);
-	io_run(gen->io.ports, mclks);
-	io_run(gen->io.ports + 1, mclks);
-	io_run(gen->io.ports + 2, mclks);
+	bench_leave(gen->header.bench, prev);
 	if (mclks >= gen->reset_cycle) {
 		gen->reset_requested = 1;
 		context->should_return = 1;
@@ -442,12 +694,15 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 	if (v_context->frame != gen->last_frame) {
 		//printf("reached frame end %d | MCLK Cycles: %d, Target: %d, VDP cycles: %d, vcounter: %d, hslot: %d\n", gen->last_frame, mclks, gen->frame_end, v_context->cycles, v_context->vcounter, v_context->hslot);
 		gen->last_frame = v_context->frame;
+		catch_up_all(gen);
 		event_flush(mclks);
 		gen->last_flush_cycle = mclks;
 
 		if(exit_after){
 			--exit_after;
 			if (!exit_after) {
+				bench_finish(gen->header.bench, gen->header.info.name);
+				gen->header.bench = NULL;
 				exit(0);
 			}
 		}
@@ -473,6 +728,16 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 			event_cycle_adjust(mclks, deduction);
 			gen->last_flush_cycle -= deduction;
 		}
+		if (gen->header.rewind && !gen->run_ahead_frame) {
+			if (gen->header.rewinding) {
+				request_frame_work(gen, FRAME_WORK_REWIND_STEP);
+			} else if (rewind_snapshot_due(gen->header.rewind)) {
+				request_frame_work(gen, FRAME_WORK_REWIND_SNAPSHOT);
+			}
+		}
+		if (gen->header.run_ahead || gen->run_ahead_frame) {
+			request_frame_work(gen, FRAME_WORK_RUN_AHEAD);
+		}
 	} else if (mclks - gen->last_flush_cycle > gen->soft_flush_cycles) {
 		event_soft_flush(mclks);
 		gen->last_flush_cycle = mclks;
@@ -495,6 +760,7 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 	if (address) {
 		if (gen->header.enter_debugger) {
 			gen->header.enter_debugger = 0;
+			catch_up_all(gen);
 			if (gen->header.debugger_type == DEBUGGER_NATIVE) {
 				debugger(context, address);
 			} else {
@@ -508,6 +774,7 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 #endif
 			uint8_t slot = gen->header.save_state - 1;
 			gen->header.save_state = 0;
+			catch_up_all(gen);
 #ifndef NEW_CORE
 			if (z_context->native_pc && !z_context->reset) {
 				//advance Z80 core to the start of an instruction
@@ -520,7 +787,11 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 			char *save_path = slot >= SERIALIZE_SLOT ? NULL : get_slot_name(&gen->header, slot, use_native_states ? "state" : "gst");
 			if (use_native_states || slot >= SERIALIZE_SLOT) {
 				serialize_buffer state;
-				init_serialize(&state);
+				if (slot == SERIALIZE_SLOT && gen->serialize_dest) {
+					init_serialize_into(&state, gen->serialize_dest, gen->serialize_dest_size);
+				} else {
+					init_serialize(&state);
+				}
 				genesis_serialize(gen, &state, address, slot != EVENTLOG_SLOT);
 				if (slot == SERIALIZE_SLOT) {
 					gen->serialize_tmp = state.data;
@@ -545,7 +816,7 @@ m68k_context * sync_components(m68k_context * context, uint32_t address)
 		}
 	}
 #ifdef REFRESH_EMULATION
-	last_sync_cycle = context->current_cycle;
+	gen->last_sync_cycle = context->current_cycle;
 #endif
 	return context;
 }
@@ -563,10 +834,10 @@ static m68k_context * vdp_port_write(uint32_t vdp_port, m68k_context * context,
 	//printf("vdp_port write: %X, value: %X, cycle: %d\n", vdp_port, value, context->current_cycle);
 #ifdef REFRESH_EMULATION
 	//do refresh check here so we can avoid adding a penalty for a refresh that happens during a VDP access
-	refresh_counter += context->current_cycle - 4*MCLKS_PER_68K - last_sync_cycle;
-	context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
-	last_sync_cycle = context->current_cycle;
+	gen->refresh_counter += context->current_cycle - 4*gen->mclks_per_68k - gen->last_sync_cycle;
+	context->current_cycle += REFRESH_DELAY * gen->mclks_per_68k * (gen->refresh_counter / (gen->mclks_per_68k * REFRESH_INTERVAL));
+	gen->refresh_counter = gen->refresh_counter % (gen->mclks_per_68k * REFRESH_INTERVAL);
+	gen->last_sync_cycle = context->current_cycle;
 #endif
 	sync_components(context, 0);
 	vdp_context *v_context = gen->vdp;
@@ -576,12 +847,14 @@ static m68k_context * vdp_port_write(uint32_t vdp_port, m68k_context * context,
 		if (vdp_port < 4) {
 			while (vdp_data_port_write(v_context, value) < 0) {
 				while(v_context->flags & FLAG_DMA_RUN) {
+					bench_component prev = bench_enter(gen->header.bench, BENCH_VDP);
 					vdp_run_dma_done(v_context, gen->frame_end);
+					bench_leave(gen->header.bench, prev);
 					if (v_context->cycles >= gen->frame_end) {
 						uint32_t cycle_diff = v_context->cycles - context->current_cycle;
-						uint32_t m68k_cycle_diff = (cycle_diff / MCLKS_PER_68K) * MCLKS_PER_68K;
+						uint32_t m68k_cycle_diff = (cycle_diff / gen->mclks_per_68k) * gen->mclks_per_68k;
 						if (m68k_cycle_diff < cycle_diff) {
-							m68k_cycle_diff += MCLKS_PER_68K;
+							m68k_cycle_diff += gen->mclks_per_68k;
 						}
 						context->current_cycle += m68k_cycle_diff;
 						gen->bus_busy = 1;
@@ -598,12 +871,14 @@ static m68k_context * vdp_port_write(uint32_t vdp_port, m68k_context * context,
 			if (blocked) {
 				while (blocked) {
 					while(v_context->flags & FLAG_DMA_RUN) {
+						bench_component prev = bench_enter(gen->header.bench, BENCH_VDP);
 						vdp_run_dma_done(v_context, gen->frame_end);
+						bench_leave(gen->header.bench, prev);
 						if (v_context->cycles >= gen->frame_end) {
 							uint32_t cycle_diff = v_context->cycles - context->current_cycle;
-							uint32_t m68k_cycle_diff = (cycle_diff / MCLKS_PER_68K) * MCLKS_PER_68K;
+							uint32_t m68k_cycle_diff = (cycle_diff / gen->mclks_per_68k) * gen->mclks_per_68k;
 							if (m68k_cycle_diff < cycle_diff) {
-								m68k_cycle_diff += MCLKS_PER_68K;
+								m68k_cycle_diff += gen->mclks_per_68k;
 							}
 							context->current_cycle += m68k_cycle_diff;
 							gen->bus_busy = 1;
@@ -629,9 +904,9 @@ static m68k_context * vdp_port_write(uint32_t vdp_port, m68k_context * context,
 		if (v_context->cycles != before_cycle) {
 			//printf("68K paused for %d (%d) cycles at cycle %d (%d) for write\n", v_context->cycles - context->current_cycle, v_context->cycles - before_cycle, context->current_cycle, before_cycle);
 			uint32_t cycle_diff = v_context->cycles - context->current_cycle;
-			uint32_t m68k_cycle_diff = (cycle_diff / MCLKS_PER_68K) * MCLKS_PER_68K;
+			uint32_t m68k_cycle_diff = (cycle_diff / gen->mclks_per_68k) * gen->mclks_per_68k;
 			if (m68k_cycle_diff < cycle_diff) {
-				m68k_cycle_diff += MCLKS_PER_68K;
+				m68k_cycle_diff += gen->mclks_per_68k;
 			}
 			context->current_cycle += m68k_cycle_diff;
 			//Lock the Z80 out of the bus until the VDP access is complete
@@ -640,21 +915,22 @@ static m68k_context * vdp_port_write(uint32_t vdp_port, m68k_context * context,
 			gen->bus_busy = 0;
 		}
 	} else if (vdp_port < 0x18) {
+		catch_up(gen, DEFER_SOUND);
 		psg_write(gen->psg, value);
 	} else {
 		vdp_test_port_write(gen->vdp, value);
 	}
 #ifdef REFRESH_EMULATION
-	last_sync_cycle -= 4 * MCLKS_PER_68K;
+	gen->last_sync_cycle -= 4 * gen->mclks_per_68k;
 	//refresh may have happened while we were waiting on the VDP,
 	//so advance refresh_counter but don't add any delays
 	if (vdp_port >= 4 && vdp_port < 8 && v_context->cycles != before_cycle) {
-		refresh_counter = 0;
+		gen->refresh_counter = 0;
 	} else {
-		refresh_counter += (context->current_cycle - last_sync_cycle);
-		refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
+		gen->refresh_counter += (context->current_cycle - gen->last_sync_cycle);
+		gen->refresh_counter = gen->refresh_counter % (gen->mclks_per_68k * REFRESH_INTERVAL);
 	}
-	last_sync_cycle = context->current_cycle;
+	gen->last_sync_cycle = context->current_cycle;
 #endif
 	return context;
 }
@@ -705,10 +981,10 @@ static uint16_t vdp_port_read(uint32_t vdp_port, m68k_context * context)
 	uint16_t value;
 #ifdef REFRESH_EMULATION
 	//do refresh check here so we can avoid adding a penalty for a refresh that happens during a VDP access
-	refresh_counter += context->current_cycle - 4*MCLKS_PER_68K - last_sync_cycle;
-	context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
-	last_sync_cycle = context->current_cycle;
+	gen->refresh_counter += context->current_cycle - 4*gen->mclks_per_68k - gen->last_sync_cycle;
+	context->current_cycle += REFRESH_DELAY * gen->mclks_per_68k * (gen->refresh_counter / (gen->mclks_per_68k * REFRESH_INTERVAL));
+	gen->refresh_counter = gen->refresh_counter % (gen->mclks_per_68k * REFRESH_INTERVAL);
+	gen->last_sync_cycle = context->current_cycle;
 #endif
 	sync_components(context, 0);
 	vdp_context * v_context = gen->vdp;
@@ -737,12 +1013,12 @@ static uint16_t vdp_port_read(uint32_t vdp_port, m68k_context * context)
 		gen->bus_busy = 0;
 	}
 #ifdef REFRESH_EMULATION
-	last_sync_cycle -= 4 * MCLKS_PER_68K;
+	gen->last_sync_cycle -= 4 * gen->mclks_per_68k;
 	//refresh may have happened while we were waiting on the VDP,
 	//so advance refresh_counter but don't add any delays
-	refresh_counter += (context->current_cycle - last_sync_cycle);
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
-	last_sync_cycle = context->current_cycle;
+	gen->refresh_counter += (context->current_cycle - gen->last_sync_cycle);
+	gen->refresh_counter = gen->refresh_counter % (gen->mclks_per_68k * REFRESH_INTERVAL);
+	gen->last_sync_cycle = context->current_cycle;
 #endif
 	return value;
 }
@@ -770,7 +1046,7 @@ static uint8_t z80_vdp_port_read(uint32_t vdp_port, void * vcontext)
 	//TODO: add cycle for an access right after a previous one
 	//TODO: Below cycle time is an estimate based on the time between 68K !BG goes low and Z80 !MREQ goes high
 	//      Needs a new logic analyzer capture to get the actual delay on the 68K side
-	gen->m68k->current_cycle += 8 * MCLKS_PER_68K;
+	gen->m68k->current_cycle += 8 * gen->mclks_per_68k;
 
 
 	vdp_port &= 0x1F;
@@ -792,26 +1068,26 @@ static uint8_t z80_vdp_port_read(uint32_t vdp_port, void * vcontext)
 	return vdp_port & 1 ? ret : ret >> 8;
 }
 
-//TODO: Move this inside the system context
-static uint32_t zram_counter = 0;
-
 static m68k_context * io_write(uint32_t location, m68k_context * context, uint8_t value)
 {
 	genesis_context * gen = context->system;
 #ifdef REFRESH_EMULATION
 	//do refresh check here so we can avoid adding a penalty for a refresh that happens during an IO area access
-	refresh_counter += context->current_cycle - 4*MCLKS_PER_68K - last_sync_cycle;
-	context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
-	last_sync_cycle = context->current_cycle - 4*MCLKS_PER_68K;
+	gen->refresh_counter += context->current_cycle - 4*gen->mclks_per_68k - gen->last_sync_cycle;
+	context->current_cycle += REFRESH_DELAY * gen->mclks_per_68k * (gen->refresh_counter / (gen->mclks_per_68k * REFRESH_INTERVAL));
+	gen->refresh_counter = gen->refresh_counter % (gen->mclks_per_68k * REFRESH_INTERVAL);
+	gen->last_sync_cycle = context->current_cycle - 4*gen->mclks_per_68k;
 #endif
 	if (location < 0x10000) {
 		//Access to Z80 memory incurs a one 68K cycle wait state
-		context->current_cycle += MCLKS_PER_68K;
+		context->current_cycle += gen->mclks_per_68k;
 		if (!z80_enabled || z80_get_busack(gen->z80, context->current_cycle)) {
 			location &= 0x7FFF;
 			if (location < 0x4000) {
 				gen->zram[location & 0x1FFF] = value;
+				if (gen->zram_dirty) {
+					gen->zram_dirty[(location & 0x1FFF) >> gen->zram_page_shift] = 1;
+				}
 #ifndef NO_Z80
 				z80_handle_code_write(location & 0x1FFF, gen->z80);
 #endif
@@ -837,6 +1113,7 @@ static m68k_context * io_write(uint32_t location, m68k_context * context, uint8_
 		}
 	} else {
 		if (location < 0x10100) {
+			catch_up(gen, DEFER_IO);
 			switch(location >> 1 & 0xFF)
 			{
 			case 0x1:
@@ -897,7 +1174,7 @@ static m68k_context * io_write(uint32_t location, m68k_context * context, uint8_
 						dputs("releasing z80 bus");
 						#ifdef DO_DEBUG_PRINT
 						char fname[20];
-						sprintf(fname, "zram-%d", zram_counter++);
+						sprintf(fname, "zram-%d", gen->zram_counter++);
 						FILE * f = fopen(fname, "wb");
 						fwrite(z80_ram, 1, sizeof(z80_ram), f);
 						fclose(f);
@@ -923,6 +1200,7 @@ static m68k_context * io_write(uint32_t location, m68k_context * context, uint8_
 					} else {
 						gen->z80->reset = 1;
 					}
+					catch_up(gen, DEFER_SOUND);
 					ym_reset(gen->ym);
 				}
 			} else if (masked != 0x11300 && masked != 0x11000) {
@@ -932,8 +1210,8 @@ static m68k_context * io_write(uint32_t location, m68k_context * context, uint8_
 	}
 #ifdef REFRESH_EMULATION
 	//no refresh delays during IO access
-	refresh_counter += context->current_cycle - last_sync_cycle;
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
+	gen->refresh_counter += context->current_cycle - gen->last_sync_cycle;
+	gen->refresh_counter = gen->refresh_counter % (gen->mclks_per_68k * REFRESH_INTERVAL);
 #endif
 	return context;
 }
@@ -960,14 +1238,14 @@ static uint8_t io_read(uint32_t location, m68k_context * context)
 	genesis_context *gen = context->system;
 #ifdef REFRESH_EMULATION
 	//do refresh check here so we can avoid adding a penalty for a refresh that happens during an IO area access
-	refresh_counter += context->current_cycle - 4*MCLKS_PER_68K - last_sync_cycle;
-	context->current_cycle += REFRESH_DELAY * MCLKS_PER_68K * (refresh_counter / (MCLKS_PER_68K * REFRESH_INTERVAL));
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
-	last_sync_cycle = context->current_cycle - 4*MCLKS_PER_68K;
+	gen->refresh_counter += context->current_cycle - 4*gen->mclks_per_68k - gen->last_sync_cycle;
+	context->current_cycle += REFRESH_DELAY * gen->mclks_per_68k * (gen->refresh_counter / (gen->mclks_per_68k * REFRESH_INTERVAL));
+	gen->refresh_counter = gen->refresh_counter % (gen->mclks_per_68k * REFRESH_INTERVAL);
+	gen->last_sync_cycle = context->current_cycle - 4*gen->mclks_per_68k;
 #endif
 	if (location < 0x10000) {
 		//Access to Z80 memory incurs a one 68K cycle wait state
-		context->current_cycle += MCLKS_PER_68K;
+		context->current_cycle += gen->mclks_per_68k;
 		if (!z80_enabled || z80_get_busack(gen->z80, context->current_cycle)) {
 			location &= 0x7FFF;
 			if (location < 0x4000) {
@@ -987,6 +1265,7 @@ static uint8_t io_read(uint32_t location, m68k_context * context)
 		}
 	} else {
 		if (location < 0x10100) {
+			catch_up(gen, DEFER_IO);
 			switch(location >> 1 & 0xFF)
 			{
 			case 0x0:
@@ -1062,8 +1341,8 @@ static uint8_t io_read(uint32_t location, m68k_context * context)
 	}
 #ifdef REFRESH_EMULATION
 	//no refresh delays during IO access
-	refresh_counter += context->current_cycle - last_sync_cycle;
-	refresh_counter = refresh_counter % (MCLKS_PER_68K * REFRESH_INTERVAL);
+	gen->refresh_counter += context->current_cycle - gen->last_sync_cycle;
+	gen->refresh_counter = gen->refresh_counter % (gen->mclks_per_68k * REFRESH_INTERVAL);
 #endif
 	return value;
 }
@@ -1116,7 +1395,7 @@ static uint8_t z80_read_bank(uint32_t location, void * vcontext)
 	//TODO: add cycle for an access right after a previous one
 	//TODO: Below cycle time is an estimate based on the time between 68K !BG goes low and Z80 !MREQ goes high
 	//      Needs a new logic analyzer capture to get the actual delay on the 68K side
-	gen->m68k->current_cycle += 8 * MCLKS_PER_68K;
+	gen->m68k->current_cycle += 8 * gen->mclks_per_68k;
 
 	location &= 0x7FFF;
 	if (context->mem_pointers[1]) {
@@ -1147,13 +1426,16 @@ static void *z80_write_bank(uint32_t location, void * vcontext, uint8_t value)
 	//TODO: add cycle for an access right after a previous one
 	//TODO: Below cycle time is an estimate based on the time between 68K !BG goes low and Z80 !MREQ goes high
 	//      Needs a new logic analyzer capture to get the actual delay on the 68K side
-	gen->m68k->current_cycle += 8 * MCLKS_PER_68K;
+	gen->m68k->current_cycle += 8 * gen->mclks_per_68k;
 
 	location &= 0x7FFF;
 	uint32_t address = gen->z80_bank_reg << 15 | location;
 	if (address >= 0xE00000) {
 		address &= 0xFFFF;
 		((uint8_t *)gen->work_ram)[address ^ 1] = value;
+		if (gen->work_ram_dirty) {
+			gen->work_ram_dirty[address >> gen->work_ram_page_shift] = 1;
+		}
 	} else if (address >= 0xC00000) {
 		z80_vdp_port_write(location & 0xFF, context, value);
 	} else {
@@ -1285,6 +1567,7 @@ static void set_speed_percent(system_header * system, uint32_t percent)
 	genesis_context *context = (genesis_context *)system;
 	uint32_t old_clock = context->master_clock;
 	context->master_clock = ((uint64_t)context->normal_clock * (uint64_t)percent) / 100;
+	catch_up(context, DEFER_SOUND);
 	while (context->ym->current_cycle != context->psg->cycles) {
 		sync_sound(context, context->psg->cycles + MCLKS_PER_PSG);
 	}
@@ -1320,6 +1603,63 @@ void set_region(genesis_context *gen, rom_info *info, uint8_t region)
 	gen->master_clock = gen->normal_clock;
 }
 
+static void hide_frames(genesis_context *gen, uint8_t hide)
+{
+	gen->vdp->discard_output = hide;
+	gen->vdp->hold_framebuffer = hide;
+}
+
+static void cancel_run_ahead(genesis_context *gen)
+{
+	if (gen->run_ahead_frame) {
+		gen->run_ahead_frame = 0;
+		render_audio_source_discard(gen->ym->audio, 0);
+		render_audio_source_discard(gen->psg->audio, 0);
+	}
+	hide_frames(gen, 0);
+}
+
+//while run-ahead is on, each real frame is emulated with its video hidden and saved, then
+//header.run_ahead more frames are emulated with the same input, only the last of which is
+//shown or heard, before going back to the saved state for the next real frame
+static void run_ahead_frame_end(genesis_context *gen)
+{
+	if (gen->run_ahead_frame) {
+		if (gen->run_ahead_frame < gen->header.run_ahead) {
+			gen->run_ahead_frame++;
+			hide_frames(gen, gen->run_ahead_frame < gen->header.run_ahead);
+			return;
+		}
+		deserialize(&gen->header, gen->run_ahead_state, gen->run_ahead_size);
+		//the restored frame counter would otherwise look like the end of another frame
+		gen->last_frame = gen->vdp->frame;
+		gen->run_ahead_frame = 0;
+		render_audio_source_discard(gen->ym->audio, 0);
+		render_audio_source_discard(gen->psg->audio, 0);
+		hide_frames(gen, gen->header.run_ahead && !(gen->header.rewind && gen->header.rewinding));
+		return;
+	}
+	if (!gen->header.run_ahead || (gen->header.rewind && gen->header.rewinding)) {
+		//frames stepped back to are shown as they are restored
+		hide_frames(gen, 0);
+		return;
+	}
+	size_t size = serialize_into(&gen->header, gen->run_ahead_state, gen->run_ahead_capacity);
+	if (!size) {
+		gen->run_ahead_capacity = serialize_size(&gen->header);
+		gen->run_ahead_state = realloc(gen->run_ahead_state, gen->run_ahead_capacity);
+		size = serialize_into(&gen->header, gen->run_ahead_state, gen->run_ahead_capacity);
+		if (!size) {
+			fatal_error("Save state does not fit in the size reported by the system\n");
+		}
+	}
+	gen->run_ahead_size = size;
+	gen->run_ahead_frame = 1;
+	render_audio_source_discard(gen->ym->audio, 1);
+	render_audio_source_discard(gen->psg->audio, 1);
+	hide_frames(gen, gen->header.run_ahead > 1);
+}
+
 static uint8_t load_state(system_header *system, uint8_t slot)
 {
 	genesis_context *gen = (genesis_context *)system;
@@ -1337,6 +1677,8 @@ static uint8_t load_state(system_header *system, uint8_t slot)
 		}
 		goto done;
 	}
+	//the state run ahead from would otherwise replace the loaded one
+	cancel_run_ahead(gen);
 	if (load_from_file(&state, statepath)) {
 		genesis_deserialize(&state, gen);
 		free(state.data);
@@ -1349,6 +1691,7 @@ static uint8_t load_state(system_header *system, uint8_t slot)
 		ret = pc != 0;
 	}
 	if (ret) {
+		gen->m68k->resume_address = pc;
 		gen->m68k->resume_pc = get_native_address_trans(gen->m68k, pc);
 	}
 done:
@@ -1358,13 +1701,15 @@ done:
 
 static void handle_reset_requests(genesis_context *gen)
 {
-	while (gen->reset_requested || gen->header.delayed_load_slot)
+	while (gen->reset_requested || gen->header.delayed_load_slot || gen->frame_work)
 	{
 		if (gen->reset_requested) {
 			gen->reset_requested = 0;
 			gen->m68k->should_return = 0;
+			cancel_run_ahead(gen);
 			z80_assert_reset(gen->z80, gen->m68k->current_cycle);
 			z80_clear_busreq(gen->z80, gen->m68k->current_cycle);
+			catch_up(gen, DEFER_SOUND);
 			ym_reset(gen->ym);
 			//Is there any sort of VDP reset?
 			m68k_reset(gen->m68k);
@@ -1374,6 +1719,26 @@ static void handle_reset_requests(genesis_context *gen)
 			gen->header.delayed_load_slot = 0;
 			resume_68k(gen->m68k);
 		}
+		if (gen->frame_work) {
+			uint8_t work = gen->frame_work;
+			gen->frame_work = 0;
+			if (work & FRAME_WORK_REWIND_STEP) {
+				rewind_step(gen->header.rewind);
+				//the restored frame counter would otherwise look like the end of another frame
+				gen->last_frame = gen->vdp->frame;
+			}
+			if (work & FRAME_WORK_REWIND_SNAPSHOT) {
+				//serializes straight into the rewind buffer through serialize_into
+				rewind_snapshot(gen->header.rewind);
+			}
+			if (work & FRAME_WORK_RUN_AHEAD) {
+				run_ahead_frame_end(gen);
+			}
+			if (gen->frame_work_return) {
+				break;
+			}
+			resume_68k(gen->m68k);
+		}
 	}
 	if (gen->header.force_release || render_should_release_on_exit()) {
 		bindings_release_capture();
@@ -1503,6 +1868,12 @@ static void free_genesis(system_header *system)
 	genesis_context *gen = (genesis_context *)system;
 	vdp_free(gen->vdp);
 	memmap_chunk *map = (memmap_chunk *)gen->m68k->options->gen.memmap;
+#ifndef NEW_CORE
+	if (gen->code_cache_path) {
+		m68k_save_code_cache(gen->m68k, gen->code_cache_path, gen->header.info.sha1, gen->code_cache_entries);
+		free(gen->code_cache_path);
+	}
+#endif
 	m68k_options_free(gen->m68k->options);
 	free(gen->cart);
 	free(gen->m68k);
@@ -1515,6 +1886,7 @@ static void free_genesis(system_header *system)
 	free(gen->header.save_dir);
 	free_rom_info(&gen->header.info);
 	free(gen->lock_on);
+	free(gen->run_ahead_state);
 	free(gen);
 }
 
@@ -1747,7 +2119,7 @@ static void *tmss_even_write_8(uint32_t address, void *context, uint8_t value)
 
 genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on, uint32_t system_opts, uint8_t force_region)
 {
-	static memmap_chunk z80_map[] = {
+	static const memmap_chunk z80_map[] = {
 		{ 0x0000, 0x4000,  0x1FFF, 0, 0, MMAP_READ | MMAP_WRITE | MMAP_CODE, NULL, NULL, NULL, NULL,              NULL },
 		{ 0x8000, 0x10000, 0x7FFF, 0, 0, 0,                                  NULL, NULL, NULL, z80_read_bank,     z80_write_bank},
 		{ 0x4000, 0x6000,  0x0003, 0, 0, 0,                                  NULL, NULL, NULL, z80_read_ym,       z80_write_ym},
@@ -1755,6 +2127,14 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 		{ 0x7F00, 0x8000,  0x00FF, 0, 0, 0,                                  NULL, NULL, NULL, z80_vdp_port_read, z80_vdp_port_write}
 	};
 	genesis_context *gen = calloc(1, sizeof(genesis_context));
+	char *m68k_divider = tern_find_path(config, "clocks\0m68k_divider\0", TVAL_PTR).ptrval;
+	if (!m68k_divider) {
+		m68k_divider = "7";
+	}
+	gen->mclks_per_68k = atoi(m68k_divider);
+	if (!gen->mclks_per_68k) {
+		gen->mclks_per_68k = 7;
+	}
 	gen->header.set_speed_percent = set_speed_percent;
 	gen->header.start_context = start_genesis;
 	gen->header.resume_context = resume_genesis;
@@ -1776,9 +2156,13 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 	gen->header.keyboard_up = keyboard_up;
 	gen->header.config_updated = config_updated;
 	gen->header.serialize = serialize;
+	gen->header.serialize_into = serialize_into;
+	gen->header.serialize_size = serialize_size;
+	gen->header.serialize_checkpoint = serialize_checkpoint;
 	gen->header.deserialize = deserialize;
 	gen->header.start_vgm_log = start_vgm_log;
 	gen->header.stop_vgm_log = stop_vgm_log;
+	gen->header.flush_audio = flush_audio;
 	gen->header.type = SYSTEM_GENESIS;
 	gen->header.info = *rom;
 	set_region(gen, rom, force_region);
@@ -1796,8 +2180,8 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 	gen->frame_end = vdp_cycles_to_frame_end(gen->vdp);
 	char * config_cycles = tern_find_path(config, "clocks\0max_cycles\0", TVAL_PTR).ptrval;
 	gen->max_cycles = config_cycles ? atoi(config_cycles) : DEFAULT_SYNC_INTERVAL;
-	gen->int_latency_prev1 = MCLKS_PER_68K * 32;
-	gen->int_latency_prev2 = MCLKS_PER_68K * 16;
+	gen->int_latency_prev1 = gen->mclks_per_68k * 32;
+	gen->int_latency_prev2 = gen->mclks_per_68k * 16;
 	
 	render_set_video_standard((gen->version_reg & HZ50) ? VID_PAL : VID_NTSC);
 	event_system_start(SYSTEM_GENESIS, (gen->version_reg & HZ50) ? VID_PAL : VID_NTSC, rom->name);
@@ -1807,20 +2191,32 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 	if (!strcmp(fm + strlen(fm) -4, "3834")) {
 		system_opts |= YM_OPT_3834;
 	}
+	if (!strcmp(tern_find_path_default(config, "audio\0fm_batch\0", (tern_val){.ptrval="off"}, TVAL_PTR).ptrval, "on")) {
+		system_opts |= YM_OPT_BATCH;
+	}
 	ym_init(gen->ym, gen->master_clock, MCLKS_PER_YM, system_opts);
 
 	gen->psg = malloc(sizeof(psg_context));
 	psg_init(gen->psg, gen->master_clock, MCLKS_PER_PSG);
 	
 	set_audio_config(gen);
+	gen->deferred[DEFER_SOUND] = (deferred_component){.run = run_sound, .cycle = CYCLE_NEVER};
+	gen->deferred[DEFER_IO] = (deferred_component){.run = run_io, .cycle = CYCLE_NEVER};
 
-	z80_map[0].buffer = gen->zram = calloc(1, Z80_RAM_BYTES);
+	//the Z80 options keep a pointer to the map, so each instance needs its own copy pointing at its own RAM
+	memcpy(gen->z80_map, z80_map, sizeof(z80_map));
+	gen->z80_map[0].buffer = gen->zram = calloc(1, Z80_RAM_BYTES);
+	if (system_opts & OPT_CHECKPOINTS) {
+		gen->z80_map[0].flags |= MMAP_DIRTY_PAGES;
+	}
 #ifndef NO_Z80
 	z80_options *z_opts = malloc(sizeof(z80_options));
-	init_z80_opts(z_opts, z80_map, 5, NULL, 0, MCLKS_PER_Z80, 0xFFFF);
+	init_z80_opts(z_opts, gen->z80_map, 5, NULL, 0, MCLKS_PER_Z80, 0xFFFF);
 	gen->z80 = init_z80_context(z_opts);
 #ifndef NEW_CORE
 	gen->z80->next_int_pulse = z80_next_int_pulse;
+	gen->zram_dirty = get_dirty_flags(&z_opts->gen, gen->z80, 0);
+	gen->zram_page_shift = z_opts->gen.ram_flags_shift;
 #endif
 	z80_assert_reset(gen->z80, 0);
 #else
@@ -1849,6 +2245,8 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 		{
 			gen->vdp->vdpmem[i] = rand();
 		}
+		vdp_invalidate_decoded_rows(gen->vdp);
+		vdp_mark_vram_dirty(gen->vdp);
 		for (int i = 0; i < SAT_CACHE_SIZE; i++)
 		{
 			gen->vdp->sat_cache[i] = rand();
@@ -1892,6 +2290,9 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 	{
 		if (rom->map[i].start == 0xE00000) {
 			rom->map[i].buffer = gen->work_ram;
+			if (system_opts & OPT_CHECKPOINTS) {
+				rom->map[i].flags |= MMAP_DIRTY_PAGES;
+			}
 			if (!tmss) {
 				break;
 			}
@@ -2025,12 +2426,18 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 	}
 
 	m68k_options *opts = malloc(sizeof(m68k_options));
-	init_m68k_opts(opts, rom->map, rom->map_chunks, MCLKS_PER_68K);
+	init_m68k_opts(opts, rom->map, rom->map_chunks, gen->mclks_per_68k);
 	if (!strcmp(tern_find_ptr_default(model, "tas", "broken"), "broken")) {
 		opts->gen.flags |= M68K_OPT_BROKEN_READ_MODIFY;
 	}
+	char *budget = tern_find_path_default(config, "system\0jit_budget\0", (tern_val){.ptrval = "64"}, TVAL_PTR).ptrval;
+	opts->gen.cache.budget = atoi(budget) * 1024 * 1024;
 	gen->m68k = init_68k_context(opts, NULL);
 	gen->m68k->system = gen;
+#ifndef NEW_CORE
+	gen->work_ram_dirty = get_dirty_flags(&opts->gen, gen->m68k, 0xFF0000);
+	gen->work_ram_page_shift = opts->gen.ram_flags_shift;
+#endif
 	opts->address_log = (system_opts & OPT_ADDRESS_LOG) ? fopen("address.log", "w") : NULL;
 	
 	//This must happen after the 68K context has been allocated
@@ -2053,6 +2460,28 @@ genesis_context *alloc_init_genesis(rom_info *rom, void *main_rom, void *lock_on
 	return gen;
 }
 
+#ifndef NEW_CORE
+static char *get_code_cache_path(genesis_context *gen)
+{
+	char const *userdata = get_userdata_dir();
+	if (!userdata) {
+		return NULL;
+	}
+	char *dir = path_append(userdata, "blastem" PATH_SEP "jit_cache");
+	if (!ensure_dir_exists(dir)) {
+		warning("Failed to create JIT cache directory %s\n", dir);
+		free(dir);
+		return NULL;
+	}
+	char hex_hash[41];
+	bin_to_hex((uint8_t *)hex_hash, gen->header.info.sha1, sizeof(gen->header.info.sha1));
+	char const *parts[] = {dir, PATH_SEP, hex_hash, ".68k"};
+	char *path = alloc_concat_m(sizeof(parts)/sizeof(*parts), parts);
+	free(dir);
+	return path;
+}
+#endif
+
 genesis_context *alloc_config_genesis(void *rom, uint32_t rom_size, void *lock_on, uint32_t lock_on_size, uint32_t ym_opts, uint8_t force_region)
 {
 	static memmap_chunk base_map[] = {
@@ -2081,13 +2510,14 @@ genesis_context *alloc_config_genesis(void *rom, uint32_t rom_size, void *lock_o
 		byteswap_rom(lock_on_size, lock_on);
 	}
 #endif
-	char *m68k_divider = tern_find_path(config, "clocks\0m68k_divider\0", TVAL_PTR).ptrval;
-	if (!m68k_divider) {
-		m68k_divider = "7";
-	}
-	MCLKS_PER_68K = atoi(m68k_divider);
-	if (!MCLKS_PER_68K) {
-		MCLKS_PER_68K = 7;
+	genesis_context *gen = alloc_init_genesis(&info, rom, lock_on, ym_opts, force_region);
+#ifndef NEW_CORE
+	if (!strcmp(tern_find_path_default(config, "system\0jit_cache\0", (tern_val){.ptrval = "off"}, TVAL_PTR).ptrval, "on")) {
+		gen->code_cache_path = get_code_cache_path(gen);
+		if (gen->code_cache_path) {
+			gen->code_cache_entries = m68k_load_code_cache(gen->m68k, gen->code_cache_path, gen->header.info.sha1);
+		}
 	}
-	return alloc_init_genesis(&info, rom, lock_on, ym_opts, force_region);
+#endif
+	return gen;
 }
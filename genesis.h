@@ -24,6 +24,28 @@
 
 typedef struct genesis_context genesis_context;
 
+typedef void (*catch_up_fun)(genesis_context *gen, uint32_t cycle);
+
+//a component that only needs to be caught up with the 68K when it's accessed, at the end of a frame
+//or before its state is saved, instead of at every sync point
+typedef struct {
+	catch_up_fun run;
+	uint32_t     cycle; //cycle the component is owed time up to, CYCLE_NEVER if it's caught up
+} deferred_component;
+
+enum {
+	DEFER_SOUND,
+	DEFER_IO,
+	DEFER_NUM
+};
+
+//work requested at the end of a frame that can only be done once the 68K has returned
+enum {
+	FRAME_WORK_REWIND_STEP     = 1,
+	FRAME_WORK_REWIND_SNAPSHOT = 2,
+	FRAME_WORK_RUN_AHEAD       = 4
+};
+
 struct genesis_context {
 	system_header   header;
 	m68k_context    *m68k;
@@ -35,6 +57,9 @@ struct genesis_context {
 	uint16_t        *lock_on;
 	uint16_t        *work_ram;
 	uint8_t         *zram;
+	//page flags set by the CPU cores on writes, NULL if the core doesn't track them
+	uint8_t         *work_ram_dirty;
+	uint8_t         *zram_dirty;
 	void            *extra;
 	uint8_t         *save_storage;
 	void            *mapper_temp;
@@ -44,9 +69,16 @@ struct genesis_context {
 	read_16_fun     tmss_read_16;
 	read_8_fun      tmss_read_8;
 	uint16_t        *tmss_pointers[NUM_MEM_AREAS];
+	memmap_chunk    z80_map[5];
 	uint8_t         *tmss_buffer;
 	uint8_t         *serialize_tmp;
+	uint8_t         *serialize_dest;
+	char            *code_cache_path;
+	uint8_t         *run_ahead_state; //the real frame while frames are being run ahead of it
 	size_t          serialize_size;
+	size_t          serialize_dest_size;
+	size_t          run_ahead_size;
+	size_t          run_ahead_capacity;
 	uint32_t        num_eeprom;
 	uint32_t        save_size;
 	uint32_t        save_ram_mask;
@@ -54,6 +86,7 @@ struct genesis_context {
 	uint32_t        normal_clock; //Normal master clock (used to restore master clock after turbo mode)
 	uint32_t        frame_end;
 	uint32_t        max_cycles;
+	uint32_t        mclks_per_68k;
 	uint32_t        int_latency_prev1;
 	uint32_t        int_latency_prev2;
 	uint32_t        reset_cycle;
@@ -61,6 +94,14 @@ struct genesis_context {
 	uint32_t        last_flush_cycle;
 	uint32_t        soft_flush_cycles;
 	uint32_t        tmss_write_offset;
+	uint32_t        last_sync_cycle;
+	uint32_t        refresh_counter;
+	uint32_t        zram_counter;
+	uint32_t        code_cache_entries;
+	deferred_component deferred[DEFER_NUM];
+	uint32_t        checkpoint_id; //checkpoint the dirty page flags are relative to, 0 if there is none
+	uint32_t        last_checkpoint_id;
+	uint32_t        loaded_checkpoint;
 	uint8_t         bank_regs[8];
 	uint16_t        z80_bank_reg;
 	uint16_t        tmss_lock[2];
@@ -73,6 +114,13 @@ struct genesis_context {
 	uint8_t         reset_requested;
 	uint8_t         tmss;
 	uint8_t         vdp_unlocked;
+	uint8_t         checkpoint_mode;
+	uint8_t         work_ram_exposed; //a frontend can write work RAM without the dirty page tracking seeing it
+	uint8_t         work_ram_page_shift;
+	uint8_t         zram_page_shift;
+	uint8_t         frame_work;
+	uint8_t         frame_work_return; //something else wants control too, return to the caller once frame_work is done
+	uint8_t         run_ahead_frame; //frames emulated past the real one so far, 0 while emulating a real frame
 	eeprom_state    eeprom;
 	nor_state       nor;
 };
@@ -83,7 +131,8 @@ struct genesis_context {
 m68k_context * sync_components(m68k_context *context, uint32_t address);
 genesis_context *alloc_config_genesis(void *rom, uint32_t rom_size, void *lock_on, uint32_t lock_on_size, uint32_t system_opts, uint8_t force_region);
 void genesis_serialize(genesis_context *gen, serialize_buffer *buf, uint32_t m68k_pc, uint8_t all);
-void genesis_deserialize(deserialize_buffer *buf, genesis_context *gen);
+//returns 0 if the state is incremental and doesn't apply on top of the current state
+uint8_t genesis_deserialize(deserialize_buffer *buf, genesis_context *gen);
 
 #endif //GENESIS_H_
 
@@ -260,6 +260,8 @@ uint8_t vdp_load_gst(vdp_context * context, FILE * state_file)
 		context->vdpmem[i] = tmp_buf[i];
 		vdp_check_update_sat_byte(context, i, tmp_buf[i]);
 	}
+	vdp_invalidate_decoded_rows(context);
+	vdp_mark_vram_dirty(context);
 	return 1;
 }
 
@@ -433,6 +435,13 @@ uint32_t load_gst(genesis_context * gen, char * fname)
 	if (!pc) {
 		goto error_close;
 	}
+	//memory is about to change without going through the dirty page tracking
+	gen->checkpoint_id = 0;
+	for (int i = 0; i < DEFER_NUM; i++)
+	{
+		//time owed to these belongs to the state being replaced
+		gen->deferred[i].cycle = CYCLE_NEVER;
+	}
 	
 	if (!vdp_load_gst(gen->vdp, gstfile)) {
 		goto error_close;
@@ -99,3 +99,81 @@ void sha1(uint8_t *data, uint64_t size, uint8_t *out)
 		out[cur+3] = val;
 	}
 }
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotleft64(uint64_t val, uint32_t shift)
+{
+	return val << shift | val >> (64-shift);
+}
+
+static uint64_t read_le64(const uint8_t *data)
+{
+	uint64_t ret = 0;
+	for (int i = 7; i >= 0; i--)
+	{
+		ret = ret << 8 | data[i];
+	}
+	return ret;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_PRIME2;
+	return rotleft64(acc, 31) * XXH_PRIME1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh_round(0, val);
+	return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+uint64_t xxhash64(const void *vdata, size_t size, uint64_t seed)
+{
+	const uint8_t *data = vdata, *end = data + size;
+	uint64_t hash;
+	if (size >= 32) {
+		uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2, v2 = seed + XXH_PRIME2, v3 = seed, v4 = seed - XXH_PRIME1;
+		for (; data + 32 <= end; data += 32)
+		{
+			v1 = xxh_round(v1, read_le64(data));
+			v2 = xxh_round(v2, read_le64(data + 8));
+			v3 = xxh_round(v3, read_le64(data + 16));
+			v4 = xxh_round(v4, read_le64(data + 24));
+		}
+		hash = rotleft64(v1, 1) + rotleft64(v2, 7) + rotleft64(v3, 12) + rotleft64(v4, 18);
+		hash = xxh_merge(hash, v1);
+		hash = xxh_merge(hash, v2);
+		hash = xxh_merge(hash, v3);
+		hash = xxh_merge(hash, v4);
+	} else {
+		hash = seed + XXH_PRIME5;
+	}
+	hash += size;
+	for (; data + 8 <= end; data += 8)
+	{
+		hash ^= xxh_round(0, read_le64(data));
+		hash = rotleft64(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+	}
+	if (data + 4 <= end) {
+		hash ^= (uint64_t)(data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24) * XXH_PRIME1;
+		hash = rotleft64(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+		data += 4;
+	}
+	for (; data < end; data++)
+	{
+		hash ^= *data * XXH_PRIME5;
+		hash = rotleft64(hash, 11) * XXH_PRIME1;
+	}
+	hash ^= hash >> 33;
+	hash *= XXH_PRIME2;
+	hash ^= hash >> 29;
+	hash *= XXH_PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
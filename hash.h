@@ -2,11 +2,14 @@
 #define HASH_H_
 
 #include <stdint.h>
+#include <stddef.h>
 
 //NOTE: This is only intended for use in file identification
 //Please do not use this in a cryptographic setting as no attempts have been
 //made at avoiding side channel attacks
 
 void sha1(uint8_t *data, uint64_t size, uint8_t *out);
+//XXH64, a fast non-cryptographic hash for checking emulator output is unchanged
+uint64_t xxhash64(const void *data, size_t size, uint64_t seed);
 
 #endif //HASH_H_
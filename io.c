@@ -1000,6 +1000,11 @@ void io_run(io_port *port, uint32_t current_cycle)
 	}
 }
 
+uint8_t io_serial_idle(io_port *port)
+{
+	return !port->serial_ctrl && !port->transmit_end && !port->receive_end;
+}
+
 void io_control_write(io_port *port, uint8_t value, uint32_t current_cycle)
 {
 	uint8_t changes = value ^ port->control;
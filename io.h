@@ -133,6 +133,8 @@ enum {
 void setup_io_devices(tern_node * config, rom_info *rom, sega_io *io);
 void io_adjust_cycles(io_port * pad, uint32_t current_cycle, uint32_t deduction);
 void io_run(io_port *port, uint32_t current_cycle);
+//returns 1 if io_run would do nothing for this port beyond advancing the serial clock
+uint8_t io_serial_idle(io_port *port);
 void io_control_write(io_port *port, uint8_t value, uint32_t current_cycle);
 void io_data_write(io_port * pad, uint8_t value, uint32_t current_cycle);
 void io_tx_write(io_port *port, uint8_t value, uint32_t current_cycle);
@@ -8,6 +8,7 @@
 #include "io.h"
 #include "genesis.h"
 #include "sms.h"
+#include "rewind.h"
 
 static retro_environment_t retro_environment;
 static retro_video_refresh_t retro_video_refresh;
@@ -43,10 +44,18 @@ RETRO_API void retro_set_environment(retro_environment_t re)
 		input_descriptor_macro(5)
 		input_descriptor_macro(6)
 		input_descriptor_macro(7)
+		{ 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L2, "Rewind" },
 		{ 0 },
 	};
 
 	re(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, (void *)desc);
+
+	static const struct retro_variable vars[] = {
+		{ "blastem_runahead", "Run-ahead frames; 0|1|2|3|4" },
+		{ "blastem_rewind", "Rewind buffer in MB, hold L2 to rewind; off|8|16|32|64" },
+		{ NULL, NULL },
+	};
+	re(RETRO_ENVIRONMENT_SET_VARIABLES, (void *)vars);
 }
 
 RETRO_API void retro_set_video_refresh(retro_video_refresh_t rvf)
@@ -79,6 +88,7 @@ int z80_enabled               = 1;
 uint8_t use_native_states     = 1;
 system_header *current_system = NULL;
 static system_media current_media;
+static system_type stype;
 
 RETRO_API void retro_init(void)
 {
@@ -197,16 +207,106 @@ RETRO_API void retro_reset(void)
  * In this case, the video callback can take a NULL argument for data.
  */
 static uint8_t started;
+static uint32_t runahead_frames;
+static uint8_t *runahead_state;
+static size_t runahead_state_size;
+static uint32_t rewind_megabytes;
+//set while running frames whose video or audio output is thrown away
+static uint8_t discard_video, discard_audio;
+
+static void update_variables(void)
+{
+	struct retro_variable var = { "blastem_runahead", NULL };
+	runahead_frames = 0;
+	uint32_t megabytes = 0;
+	if (retro_environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+		runahead_frames = atoi(var.value);
+	var.key = "blastem_rewind";
+	var.value = NULL;
+	if (retro_environment(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+		megabytes = atoi(var.value);
+	if (megabytes != rewind_megabytes)
+	{
+		/* the system takes a snapshot at the end of every frame while this is set */
+		if (current_system->rewind)
+			rewind_free(current_system->rewind);
+		current_system->rewind = megabytes ? rewind_new(current_system, (size_t)megabytes * 1024 * 1024, 1) : NULL;
+		rewind_megabytes = megabytes;
+	}
+}
+
+static vdp_context *current_vdp(void)
+{
+	switch (stype)
+	{
+	case SYSTEM_GENESIS:
+		return ((genesis_context *)current_system)->vdp;
+	case SYSTEM_SMS:
+		return ((sms_context *)current_system)->vdp;
+	default:
+		return NULL;
+	}
+}
+
+static void set_discard_video(uint8_t discard)
+{
+	vdp_context *vdp = current_vdp();
+	discard_video = discard;
+	if (vdp)
+		vdp->discard_output = discard;
+}
+
+/* Runs the real frame with its video hidden and snapshots it in memory,
+ * then runs ahead with the same input, dropping audio and showing only
+ * the last frame, before rolling back to the snapshot */
+static void run_ahead(void)
+{
+	size_t state_size;
+	size_t size = retro_serialize_size();
+	if (size > runahead_state_size)
+	{
+		runahead_state      = realloc(runahead_state, size);
+		runahead_state_size = size;
+	}
+	set_discard_video(1);
+	current_system->resume_context(current_system);
+	state_size = current_system->serialize_into(current_system, runahead_state, runahead_state_size);
+	if (!state_size)
+	{
+		set_discard_video(0);
+		return;
+	}
+	discard_audio = 1;
+	/* frames that get rolled back must not end up in the rewind history */
+	rewind_buffer *rewind = current_system->rewind;
+	current_system->rewind = NULL;
+	for (uint32_t i = 0; i < runahead_frames; i++)
+	{
+		if (i == runahead_frames - 1)
+			set_discard_video(0);
+		current_system->resume_context(current_system);
+	}
+	current_system->deserialize(current_system, runahead_state, state_size);
+	current_system->rewind = rewind;
+	discard_audio = 0;
+}
+
 RETRO_API void retro_run(void)
 {
+	bool updated = false;
+	if (retro_environment(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
+		update_variables();
 	retro_input_poll();
-	if (started)
-		current_system->resume_context(current_system);
-	else
+	current_system->rewinding = retro_input_state(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L2) != 0;
+	if (!started)
 	{
 		current_system->start_context(current_system, NULL);
 		started = 1;
 	}
+	else if (runahead_frames && current_system->serialize_into)
+		run_ahead();
+	else
+		current_system->resume_context(current_system);
 }
 
 /* Returns the amount of data the implementation requires to serialize
@@ -215,31 +315,29 @@ RETRO_API void retro_run(void)
  * returned size is never allowed to be larger than a previous returned
  * value, to ensure that the frontend can allocate a save state buffer once.
  */
+static size_t serialize_size;
 RETRO_API size_t retro_serialize_size(void)
 {
-	return SERIALIZE_DEFAULT_SIZE;
+	if (!current_system) {
+		return SERIALIZE_DEFAULT_SIZE;
+	}
+	//the bound is computed once per game so it never grows between calls
+	if (!serialize_size) {
+		serialize_size = current_system->serialize_size(current_system);
+	}
+	return serialize_size;
 }
 
 /* Serializes internal state. If failed, or size is lower than
  * retro_serialize_size(), it should return false, true otherwise. */
 RETRO_API bool retro_serialize(void *data, size_t size)
 {
-	size_t actual_size;
-	uint8_t *tmp = current_system->serialize(current_system, &actual_size);
-	if (actual_size > size)
-   {
-      free(tmp);
-      return 0;
-   }
-	memcpy(data, tmp, actual_size);
-	free(tmp);
-	return 1;
+	return current_system->serialize_into(current_system, data, size) != 0;
 }
 
 RETRO_API bool retro_unserialize(const void *data, size_t size)
 {
-	current_system->deserialize(current_system, (uint8_t *)data, size);
-	return 1;
+	return current_system->deserialize(current_system, (uint8_t *)data, size) != 0;
 }
 
 RETRO_API void retro_cheat_reset(void) { }
@@ -247,7 +345,6 @@ RETRO_API void retro_cheat_set(unsigned index,
       bool enabled, const char *code)  { }
 
 /* Loads a game. */
-static system_type stype;
 RETRO_API bool retro_load_game(const struct retro_game_info *game)
 {
 	unsigned format = RETRO_PIXEL_FORMAT_XRGB8888;
@@ -269,6 +366,7 @@ RETRO_API bool retro_load_game(const struct retro_game_info *game)
 
    if (!current_system)
       return false;
+   update_variables();
    return true;
 }
 
@@ -293,8 +391,15 @@ RETRO_API void retro_unload_game(void)
 	/* buffer is freed by the context */
 	current_media.buffer    = NULL;
 
+	if (current_system->rewind)
+		rewind_free(current_system->rewind);
+	rewind_megabytes = 0;
 	current_system->free_context(current_system);
 	current_system  = NULL;
+	serialize_size  = 0;
+	free(runahead_state);
+	runahead_state      = NULL;
+	runahead_state_size = 0;
 }
 
 /* Gets region of game. */
@@ -314,6 +419,10 @@ RETRO_API void *retro_get_memory_data(unsigned id)
             case SYSTEM_GENESIS:
                {
                   genesis_context *gen = (genesis_context *)current_system;
+                  /* writes through this pointer don't go through the dirty page tracking, so
+                   * incremental states can't be saved or loaded on top of a checkpoint anymore */
+                  gen->work_ram_exposed = 1;
+                  gen->checkpoint_id = 0;
                   return (uint8_t *)gen->work_ram;
                }
 #ifndef NO_Z80
@@ -376,7 +485,7 @@ uint32_t render_map_color(uint8_t r, uint8_t g, uint8_t b)
 
 /* Not supported in lib build */
 uint8_t render_create_window(char *caption,
-      uint32_t width, uint32_t height, window_close_handler close_handler)
+      uint32_t width, uint32_t height, window_close_handler close_handler, void *close_data)
 {
 	return 0;
 }
@@ -421,7 +530,8 @@ void render_framebuffer_updated(uint8_t which, int width)
       last_width            = width;
       last_height           = height;
    }
-   retro_video_refresh(fb + overscan_left + LINEBUF_SIZE * overscan_top, width, height, LINEBUF_SIZE * sizeof(uint32_t));
+   if (!discard_video)
+      retro_video_refresh(fb + overscan_left + LINEBUF_SIZE * overscan_top, width, height, LINEBUF_SIZE * sizeof(uint32_t));
    system_request_exit(current_system, 0);
 }
 
@@ -518,7 +628,8 @@ void render_do_audio_ready(audio_source *src)
       int16_t buffer[8];
       int min_remaining_out;
       mix_and_convert((uint8_t *)buffer, sizeof(buffer), &min_remaining_out);
-      retro_audio_sample_batch(buffer, sizeof(buffer)/(2*sizeof(*buffer)));
+      if (!discard_audio)
+         retro_audio_sample_batch(buffer, sizeof(buffer)/(2*sizeof(*buffer)));
    }
 }
 
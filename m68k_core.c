@@ -10,10 +10,19 @@
 #include "gen.h"
 #include "util.h"
 #include "serialize.h"
+#include "hash.h"
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+//should_return value used when the only reason to return is a pending code cache flush
+#define M68K_RETURN_FLUSH 2
 
 char disasm_buf[1024];
 
@@ -99,7 +108,11 @@ void m68k_save_result(m68kinst * inst, m68k_options * opts)
 		) {
 			areg_to_native(opts, inst->dst.params.regs.pri, opts->gen.scratch2);
 		}
-		m68k_write_size(opts, inst->extra.size, 1);
+		if (inst->dst.addr_mode == MODE_ABSOLUTE || inst->dst.addr_mode == MODE_ABSOLUTE_SHORT) {
+			m68k_write_size_at(opts, inst, 1, inst->dst.params.immed);
+		} else {
+			m68k_write_size(opts, inst->extra.size, 1);
+		}
 	}
 }
 
@@ -227,8 +240,7 @@ static void translate_m68k_jmp_jsr(m68k_options * opts, m68kinst * inst)
 			push_const(opts, inst->address+2);
 		}
 		areg_to_native(opts, inst->src.params.regs.pri, opts->gen.scratch1);
-		call(code, opts->native_addr);
-		jmp_r(code, opts->gen.scratch1);
+		jump_m68k_indirect(opts);
 		break;
 	case MODE_AREG_DISPLACE:
 		cycles(&opts->gen, BUS*2);
@@ -236,8 +248,7 @@ static void translate_m68k_jmp_jsr(m68k_options * opts, m68kinst * inst)
 			push_const(opts, inst->address+4);
 		}
 		calc_areg_displace(opts, &inst->src, opts->gen.scratch1);
-		call(code, opts->native_addr);
-		jmp_r(code, opts->gen.scratch1);
+		jump_m68k_indirect(opts);
 		break;
 	case MODE_AREG_INDEX_DISP8:
 		cycles(&opts->gen, BUS*3);//TODO: CHeck that this is correct
@@ -245,8 +256,7 @@ static void translate_m68k_jmp_jsr(m68k_options * opts, m68kinst * inst)
 			push_const(opts, inst->address+4);
 		}
 		calc_areg_index_disp8(opts, &inst->src, opts->gen.scratch1);
-		call(code, opts->native_addr);
-		jmp_r(code, opts->gen.scratch1);
+		jump_m68k_indirect(opts);
 		break;
 	case MODE_PC_DISPLACE:
 		//TODO: Add cycles in the right place relative to pushing the return address on the stack
@@ -263,8 +273,7 @@ static void translate_m68k_jmp_jsr(m68k_options * opts, m68kinst * inst)
 		}
 		ldi_native(opts, inst->address+2, opts->gen.scratch1);
 		calc_index_disp8(opts, &inst->src, opts->gen.scratch1);
-		call(code, opts->native_addr);
-		jmp_r(code, opts->gen.scratch1);
+		jump_m68k_indirect(opts);
 		break;
 	case MODE_ABSOLUTE:
 	case MODE_ABSOLUTE_SHORT:
@@ -316,8 +325,7 @@ static void translate_m68k_rts(m68k_options * opts, m68kinst * inst)
 	addi_areg(opts, 4, 7);
 	call(code, opts->read_32);
 	cycles(&opts->gen, 2*BUS);
-	call(code, opts->native_addr);
-	jmp_r(code, opts->gen.scratch1);
+	jump_m68k_indirect(opts);
 }
 
 static void translate_m68k_rtr(m68k_options *opts, m68kinst * inst)
@@ -333,8 +341,7 @@ static void translate_m68k_rtr(m68k_options *opts, m68kinst * inst)
 	call(code, opts->read_32);
 	addi_areg(opts, 4, 7);
 	//Get native address and jump to it
-	call(code, opts->native_addr);
-	jmp_r(code, opts->gen.scratch1);
+	jump_m68k_indirect(opts);
 }
 
 static void translate_m68k_trap(m68k_options *opts, m68kinst *inst)
@@ -816,6 +823,8 @@ void insert_breakpoint(m68k_context * context, uint32_t address, m68k_debug_hand
 			.handler = bp_handler,
 			.address = address
 		};
+		//a run starting before this address would skip over the breakpoint
+		m68k_invalidate_code_range(context, address, address);
 		m68k_breakpoint_patch(context, address, bp_handler, NULL);
 	}
 }
@@ -1006,6 +1015,213 @@ static void translate_m68k(m68k_context *context, m68kinst * inst)
 	}
 }
 
+static uint8_t m68k_is_run_operand(m68k_op_info *op)
+{
+	switch (op->addr_mode)
+	{
+	case MODE_REG:
+	case MODE_AREG:
+	case MODE_IMMEDIATE:
+	case MODE_IMMEDIATE_WORD:
+	case MODE_UNUSED:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+//instructions that only touch registers and flags and have a fixed duration
+static uint8_t m68k_is_run_inst(m68k_context *context, m68kinst *inst)
+{
+	if ((inst->address & 1) || find_breakpoint(context, inst->address)) {
+		return 0;
+	}
+	if (!m68k_is_run_operand(&inst->src) || !m68k_is_run_operand(&inst->dst)) {
+		return 0;
+	}
+	switch (inst->op)
+	{
+	case M68K_ADD:
+	case M68K_SUB:
+	case M68K_ADDX:
+	case M68K_SUBX:
+	case M68K_AND:
+	case M68K_EOR:
+	case M68K_OR:
+	case M68K_CMP:
+	case M68K_EXT:
+	case M68K_NEG:
+	case M68K_NOT:
+	case M68K_TST:
+	case M68K_SWAP:
+	case M68K_MOVE:
+	case M68K_CLR:
+	case M68K_EXG:
+	case M68K_NOP:
+		return 1;
+	case M68K_ASL:
+	case M68K_LSL:
+	case M68K_ASR:
+	case M68K_LSR:
+	case M68K_ROL:
+	case M68K_ROR:
+		//shifts by a register have a variable duration
+		return inst->src.addr_mode == MODE_IMMEDIATE;
+	default:
+		return 0;
+	}
+}
+
+//flags that are always overwritten by an instruction that can be part of a run
+static uint32_t m68k_run_flags_written(m68kinst *inst)
+{
+	switch (inst->op)
+	{
+	case M68K_ADD:
+	case M68K_SUB:
+		//ADDA and SUBA leave the flags alone
+		return inst->dst.addr_mode == MODE_AREG ? 0 : ALL_FLAGS;
+	case M68K_NEG:
+	case M68K_ASL:
+	case M68K_LSL:
+	case M68K_ASR:
+	case M68K_LSR:
+		return ALL_FLAGS;
+	case M68K_ADDX:
+	case M68K_SUBX:
+		//Z is only ever cleared
+		return XA|NA|VA|CA;
+	case M68K_MOVE:
+		return inst->dst.addr_mode == MODE_AREG ? 0 : NA|ZA|VA|CA;
+	case M68K_AND:
+	case M68K_EOR:
+	case M68K_OR:
+	case M68K_CMP:
+	case M68K_EXT:
+	case M68K_NOT:
+	case M68K_TST:
+	case M68K_SWAP:
+	case M68K_CLR:
+	case M68K_ROL:
+	case M68K_ROR:
+		return NA|ZA|VA|CA;
+	default:
+		return 0;
+	}
+}
+
+static uint32_t m68k_run_flags_read(m68kinst *inst)
+{
+	if (inst->op == M68K_ADDX || inst->op == M68K_SUBX) {
+		return XA|ZA;
+	}
+	return 0;
+}
+
+//Decodes the instructions that follow run[0] in its run, address is the address after run[0].
+//Returns the number of instructions in the run and sets *after to the address following it
+static uint32_t m68k_decode_run(m68k_context *context, m68kinst *run, uint32_t address, uint32_t *after)
+{
+	m68k_options *opts = context->options;
+	uint32_t num = 1;
+	memmap_chunk const *chunk = find_map_chunk(run->address, &opts->gen, 0, NULL);
+	while (num < M68K_MAX_RUN)
+	{
+		if (get_native_address(opts, address) || find_map_chunk(address, &opts->gen, 0, NULL) != chunk) {
+			break;
+		}
+		uint16_t *encoded = get_native_pointer(address, (void **)context->mem_pointers, &opts->gen);
+		if (!encoded) {
+			break;
+		}
+		uint16_t *next = m68k_decode(encoded, run + num, address);
+		uint32_t next_address = address + (next-encoded)*2;
+		if (!m68k_is_run_inst(context, run + num) || next_address - run->address > M68K_MAX_RUN_BYTES) {
+			break;
+		}
+		address = next_address;
+		num++;
+	}
+	*after = address;
+	return num;
+}
+
+//Translates a run of register-only instructions starting with first, see check_cycles_run in backend.h.
+//Returns the address after the run or 0 if there was no run at this address
+static uint32_t translate_m68k_run(m68k_context *context, m68kinst *first, uint32_t address)
+{
+	m68k_options *opts = context->options;
+	code_info *code = &opts->gen.code;
+	m68kinst run[M68K_MAX_RUN];
+	run[0] = *first;
+	uint32_t num = m68k_decode_run(context, run, address, &address);
+	if (num < 2) {
+		return 0;
+	}
+
+	code_ptr start = code->cur;
+	check_cycles_int(&opts->gen, first->address);
+	code_ptr check = check_cycles_run(&opts->gen);
+	//nothing can observe the flags between instructions inside the run since there are
+	//no interrupt checks or syncs, so flag updates that get overwritten can be dropped
+	uint32_t live_flags[M68K_MAX_RUN];
+	uint32_t live = ALL_FLAGS;
+	for (int32_t i = num - 1; i >= 0; i--)
+	{
+		//X is copied from C so C needs to be kept whenever X is
+		live_flags[i] = live & XA ? live | CA : live;
+		live = (live & ~m68k_run_flags_written(run + i)) | m68k_run_flags_read(run + i);
+	}
+	for (uint32_t i = 0; i < num; i++)
+	{
+		m68kinst inst = run[i];
+		opts->live_flags = live_flags[i];
+		translate_m68k(context, &inst);
+	}
+	opts->live_flags = ALL_FLAGS;
+	end_cycles_run(&opts->gen, check);
+	check_code_prologue(code);
+	code_ptr dest = get_native_address(opts, address);
+	if (!dest) {
+		opts->gen.deferred = defer_address(opts->gen.deferred, address, code->cur + 1);
+		dest = code->cur + 256;
+	}
+	jmp(code, dest);
+	map_native_address(context, first->address, start, address - first->address, code->cur - start);
+	run_fallback_stub(&opts->gen, check, first->address);
+	*first = run[num - 1];
+	return address;
+}
+
+code_ptr m68k_translate_run_fallback(m68k_context *context, uint32_t address, code_ptr stub)
+{
+	m68k_options *opts = context->options;
+	code_info *code = &opts->gen.code;
+	m68kinst run[M68K_MAX_RUN];
+	uint16_t *encoded = get_native_pointer(address, (void **)context->mem_pointers, &opts->gen);
+	uint16_t *next = m68k_decode(encoded, run, address);
+	uint32_t after;
+	uint32_t num = m68k_decode_run(context, run, address + (next-encoded)*2, &after);
+	code_ptr dest = get_native_address_trans(context, after);
+	check_code_prologue(code);
+	code_ptr start = code->cur + check_cycles_int_size(&opts->gen, address);
+	translate_m68k(context, run);
+	for (uint32_t i = 1; i < num; i++)
+	{
+		check_code_prologue(code);
+		code_ptr inst_start = code->cur;
+		translate_m68k(context, run + i);
+		map_native_address(context, run[i].address, inst_start, run[i].bytes, code->cur - inst_start);
+	}
+	jmp(code, dest);
+	m68k_handle_deferred(context);
+	patch_run_fallback(stub, start);
+	if (code_cache_update(&opts->gen)) {
+		context->should_return |= M68K_RETURN_FLUSH;
+	}
+	return start;
+}
+
 void translate_m68k_stream(uint32_t address, m68k_context * context)
 {
 	m68kinst instbuf;
@@ -1046,6 +1262,15 @@ void translate_m68k_stream(uint32_t address, m68k_context * context)
 
 			//make sure the beginning of the code for an instruction is contiguous
 			check_code_prologue(code);
+			//code that enters a run after its first instruction is translated an instruction at a time
+			//until it gets back to mapped code, the same as the fallback for the run, see backend.h
+			if (m68k_is_run_inst(context, &instbuf) && !get_instruction_start(opts, instbuf.address)) {
+				uint32_t after_run = translate_m68k_run(context, &instbuf, address);
+				if (after_run) {
+					address = after_run;
+					continue;
+				}
+			}
 			code_ptr start = code->cur;
 			translate_m68k(context, &instbuf);
 			code_ptr after = code->cur;
@@ -1056,6 +1281,10 @@ void translate_m68k_stream(uint32_t address, m68k_context * context)
 			address = opts->gen.deferred->address;
 		}
 	} while(opts->gen.deferred);
+	if (code_cache_update(&opts->gen)) {
+		//code can only be flushed once we're back in C code
+		context->should_return |= M68K_RETURN_FLUSH;
+	}
 }
 
 void * m68k_retranslate_inst(uint32_t address, m68k_context * context)
@@ -1104,6 +1333,7 @@ void * m68k_retranslate_inst(uint32_t address, m68k_context * context)
 		}*/
 
 		map_native_address(context, instbuf.address, native_start, (after-inst)*2, MAX_NATIVE_SIZE);
+		code_cache_retranslated(&opts->gen, orig_size);
 
 		jmp(&orig_code, native_start);
 		if (!m68k_is_terminal(&instbuf)) {
@@ -1120,6 +1350,9 @@ void * m68k_retranslate_inst(uint32_t address, m68k_context * context)
 			code->cur = native_start + MAX_NATIVE_SIZE;
 		}
 		m68k_handle_deferred(context);
+		if (code_cache_update(&opts->gen)) {
+			context->should_return |= M68K_RETURN_FLUSH;
+		}
 		return native_start;
 	} else {
 		code_info tmp = *code;
@@ -1145,6 +1378,28 @@ code_ptr get_native_address_trans(m68k_context * context, uint32_t address)
 	return ret;
 }
 
+//Slow path for indirect jumps, fills in the target cache entry checked by jump_m68k_indirect.
+//Native addresses stay valid until the code cache is flushed since invalidated code is
+//patched in place rather than moved
+code_ptr get_native_address_cached(m68k_context * context, uint32_t address)
+{
+	code_ptr ret = get_native_address_trans(context, address);
+	m68k_target_cache *entry = context->target_cache + ((address >> 1) & (M68K_TARGET_CACHE_SIZE - 1));
+	entry->address = address;
+	entry->native = ret;
+	return ret;
+}
+
+void m68k_clear_target_cache(m68k_context *context)
+{
+	for (uint32_t i = 0; i < M68K_TARGET_CACHE_SIZE; i++)
+	{
+		//use an address that belongs in a different slot so nothing can match
+		context->target_cache[i].address = ((i + 1) & (M68K_TARGET_CACHE_SIZE - 1)) << 1;
+		context->target_cache[i].native = NULL;
+	}
+}
+
 void remove_breakpoint(m68k_context * context, uint32_t address)
 {
 	for (uint32_t i = 0; i < context->num_breakpoints; i++)
@@ -1168,20 +1423,73 @@ void remove_breakpoint(m68k_context * context, uint32_t address)
 	context->options->gen.code = tmp;
 }
 
-void start_68k_context(m68k_context * context, uint32_t address)
+void m68k_flush_code_cache(m68k_context *context)
+{
+	m68k_options *opts = context->options;
+	code_cache *cache = &opts->gen.cache;
+	debug_message("Flushing 68K code cache: %u bytes used, %u dead, %u retranslations, flush %u\n",
+		code_cache_used(&opts->gen), cache->dead, cache->retranslations, cache->flushes + 1);
+	for (uint32_t chunk = 0; chunk < NATIVE_MAP_CHUNKS; chunk++)
+	{
+		if (opts->gen.native_code_map[chunk].base) {
+			free(opts->gen.native_code_map[chunk].offsets);
+			opts->gen.native_code_map[chunk].base = NULL;
+			opts->gen.native_code_map[chunk].offsets = NULL;
+		}
+	}
+	uint32_t ram_inst_slots = ram_size(&opts->gen) / 1024;
+	for (uint32_t i = 0; i < ram_inst_slots; i++)
+	{
+		free(opts->gen.ram_inst_sizes[i]);
+		opts->gen.ram_inst_sizes[i] = NULL;
+	}
+	memset(context->ram_code_flags, 0, ram_size(&opts->gen) / (1 << opts->gen.ram_flags_shift) / 8);
+	m68k_clear_target_cache(context);
+	code_cache_flush(&opts->gen);
+}
+
+static uint8_t m68k_can_flush(m68k_context *context)
+{
+	return context->options->gen.cache.flush_pending && !(context->status & M68K_STATUS_TRACE) && !context->trace_pending;
+}
+
+static void run_68k(m68k_context *context, code_ptr addr)
 {
-	code_ptr addr = get_native_address_trans(context, address);
 	m68k_options * options = context->options;
 	options->start_context(addr, context);
+	//returns that only happened so the code cache could be flushed are invisible to callers
+	while (context->should_return == M68K_RETURN_FLUSH)
+	{
+		if (m68k_can_flush(context)) {
+			//resume_pc points just past the prologue of the instruction at resume_address,
+			//starting that instruction from the top again just repeats a check that already passed
+			m68k_flush_code_cache(context);
+			context->resume_pc = get_native_address_trans(context, context->resume_address);
+		}
+		//clear this after translating so a budget smaller than one translation can't stop us making progress
+		context->should_return = 0;
+		addr = context->resume_pc;
+		context->resume_pc = NULL;
+		options->start_context(addr, context);
+	}
+}
+
+void start_68k_context(m68k_context * context, uint32_t address)
+{
+	run_68k(context, get_native_address_trans(context, address));
 }
 
 void resume_68k(m68k_context *context)
 {
+	if (m68k_can_flush(context)) {
+		//see run_68k
+		m68k_flush_code_cache(context);
+		context->resume_pc = get_native_address_trans(context, context->resume_address);
+	}
 	code_ptr addr = context->resume_pc;
 	context->resume_pc = NULL;
-	m68k_options * options = context->options;
 	context->should_return = 0;
-	options->start_context(addr, context);
+	run_68k(context, addr);
 }
 
 void m68k_reset(m68k_context * context)
@@ -1216,18 +1524,165 @@ void m68k_options_free(m68k_options *opts)
 		free(opts->gen.ram_inst_sizes[i]);
 	}
 	free(opts->gen.ram_inst_sizes);
+	free(opts->gen.cache.blocks);
 	free(opts->big_movem);
 	free(opts);
 }
 
 
+#define CODE_CACHE_VERSION 2
+#define CODE_CACHE_HEADER_SIZE (4 + 1 + 4 + 20 + 4)
+#define CODE_CACHE_ENTRY_SIZE 6
+static const char code_cache_magic[] = "BLJC";
+//native code is not what gets cached, but translation decisions can still change between builds.
+//The Makefile sets this to a checksum of the decoder and translator sources
+#ifndef JIT_SOURCE_HASH
+#define JIT_SOURCE_HASH 0
+#endif
+
+//only plain ROM is safe to translate ahead of time, anything banked or writable can change under us
+static uint8_t is_code_cache_chunk(memmap_chunk const *chunk)
+{
+	return chunk && chunk->buffer && (chunk->flags & MMAP_READ)
+		&& !(chunk->flags & (MMAP_WRITE | MMAP_PTR_IDX | MMAP_CODE | MMAP_ONLY_ODD | MMAP_ONLY_EVEN))
+		&& !chunk->write_16 && !chunk->write_8;
+}
+
+uint32_t m68k_load_code_cache(m68k_context *context, char *path, uint8_t *rom_hash)
+{
+	m68k_options *opts = context->options;
+	deserialize_buffer buf;
+	if (!load_from_file(&buf, path)) {
+		return 0;
+	}
+	uint32_t count = 0;
+	uint8_t valid = buf.size >= CODE_CACHE_HEADER_SIZE + sizeof(uint64_t);
+	if (valid) {
+		buf.size -= sizeof(uint64_t);
+		uint64_t check = 0;
+		for (int i = 0; i < sizeof(uint64_t); i++)
+		{
+			check = check << 8 | buf.data[buf.size + i];
+		}
+		valid = check == xxhash64(buf.data, buf.size, 0);
+	}
+	if (valid) {
+		uint8_t field[20];
+		load_buffer8(&buf, field, 4);
+		valid = !memcmp(field, code_cache_magic, 4) && load_int8(&buf) == CODE_CACHE_VERSION;
+		valid = valid && load_int32(&buf) == (uint32_t)JIT_SOURCE_HASH;
+		load_buffer8(&buf, field, 20);
+		valid = valid && !memcmp(field, rom_hash, 20);
+		count = load_int32(&buf);
+		valid = valid && (buf.size - buf.cur_pos) == (uint64_t)count * CODE_CACHE_ENTRY_SIZE;
+	}
+	uint32_t *addresses = NULL;
+	if (valid) {
+		//check every entry against the ROM before translating anything so a bad file changes nothing
+		addresses = malloc(count * sizeof(uint32_t));
+		for (uint32_t i = 0; valid && i < count; i++)
+		{
+			addresses[i] = load_int32(&buf);
+			uint16_t word = load_int16(&buf);
+			memmap_chunk const *chunk = find_map_chunk(addresses[i], &opts->gen, 0, NULL);
+			uint16_t *encoded = is_code_cache_chunk(chunk) && !(addresses[i] & 1)
+				? get_native_pointer(addresses[i], (void **)context->mem_pointers, &opts->gen)
+				: NULL;
+			valid = encoded && *encoded == word;
+		}
+	}
+	if (valid) {
+		for (uint32_t i = 0; i < count; i++)
+		{
+			translate_m68k_stream(addresses[i], context);
+		}
+		debug_message("Translated %u cached 68K instruction addresses from %s\n", count, path);
+	} else {
+		debug_message("Ignoring stale or corrupt 68K code cache %s\n", path);
+		count = 0;
+	}
+	free(addresses);
+	free(buf.data);
+	return count;
+}
+
+uint8_t m68k_save_code_cache(m68k_context *context, char *path, uint8_t *rom_hash, uint32_t min_entries)
+{
+	m68k_options *opts = context->options;
+	native_map_slot *native_code_map = opts->gen.native_code_map;
+	serialize_buffer buf;
+	init_serialize(&buf);
+	save_buffer8(&buf, (void *)code_cache_magic, 4);
+	save_int8(&buf, CODE_CACHE_VERSION);
+	save_int32(&buf, JIT_SOURCE_HASH);
+	save_buffer8(&buf, rom_hash, 20);
+	size_t count_pos = buf.size;
+	save_int32(&buf, 0);
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < opts->gen.memmap_chunks; i++)
+	{
+		memmap_chunk const *chunk = opts->gen.memmap + i;
+		if (!is_code_cache_chunk(chunk)) {
+			continue;
+		}
+		//native_code_map is only populated for the lowest alias of each address
+		uint32_t end = chunk->end - chunk->start > chunk->mask ? chunk->start + chunk->mask + 1 : chunk->end;
+		for (uint32_t address = chunk->start; address < end; address += 2)
+		{
+			uint32_t map_chunk = address / NATIVE_CHUNK_SIZE, offset = address % NATIVE_CHUNK_SIZE;
+			if (!native_code_map[map_chunk].base || native_code_map[map_chunk].offsets[offset] == INVALID_OFFSET
+				|| native_code_map[map_chunk].offsets[offset] == EXTENSION_WORD
+			) {
+				continue;
+			}
+			uint16_t *encoded = get_native_pointer(address, (void **)context->mem_pointers, &opts->gen);
+			if (!encoded) {
+				continue;
+			}
+			save_int32(&buf, address);
+			save_int16(&buf, *encoded);
+			count++;
+		}
+	}
+	uint8_t ret = 0;
+	if (count > min_entries) {
+		buf.data[count_pos] = count >> 24;
+		buf.data[count_pos + 1] = count >> 16;
+		buf.data[count_pos + 2] = count >> 8;
+		buf.data[count_pos + 3] = count;
+		uint64_t check = xxhash64(buf.data, buf.size, 0);
+		save_int32(&buf, check >> 32);
+		save_int32(&buf, check);
+		//write under a temporary name so a concurrent reader never sees a partial file
+		//every instance running the same ROM uses the same path, so the name needs to be unique
+		//to this process and context or concurrent writers could interleave their output
+		char suffix[64];
+		sprintf(suffix, ".%d.%p.tmp", (int)getpid(), (void *)context);
+		char *tmp_path = alloc_concat(path, suffix);
+		if (save_to_file(&buf, tmp_path)) {
+			remove(path);
+			ret = !rename(tmp_path, path);
+		}
+		if (!ret) {
+			remove(tmp_path);
+			warning("Failed to write 68K code cache to %s\n", path);
+		}
+		free(tmp_path);
+	}
+	free(buf.data);
+	return ret;
+}
+
 m68k_context * init_68k_context(m68k_options * opts, m68k_reset_handler reset_handler)
 {
-	m68k_context * context = calloc(1, sizeof(m68k_context) + ram_size(&opts->gen) / (1 << opts->gen.ram_flags_shift) / 8);
+	//room for the code flags and the dirty page flags if there are any
+	uint32_t pages = ram_size(&opts->gen) / (1 << opts->gen.ram_flags_shift);
+	m68k_context * context = calloc(1, sizeof(m68k_context) + pages / 8 + (opts->gen.dirty_flags_off ? pages : 0));
 	context->options = opts;
 	context->int_cycle = CYCLE_NEVER;
 	context->status = 0x27;
 	context->reset_handler = (code_ptr)reset_handler;
+	m68k_clear_target_cache(context);
 	return context;
 }
 
@@ -16,6 +16,11 @@ struct m68kinst;
 #define NATIVE_MAP_CHUNKS (64*1024)
 #define NATIVE_CHUNK_SIZE ((16 * 1024 * 1024 / NATIVE_MAP_CHUNKS))
 #define MAX_NATIVE_SIZE 255
+//limits for straight-line runs that share a single cycle limit check
+#define M68K_MAX_RUN 16
+#define M68K_MAX_RUN_BYTES 32
+//number of entries in the cache of indirect jump targets, must be a power of 2
+#define M68K_TARGET_CACHE_SIZE 256
 
 #define M68K_OPT_BROKEN_READ_MODIFY 1
 
@@ -26,6 +31,11 @@ struct m68kinst;
 
 typedef void (*start_fun)(uint8_t * addr, void * context);
 
+typedef struct {
+	uint32_t address;
+	code_ptr native;
+} m68k_target_cache;
+
 typedef struct {
 	code_ptr impl;
 	uint16_t reglist;
@@ -63,6 +73,7 @@ typedef struct {
 	movem_fun       *big_movem;
 	uint32_t        num_movem;
 	uint32_t        movem_storage;
+	uint32_t        live_flags;
 	code_word       prologue_start;
 } m68k_options;
 
@@ -88,6 +99,7 @@ struct m68k_context {
 	uint32_t        last_prefetch_address;
 	uint16_t        *mem_pointers[NUM_MEM_AREAS];
 	code_ptr        resume_pc;
+	uint32_t        resume_address; //68K address of the instruction resume_pc is in the middle of
 	code_ptr        reset_handler;
 	m68k_options    *options;
 	void            *system;
@@ -97,6 +109,7 @@ struct m68k_context {
 	uint8_t         int_pending;
 	uint8_t         trace_pending;
 	uint8_t         should_return;
+	m68k_target_cache target_cache[M68K_TARGET_CACHE_SIZE];
 	uint8_t         ram_code_flags[];
 };
 
@@ -117,6 +130,12 @@ uint32_t get_instruction_start(m68k_options *opts, uint32_t address);
 uint16_t m68k_get_ir(m68k_context *context);
 void m68k_print_regs(m68k_context * context);
 void m68k_invalidate_code_range(m68k_context *context, uint32_t start, uint32_t end);
+void m68k_flush_code_cache(m68k_context *context);
+void m68k_clear_target_cache(m68k_context *context);
+//persists the addresses of translated ROM instructions so a later run can translate them up front.
+//Native code is not saved, so loading still pays for translation, just before the first frame instead of during play
+uint32_t m68k_load_code_cache(m68k_context *context, char *path, uint8_t *rom_hash);
+uint8_t m68k_save_code_cache(m68k_context *context, char *path, uint8_t *rom_hash, uint32_t min_entries);
 void m68k_serialize(m68k_context *context, uint32_t pc, serialize_buffer *buf);
 void m68k_deserialize(deserialize_buffer *buf, void *vcontext);
 
@@ -108,6 +108,8 @@ void flag_to_flag(m68k_options *opts, uint8_t flag1, uint8_t flag2)
 void update_flags(m68k_options *opts, uint32_t update_mask)
 {
 	uint8_t native_flags[] = {0, CC_S, CC_Z, CC_O, CC_C};
+	//skip flags that will be overwritten before anything can observe them
+	update_mask &= opts->live_flags;
 	for (int8_t flag = FLAG_C; flag >= FLAG_X; --flag)
 	{
 		if (update_mask & X0 << (flag*3)) {
@@ -350,8 +352,33 @@ void calc_areg_index_disp8(m68k_options *opts, m68k_op_info *op, uint8_t native_
 	calc_index_disp8(opts, op, native_reg);
 }
 
+//jumps to the 68K address in scratch1, checking the target cache inline before
+//falling back to the native_addr stub
+void jump_m68k_indirect(m68k_options *opts)
+{
+	code_info *code = &opts->gen.code;
+	check_alloc_code(code, 10*MAX_INST_LEN);
+	//entries are indexed by address / 2
+	uint32_t shift = sizeof(m68k_target_cache) == 16 ? 3 : 2;
+	mov_rr(code, opts->gen.scratch1, opts->gen.scratch2, SZ_D);
+	shl_ir(code, shift, opts->gen.scratch2, SZ_D);
+	and_ir(code, (M68K_TARGET_CACHE_SIZE - 1) * sizeof(m68k_target_cache), opts->gen.scratch2, SZ_D);
+	add_rr(code, opts->gen.context_reg, opts->gen.scratch2, SZ_PTR);
+	cmp_rdispr(code, opts->gen.scratch2, offsetof(m68k_context, target_cache), opts->gen.scratch1, SZ_D);
+	code_ptr miss = code->cur + 1;
+	jcc(code, CC_NZ, code->cur + 2);
+	mov_rdispr(code, opts->gen.scratch2, offsetof(m68k_context, target_cache) + offsetof(m68k_target_cache, native), opts->gen.scratch1, SZ_PTR);
+	jmp_r(code, opts->gen.scratch1);
+	*miss = code->cur - (miss + 1);
+	call(code, opts->native_addr);
+	jmp_r(code, opts->gen.scratch1);
+}
+
 void m68k_check_cycles_int_latch(m68k_options *opts)
 {
+	if (run_covers_check(&opts->gen)) {
+		return;
+	}
 	code_info *code = &opts->gen.code;
 	check_alloc_code(code, 3*MAX_INST_LEN);
 	uint8_t cc;
@@ -368,6 +395,102 @@ void m68k_check_cycles_int_latch(m68k_options *opts)
 	*jmp_off = code->cur - (jmp_off+1);
 }
 
+//instructions in RAM need to fit in MAX_NATIVE_SIZE when they get retranslated
+//so they keep using the smaller helper calls
+static uint8_t m68k_can_inline_mem(m68k_options *opts, m68kinst *inst)
+{
+	memmap_chunk const *chunk = find_map_chunk(inst->address, &opts->gen, 0, NULL);
+	return chunk && !(chunk->flags & MMAP_CODE);
+}
+
+//reads from a fixed address, inline if it maps straight to a buffer
+//only absolute and PC relative operands get here. Address register operands always
+//use the helpers since translated code can be entered at any instruction (return
+//from an interrupt, jump through a table), so a register value seen earlier in the
+//same block can't be relied on
+void m68k_read_size_at(m68k_options *opts, m68kinst *inst, uint32_t address)
+{
+	code_info *code = &opts->gen.code;
+	uint8_t size = inst->extra.size;
+	if (!m68k_can_inline_mem(opts, inst)) {
+		size = OPSIZE_INVALID;
+	}
+	switch (size)
+	{
+	case OPSIZE_BYTE:
+		if (gen_mem_direct(&opts->gen, READ_8, address)) {
+			return;
+		}
+		break;
+	case OPSIZE_WORD:
+		if (gen_mem_direct(&opts->gen, READ_16, address)) {
+			return;
+		}
+		break;
+	case OPSIZE_LONG:
+		if (!(address & opts->gen.align_error_mask) && !opts->gen.in_run
+			&& find_direct_chunk(address, &opts->gen, 0, NULL) && find_direct_chunk(address + 2, &opts->gen, 0, NULL)
+		) {
+			//same two word accesses as read_32
+			push_r(code, opts->gen.scratch2);
+			gen_mem_direct(&opts->gen, READ_16, address);
+			shl_ir(code, 16, opts->gen.scratch1, SZ_D);
+			mov_rr(code, opts->gen.scratch1, opts->gen.scratch2, SZ_D);
+			gen_mem_direct(&opts->gen, READ_16, address + 2);
+			movzx_rr(code, opts->gen.scratch1, opts->gen.scratch1, SZ_W, SZ_D);
+			or_rr(code, opts->gen.scratch2, opts->gen.scratch1, SZ_D);
+			pop_r(code, opts->gen.scratch2);
+			return;
+		}
+		break;
+	}
+	mov_ir(code, address, opts->gen.scratch1, SZ_D);
+	m68k_read_size(opts, inst->extra.size);
+}
+
+//writes scratch1 to a fixed address, inline if it maps straight to a buffer
+//scratch2 must already hold the address in case the regular helpers are needed
+void m68k_write_size_at(m68k_options *opts, m68kinst *inst, uint8_t lowfirst, uint32_t address)
+{
+	code_info *code = &opts->gen.code;
+	uint8_t size = inst->extra.size;
+	if (!m68k_can_inline_mem(opts, inst)) {
+		size = OPSIZE_INVALID;
+	}
+	switch (size)
+	{
+	case OPSIZE_BYTE:
+		if (gen_mem_direct(&opts->gen, WRITE_8, address)) {
+			return;
+		}
+		break;
+	case OPSIZE_WORD:
+		if (gen_mem_direct(&opts->gen, WRITE_16, address)) {
+			return;
+		}
+		break;
+	case OPSIZE_LONG:
+		if (!(address & opts->gen.align_error_mask) && !opts->gen.in_run
+			&& find_direct_chunk(address, &opts->gen, 1, NULL) && find_direct_chunk(address + 2, &opts->gen, 1, NULL)
+		) {
+			//same two word accesses, in the same order, as write_32_lowfirst/write_32_highfirst
+			if (lowfirst) {
+				gen_mem_direct(&opts->gen, WRITE_16, address + 2);
+				shr_ir(code, 16, opts->gen.scratch1, SZ_D);
+				gen_mem_direct(&opts->gen, WRITE_16, address);
+			} else {
+				rol_ir(code, 16, opts->gen.scratch1, SZ_D);
+				gen_mem_direct(&opts->gen, WRITE_16, address);
+				rol_ir(code, 16, opts->gen.scratch1, SZ_D);
+				gen_mem_direct(&opts->gen, WRITE_16, address + 2);
+			}
+			return;
+		}
+		break;
+	}
+	m68k_write_size(opts, inst->extra.size, lowfirst);
+}
+
 uint8_t translate_m68k_op(m68kinst * inst, host_ea * ea, m68k_options * opts, uint8_t dst)
 {
 	code_info *code = &opts->gen.code;
@@ -481,13 +604,9 @@ uint8_t translate_m68k_op(m68kinst * inst, host_ea * ea, m68k_options * opts, ui
 		break;
 	case MODE_PC_DISPLACE:
 		cycles(&opts->gen, BUS);
-		mov_ir(code, op->params.regs.displacement + inst->address+2, opts->gen.scratch1, SZ_D);
-		if (dst) {
-			push_r(code, opts->gen.scratch1);
-		}
-		m68k_read_size(opts, inst->extra.size);
+		m68k_read_size_at(opts, inst, op->params.regs.displacement + inst->address+2);
 		if (dst) {
-			pop_r(code, opts->gen.scratch2);
+			mov_ir(code, op->params.regs.displacement + inst->address+2, opts->gen.scratch2, SZ_D);
 		}
 
 		ea->mode = MODE_REG_DIRECT;
@@ -511,13 +630,9 @@ uint8_t translate_m68k_op(m68kinst * inst, host_ea * ea, m68k_options * opts, ui
 	case MODE_ABSOLUTE:
 	case MODE_ABSOLUTE_SHORT:
 		cycles(&opts->gen, op->addr_mode == MODE_ABSOLUTE ? BUS*2 : BUS);
-		mov_ir(code, op->params.immed, opts->gen.scratch1, SZ_D);
+		m68k_read_size_at(opts, inst, op->params.immed);
 		if (dst) {
-			push_r(code, opts->gen.scratch1);
-		}
-		m68k_read_size(opts, inst->extra.size);
-		if (dst) {
-			pop_r(code, opts->gen.scratch2);
+			mov_ir(code, op->params.immed, opts->gen.scratch2, SZ_D);
 		}
 
 		ea->mode = MODE_REG_DIRECT;
@@ -733,7 +848,11 @@ void translate_m68k_move(m68k_options * opts, m68kinst * inst)
 			//and then backing out that extra increment here before the write happens
 			cycles(&opts->gen, -BUS);
 		}
-		m68k_write_size(opts, inst->extra.size, inst->dst.addr_mode == MODE_AREG_PREDEC);
+		if (inst->dst.addr_mode == MODE_ABSOLUTE || inst->dst.addr_mode == MODE_ABSOLUTE_SHORT) {
+			m68k_write_size_at(opts, inst, 0, inst->dst.params.immed);
+		} else {
+			m68k_write_size(opts, inst->extra.size, inst->dst.addr_mode == MODE_AREG_PREDEC);
+		}
 		if (inst->dst.addr_mode == MODE_AREG_POSTINC) {
 			inc_amount = inst->extra.size == OPSIZE_WORD ? 2 : (inst->extra.size == OPSIZE_LONG ? 4 : (inst->dst.params.regs.pri == 7 ? 2 : 1));
 			addi_areg(opts, inc_amount, inst->dst.params.regs.pri);
@@ -2489,13 +2608,12 @@ void nop_fill_or_jmp_next(code_info *code, code_ptr old_end, code_ptr next_inst)
 	}
 }
 
-#define M68K_MAX_INST_SIZE (2*(1+2+2))
-
 m68k_context * m68k_handle_code_write(uint32_t address, m68k_context * context)
 {
 	m68k_options * options = context->options;
 	uint32_t inst_start = get_instruction_start(options, address);
-	while (inst_start && (address - inst_start) < M68K_MAX_INST_SIZE) {
+	//the instruction might be part of a run that started before it
+	while (inst_start && (address - inst_start) < M68K_MAX_RUN_BYTES) {
 		code_ptr dst = get_native_address(context->options, inst_start);
 		patch_for_retranslate(&options->gen, dst, options->retrans_stub);
 		inst_start = get_instruction_start(options, inst_start - 2);
@@ -2517,6 +2635,8 @@ void m68k_invalidate_code_range(m68k_context *context, uint32_t start, uint32_t
 		//calculate the lowest alias for this address
 		end = mem_chunk->start + ((end - mem_chunk->start) & mem_chunk->mask);
 	}
+	//runs that start before the range can include instructions inside it
+	start = start > M68K_MAX_RUN_BYTES ? start - M68K_MAX_RUN_BYTES : 0;
 	uint32_t start_chunk = start / NATIVE_CHUNK_SIZE, end_chunk = end / NATIVE_CHUNK_SIZE;
 	for (uint32_t chunk = start_chunk; chunk <= end_chunk; chunk++)
 	{
@@ -2576,6 +2696,11 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 	opts->gen.mem_ptr_off = offsetof(m68k_context, mem_pointers);
 	opts->gen.ram_flags_off = offsetof(m68k_context, ram_code_flags);
 	opts->gen.ram_flags_shift = 11;
+	//dirty page flags follow the code flags at the end of the context when anything asks for them
+	if (tracks_dirty_pages(&opts->gen)) {
+		opts->gen.dirty_flags_off = ram_size(&opts->gen) / (1 << opts->gen.ram_flags_shift) / 8;
+	}
+	opts->live_flags = ALL_FLAGS;
 	for (int i = 0; i < 8; i++)
 	{
 		opts->dregs[i] = opts->aregs[i] = -1;
@@ -2684,12 +2809,24 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 	opts->native_addr = code->cur;
 	call(code, opts->gen.save_context);
 	push_r(code, opts->gen.context_reg);
-	call_args(code, (code_ptr)get_native_address_trans, 2, opts->gen.context_reg, opts->gen.scratch1);
+	call_args(code, (code_ptr)get_native_address_cached, 2, opts->gen.context_reg, opts->gen.scratch1);
 	mov_rr(code, RAX, opts->gen.scratch1, SZ_PTR); //move result to scratch reg
 	pop_r(code, opts->gen.context_reg);
 	call(code, opts->gen.load_context);
 	retn(code);
 
+	opts->gen.run_fallback = code->cur;
+	call(code, opts->gen.save_context);
+	push_r(code, opts->gen.context_reg);
+	//scratch2 is in the register for the first argument and call_args loses track of it
+	//while moving the other arguments into place
+	mov_rr(code, opts->gen.scratch2, RAX, SZ_PTR);
+	call_args(code, (code_ptr)m68k_translate_run_fallback, 3, opts->gen.context_reg, opts->gen.scratch1, RAX);
+	mov_rr(code, RAX, opts->gen.scratch1, SZ_PTR);
+	pop_r(code, opts->gen.context_reg);
+	call(code, opts->gen.load_context);
+	retn(code);
+
 	opts->native_addr_and_sync = code->cur;
 	call(code, opts->gen.save_context);
 	push_r(code, opts->gen.scratch1);
@@ -2991,6 +3128,8 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 	retn(code);
 	*do_ret = code->cur - (do_ret+1);
 	uint32_t tmp_stack_off = code->stack_off;
+	//remember which instruction we stopped at so the code cache can be flushed before resuming
+	mov_rrdisp(code, opts->gen.scratch1, opts->gen.context_reg, offsetof(m68k_context, resume_address), SZ_D);
 	//fetch return address and adjust RSP
 	pop_r(code, opts->gen.scratch1);
 	add_ir(code, 16-sizeof(void *), RSP, SZ_PTR);
@@ -3226,4 +3365,5 @@ void init_m68k_opts(m68k_options * opts, memmap_chunk * memmap, uint32_t num_chu
 	code->stack_off = tmp_stack_off;
 	
 	retranslate_calc(&opts->gen);
+	code_cache_init(&opts->gen);
 }
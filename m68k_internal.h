@@ -28,6 +28,7 @@ void subi_areg(m68k_options *opts, int32_t val, uint8_t reg);
 void add_areg_native(m68k_options *opts, uint8_t reg, uint8_t native_reg);
 void add_dreg_native(m68k_options *opts, uint8_t reg, uint8_t native_reg);
 void calc_areg_displace(m68k_options *opts, m68k_op_info *op, uint8_t native_reg);
+void jump_m68k_indirect(m68k_options *opts);
 void calc_index_disp8(m68k_options *opts, m68k_op_info *op, uint8_t native_reg);
 void calc_areg_index_disp8(m68k_options *opts, m68k_op_info *op, uint8_t native_reg);
 void nop_fill_or_jmp_next(code_info *code, code_ptr old_end, code_ptr next_inst);
@@ -38,6 +39,8 @@ void m68k_trap_if_not_supervisor(m68k_options *opts, m68kinst *inst);
 void m68k_breakpoint_patch(m68k_context *context, uint32_t address, m68k_debug_handler bp_handler, code_ptr native_addr);
 void m68k_check_cycles_int_latch(m68k_options *opts);
 uint8_t translate_m68k_op(m68kinst * inst, host_ea * ea, m68k_options * opts, uint8_t dst);
+void m68k_read_size_at(m68k_options *opts, m68kinst *inst, uint32_t address);
+void m68k_write_size_at(m68k_options *opts, m68kinst *inst, uint8_t lowfirst, uint32_t address);
 
 //functions implemented in m68k_core.c
 int8_t native_reg(m68k_op_info * op, m68k_options * opts);
@@ -52,6 +55,8 @@ void swap_ssp_usp(m68k_options * opts);
 code_ptr get_native_address(m68k_options *opts, uint32_t address);
 uint8_t m68k_is_terminal(m68kinst * inst);
 code_ptr get_native_address_trans(m68k_context * context, uint32_t address);
+code_ptr get_native_address_cached(m68k_context * context, uint32_t address);
+code_ptr m68k_translate_run_fallback(m68k_context *context, uint32_t address, code_ptr stub);
 void * m68k_retranslate_inst(uint32_t address, m68k_context * context);
 m68k_context *m68k_bp_dispatcher(m68k_context *context, uint32_t address);
 
@@ -101,6 +106,13 @@ void translate_m68k_reset(m68k_options *opts, m68kinst *inst);
 #define C0  0x1000
 #define C1  0x2000
 #define C   0x4000
+//all of the update bits for a flag
+#define XA  (X0|X1|X)
+#define NA  (N0|N1|N)
+#define ZA  (Z0|Z1|Z)
+#define VA  (V0|V1|V)
+#define CA  (C0|C1|C)
+#define ALL_FLAGS (XA|NA|ZA|VA|CA)
 
 #define BUS 4
 #define PREDEC_PENALTY 2
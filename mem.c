@@ -25,7 +25,8 @@ void * alloc_code(size_t *size)
 {
 	//start at the 1GB mark to allow plenty of room for sbrk based malloc implementations
 	//while still keeping well within 32-bit displacement range for calling code compiled into the executable
-	static uint8_t *next = (uint8_t *)0x40000000;
+	//the hint is per thread so batch workers allocating at the same time don't race on it
+	static __thread uint8_t *next = (uint8_t *)0x40000000;
 	uint8_t *ret = try_alloc_arena();
 	if (ret) {
 		return ret;
@@ -18,6 +18,8 @@ typedef enum {
 #define MMAP_BYTESWAP  0x80
 #define MMAP_AUX_BUFF  0x100
 #define MMAP_READ_CODE 0x200
+//writes to a MMAP_CODE | MMAP_WRITE chunk with this set are recorded in the dirty page flags
+#define MMAP_DIRTY_PAGES 0x400
 
 typedef uint16_t (*read_16_fun)(uint32_t address, void * context);
 typedef uint8_t (*read_8_fun)(uint32_t address, void * context);
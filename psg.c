@@ -87,9 +87,66 @@ static int16_t volume_table[16] = {
 	2067/PSG_VOL_DIV, 1642/PSG_VOL_DIV, 1304/PSG_VOL_DIV, 0
 };
 
+static int16_t psg_accum(psg_context *context)
+{
+	int16_t accum = 0;
+	
+	for (int i = 0; i < 3; i++) {
+		if (context->output_state[i]) {
+			accum += volume_table[context->volume[i]];
+		}
+	}
+	if (context->noise_out) {
+		accum += volume_table[context->volume[3]];
+	}
+	return accum;
+}
+
+static void psg_flush_samples(psg_context *context)
+{
+	render_put_mono_block(context->audio, context->sample_buffer, context->buffered_samples);
+	context->buffered_samples = 0;
+}
+
+static void psg_output(psg_context *context, int16_t value, uint32_t count)
+{
+	while (count)
+	{
+		uint32_t space = PSG_SAMPLE_BUFFER - context->buffered_samples;
+		uint32_t n = count < space ? count : space;
+		for (int16_t *dst = context->sample_buffer + context->buffered_samples, *end = dst + n; dst < end; dst++)
+		{
+			*dst = value;
+		}
+		context->buffered_samples += n;
+		count -= n;
+		if (context->buffered_samples == PSG_SAMPLE_BUFFER) {
+			psg_flush_samples(context);
+		}
+	}
+}
+
 void psg_run(psg_context * context, uint32_t cycles)
 {
 	while (context->cycles < cycles) {
+		//figure out how many ticks we can run before a counter reaches zero
+		uint32_t run = (cycles - context->cycles + context->clock_inc - 1) / context->clock_inc;
+		for (int i = 0; i < 4; i++) {
+			uint32_t until_flip = context->counters[i] ? context->counters[i] : 1;
+			if (until_flip < run) {
+				run = until_flip;
+			}
+		}
+		if (run > 1) {
+			//nothing changes state until the last tick of the run, so the output is constant
+			run--;
+			for (int i = 0; i < 4; i++) {
+				context->counters[i] -= run;
+			}
+			psg_output(context, psg_accum(context), run);
+			context->cycles += run * context->clock_inc;
+		}
+		
 		for (int i = 0; i < 4; i++) {
 			if (context->counters[i]) {
 				context->counters[i] -= 1;
@@ -110,21 +167,13 @@ void psg_run(psg_context * context, uint32_t cycles)
 			}
 		}
 
-		int16_t accum = 0;
-		
-		for (int i = 0; i < 3; i++) {
-			if (context->output_state[i]) {
-				accum += volume_table[context->volume[i]];
-			}
-		}
-		if (context->noise_out) {
-			accum += volume_table[context->volume[3]];
-		}
-		
-		render_put_mono_sample(context->audio, accum);
+		psg_output(context, psg_accum(context), 1);
 
 		context->cycles += context->clock_inc;
 	}
+	if (context->buffered_samples) {
+		psg_flush_samples(context);
+	}
 }
 
 void psg_vgm_log(psg_context *context, uint32_t master_clock, vgm_writer *vgm)
@@ -11,6 +11,8 @@
 #include "render_audio.h"
 #include "vgm.h"
 
+#define PSG_SAMPLE_BUFFER 256
+
 typedef struct {
 	audio_source *audio;
 	vgm_writer   *vgm;
@@ -25,6 +27,9 @@ typedef struct {
 	uint8_t  noise_use_tone;
 	uint8_t  noise_type;
 	uint8_t  latch;
+	uint32_t buffered_samples;
+	//output samples waiting to be handed to the resampler
+	int16_t  sample_buffer[PSG_SAMPLE_BUFFER];
 } psg_context;
 
 
@@ -6,23 +6,128 @@
 #include "util.h"
 #include "config.h"
 #include "blastem.h"
+#include "hash.h"
 
-static uint8_t output_channels;
-static uint32_t buffer_samples, sample_rate;
+typedef void (*conv_func)(float *samples, void *vstream, int sample_count);
 
-static audio_source *audio_sources[8];
-static audio_source *inactive_audio_sources[8];
-static uint8_t num_audio_sources;
-static uint8_t num_inactive_audio_sources;
+//output device settings from render_audio_initialized
+typedef struct {
+	conv_func convert;
+	float     gain_mult;
+	int       sample_size;
+	uint32_t  buffer_samples;
+	uint32_t  sample_rate;
+	uint32_t  sync_samples;
+	uint8_t   channels;
+	uint8_t   need_mix_buf;
+	uint8_t   audio_sync;
+} audio_output;
 
-static float overall_gain_mult, *mix_buf;
-static int sample_size;
+struct audio_mixer {
+	audio_source *sources[8];
+	audio_source *inactive_sources[8];
+	float        *mix_buf;
+	audio_output output;
+	uint32_t     mix_buf_size;
+	uint8_t      num_sources;
+	uint8_t      num_inactive_sources;
+	uint8_t      hash_audio;
+};
 
-typedef void (*conv_func)(float *samples, void *vstream, int sample_count);
+//used by any thread that has not been given a mixer of its own
+static audio_mixer default_mixer;
+static __thread audio_mixer *thread_mixer;
+
+static audio_mixer *get_mixer(void)
+{
+	return thread_mixer ? thread_mixer : &default_mixer;
+}
+
+audio_mixer *render_new_audio_mixer(void)
+{
+	audio_mixer *mixer = calloc(1, sizeof(audio_mixer));
+	//start out with the same output settings as the calling thread's mixer
+	mixer->output = get_mixer()->output;
+	return mixer;
+}
+
+audio_mixer *render_set_audio_mixer(audio_mixer *mixer)
+{
+	audio_mixer *old = thread_mixer;
+	thread_mixer = mixer;
+	return old;
+}
+
+//samples are hashed in fixed size blocks so the result doesn't depend on how often a source is run
+#define HASH_BLOCK_SAMPLES 256
+
+static void set_source_hashing(audio_source *src, uint8_t enabled)
+{
+	if (enabled && !src->hash_buf) {
+		src->hash_buf = malloc(HASH_BLOCK_SAMPLES * sizeof(int16_t));
+	} else if (!enabled) {
+		free(src->hash_buf);
+		src->hash_buf = NULL;
+	}
+	src->hash = 0;
+	src->hash_count = 0;
+}
+
+void render_set_audio_hashing(uint8_t enabled)
+{
+	audio_mixer *mixer = get_mixer();
+	mixer->hash_audio = enabled;
+	for (uint8_t i = 0; i < mixer->num_sources; i++)
+	{
+		set_source_hashing(mixer->sources[i], enabled);
+	}
+	for (uint8_t i = 0; i < mixer->num_inactive_sources; i++)
+	{
+		set_source_hashing(mixer->inactive_sources[i], enabled);
+	}
+}
+
+static void hash_sample(audio_source *src, int16_t sample)
+{
+	src->hash_buf[src->hash_count++] = sample;
+	if (src->hash_count == HASH_BLOCK_SAMPLES) {
+		src->hash = xxhash64(src->hash_buf, HASH_BLOCK_SAMPLES * sizeof(int16_t), src->hash);
+		src->hash_count = 0;
+	}
+}
+
+uint64_t render_take_audio_hash(void)
+{
+	audio_mixer *mixer = get_mixer();
+	uint64_t ret = 0;
+	for (uint8_t i = 0; i < mixer->num_sources; i++)
+	{
+		audio_source *src = mixer->sources[i];
+		if (!src->hash_buf) {
+			continue;
+		}
+		if (src->hash_count) {
+			src->hash = xxhash64(src->hash_buf, src->hash_count * sizeof(int16_t), src->hash);
+		}
+		ret = xxhash64(&src->hash, sizeof(src->hash), ret);
+		src->hash = 0;
+		src->hash_count = 0;
+	}
+	return ret;
+}
+
+void render_free_audio_mixer(audio_mixer *mixer)
+{
+	if (thread_mixer == mixer) {
+		thread_mixer = NULL;
+	}
+	free(mixer->mix_buf);
+	free(mixer);
+}
 
 static void convert_null(float *samples, void *vstream, int sample_count)
 {
-	memset(vstream, 0, sample_count * sample_size);
+	memset(vstream, 0, sample_count * get_mixer()->output.sample_size);
 }
 
 static void convert_s16(float *samples, void *vstream, int sample_count)
@@ -64,8 +169,9 @@ static int32_t mix_f32(audio_source *audio, float *stream, int samples)
 	uint32_t i = audio->read_start;
 	uint32_t i_end = audio->read_end;
 	float *cur = stream;
-	float gain_mult = audio->gain_mult * overall_gain_mult;
-	size_t first_add = output_channels > 1 ? 1 : 0, second_add = output_channels > 1 ? output_channels - 1 : 1;
+	audio_output *output = &audio->mixer->output;
+	float gain_mult = audio->gain_mult * output->gain_mult;
+	size_t first_add = output->channels > 1 ? 1 : 0, second_add = output->channels > 1 ? output->channels - 1 : 1;
 	if (audio->num_channels == 1) {
 		while (cur < end && i != i_end)
 		{
@@ -96,26 +202,32 @@ static int32_t mix_f32(audio_source *audio, float *stream, int samples)
 	}
 }
 
-static conv_func convert;
-
-
 int mix_and_convert(unsigned char *byte_stream, int len, int *min_remaining_out)
 {
-	int samples = len / sample_size;
-	float *mix_dest = mix_buf ? mix_buf : (float *)byte_stream;
+	audio_mixer *mixer = get_mixer();
+	int samples = len / mixer->output.sample_size;
+	float *mix_dest = (float *)byte_stream;
+	if (mixer->output.need_mix_buf) {
+		if (mixer->mix_buf_size < samples) {
+			mixer->mix_buf = realloc(mixer->mix_buf, samples * sizeof(float));
+			mixer->mix_buf_size = samples;
+		}
+		mix_dest = mixer->mix_buf;
+	}
 	memset(mix_dest, 0, samples * sizeof(float));
 	int min_buffered = INT_MAX;
 	int min_remaining_buffer = INT_MAX;
-	for (uint8_t i = 0; i < num_audio_sources; i++)
+	for (uint8_t i = 0; i < mixer->num_sources; i++)
 	{
-		int buffered = mix_f32(audio_sources[i], mix_dest, samples);
-		int remaining = (audio_sources[i]->mask + 1) / audio_sources[i]->num_channels - buffered;
+		audio_source *src = mixer->sources[i];
+		int buffered = mix_f32(src, mix_dest, samples);
+		int remaining = (src->mask + 1) / src->num_channels - buffered;
 		min_buffered = buffered < min_buffered ? buffered : min_buffered;
 		min_remaining_buffer = remaining < min_remaining_buffer ? remaining : min_remaining_buffer;
-		audio_sources[i]->front_populated = 0;
-		render_buffer_consumed(audio_sources[i]);
+		src->front_populated = 0;
+		render_buffer_consumed(src);
 	}
-	convert(mix_dest, byte_stream, samples);
+	mixer->output.convert(mix_dest, byte_stream, samples);
 	if (min_remaining_out) {
 		*min_remaining_out = min_remaining_buffer;
 	}
@@ -124,45 +236,52 @@ int mix_and_convert(unsigned char *byte_stream, int len, int *min_remaining_out)
 
 uint8_t all_sources_ready(void)
 {
+	audio_mixer *mixer = get_mixer();
 	uint8_t num_populated = 0;
-	num_populated = 0;
-	for (uint8_t i = 0; i < num_audio_sources; i++)
+	for (uint8_t i = 0; i < mixer->num_sources; i++)
 	{
-		if (audio_sources[i]->front_populated) {
+		if (mixer->sources[i]->front_populated) {
 			num_populated++;
 		}
 	}
-	return num_populated == num_audio_sources;
+	return num_populated == mixer->num_sources;
 }
 
 #define BUFFER_INC_RES 0x40000000UL
 
 void render_audio_adjust_clock(audio_source *src, uint64_t master_clock, uint64_t sample_divider)
 {
-	src->buffer_inc = ((BUFFER_INC_RES * (uint64_t)sample_rate) / master_clock) * sample_divider;
+	src->buffer_inc = ((BUFFER_INC_RES * (uint64_t)src->mixer->output.sample_rate) / master_clock) * sample_divider;
+	src->buffer_inc_recip = 1.0 / src->buffer_inc;
 }
 
 void render_audio_adjust_speed(float adjust_ratio)
 {
-	for (uint8_t i = 0; i < num_audio_sources; i++)
+	audio_mixer *mixer = get_mixer();
+	for (uint8_t i = 0; i < mixer->num_sources; i++)
 	{
-		audio_sources[i]->buffer_inc = ((double)audio_sources[i]->buffer_inc) + ((double)audio_sources[i]->buffer_inc) * adjust_ratio + 0.5;
+		audio_source *src = mixer->sources[i];
+		src->buffer_inc = ((double)src->buffer_inc) + ((double)src->buffer_inc) * adjust_ratio + 0.5;
+		src->buffer_inc_recip = 1.0 / src->buffer_inc;
 	}
 }
 
 audio_source *render_audio_source(uint64_t master_clock, uint64_t sample_divider, uint8_t channels)
 {
 	audio_source *ret = NULL;
-	uint32_t alloc_size = render_is_audio_sync() ? channels * buffer_samples : nearest_pow2(render_min_buffered() * 4 * channels);
+	audio_mixer *mixer = get_mixer();
+	uint32_t alloc_size = render_is_audio_sync() ? channels * mixer->output.buffer_samples : nearest_pow2(render_min_buffered() * 4 * channels);
 	render_lock_audio();
-		if (num_audio_sources < 8) {
+		if (mixer->num_sources < 8) {
 			ret = calloc(1, sizeof(audio_source));
 			ret->back = malloc(alloc_size * sizeof(int16_t));
 			ret->front = render_is_audio_sync() ? malloc(alloc_size * sizeof(int16_t)) : ret->back;
 			ret->front_populated = 0;
 			ret->opaque = render_new_audio_opaque();
 			ret->num_channels = channels;
-			audio_sources[num_audio_sources++] = ret;
+			ret->mixer = mixer;
+			set_source_hashing(ret, mixer->hash_audio);
+			mixer->sources[mixer->num_sources++] = ret;
 		}
 	render_unlock_audio();
 	if (!ret) {
@@ -178,7 +297,7 @@ audio_source *render_audio_source(uint64_t master_clock, uint64_t sample_divider
 		ret->buffer_fraction = 0;
 		ret->last_left = ret->last_right = 0;
 		ret->read_start = 0;
-		ret->read_end = render_is_audio_sync() ? buffer_samples * channels : 0;
+		ret->read_end = render_is_audio_sync() ? mixer->output.buffer_samples * channels : 0;
 		ret->mask = render_is_audio_sync() ? 0xFFFFFFFF : alloc_size-1;
 		ret->gain_mult = 1.0f;
 	}
@@ -198,16 +317,22 @@ void render_audio_source_gaindb(audio_source *src, float gain)
 	src->gain_mult = db_to_mult(gain);
 }
 
+void render_audio_source_discard(audio_source *src, uint8_t discard)
+{
+	src->discard = discard;
+}
+
 void render_pause_source(audio_source *src)
 {
 	uint8_t found = 0, remaining_sources;
+	audio_mixer *mixer = src->mixer;
 	render_lock_audio();
-		for (uint8_t i = 0; i < num_audio_sources; i++)
+		for (uint8_t i = 0; i < mixer->num_sources; i++)
 		{
-			if (audio_sources[i] == src) {
-				audio_sources[i] = audio_sources[--num_audio_sources];
+			if (mixer->sources[i] == src) {
+				mixer->sources[i] = mixer->sources[--mixer->num_sources];
 				found = 1;
-				remaining_sources = num_audio_sources;
+				remaining_sources = mixer->num_sources;
 				break;
 			}
 		}
@@ -216,20 +341,21 @@ void render_pause_source(audio_source *src)
 	if (found) {
 		render_source_paused(src, remaining_sources);
 	}
-	inactive_audio_sources[num_inactive_audio_sources++] = src;
+	mixer->inactive_sources[mixer->num_inactive_sources++] = src;
 }
 
 void render_resume_source(audio_source *src)
 {
+	audio_mixer *mixer = src->mixer;
 	render_lock_audio();
-		if (num_audio_sources < 8) {
-			audio_sources[num_audio_sources++] = src;
+		if (mixer->num_sources < 8) {
+			mixer->sources[mixer->num_sources++] = src;
 		}
 	render_unlock_audio();
-	for (uint8_t i = 0; i < num_inactive_audio_sources; i++)
+	for (uint8_t i = 0; i < mixer->num_inactive_sources; i++)
 	{
-		if (inactive_audio_sources[i] == src) {
-			inactive_audio_sources[i] = inactive_audio_sources[--num_inactive_audio_sources];
+		if (mixer->inactive_sources[i] == src) {
+			mixer->inactive_sources[i] = mixer->inactive_sources[--mixer->num_inactive_sources];
 		}
 	}
 	render_source_resumed(src);
@@ -238,17 +364,18 @@ void render_resume_source(audio_source *src)
 void render_free_source(audio_source *src)
 {
 	uint8_t found = 0;
-	for (uint8_t i = 0; i < num_inactive_audio_sources; i++)
+	audio_mixer *mixer = src->mixer;
+	for (uint8_t i = 0; i < mixer->num_inactive_sources; i++)
 	{
-		if (inactive_audio_sources[i] == src) {
-			inactive_audio_sources[i] = inactive_audio_sources[--num_inactive_audio_sources];
+		if (mixer->inactive_sources[i] == src) {
+			mixer->inactive_sources[i] = mixer->inactive_sources[--mixer->num_inactive_sources];
 			found = 1;
 			break;
 		}
 	}
 	if (!found) {
 		render_pause_source(src);
-		num_inactive_audio_sources--;
+		mixer->num_inactive_sources--;
 	}
 	
 	free(src->front);
@@ -256,6 +383,7 @@ void render_free_source(audio_source *src)
 		free(src->back);
 		render_free_audio_opaque(src->opaque);
 	}
+	free(src->hash_buf);
 	free(src);
 }
 
@@ -266,16 +394,38 @@ static int16_t lowpass_sample(audio_source *src, int16_t last, int16_t current)
 	return current;
 }
 
+//Computes (buffer_fraction << 16) / buffer_inc with a multiply by the precomputed reciprocal.
+//The numerator is well under 2^53, so the estimate is off by at most one; the fixup makes the
+//result identical to the integer division
+static int64_t interp_weight(audio_source *src)
+{
+	uint64_t num = src->buffer_fraction << 16;
+	uint64_t weight = num * src->buffer_inc_recip;
+	if (weight * src->buffer_inc > num) {
+		weight--;
+	} else if (num - weight * src->buffer_inc >= src->buffer_inc) {
+		weight++;
+	}
+	return weight;
+}
+
 static void interp_sample(audio_source *src, int16_t last, int16_t current)
 {
-	int64_t tmp = last * ((src->buffer_fraction << 16) / src->buffer_inc);
-	tmp += current * (0x10000 - ((src->buffer_fraction << 16) / src->buffer_inc));
-	src->back[src->buffer_pos++] = tmp >> 16;
+	int64_t weight = interp_weight(src);
+	int64_t tmp = last * weight;
+	tmp += current * (0x10000 - weight);
+	src->back[src->buffer_pos] = tmp >> 16;
+	if (src->hash_buf) {
+		hash_sample(src, src->back[src->buffer_pos]);
+	}
+	src->buffer_pos++;
 }
 
-static uint32_t sync_samples;
 void render_put_mono_sample(audio_source *src, int16_t value)
 {
+	if (src->discard) {
+		return;
+	}
 	value = lowpass_sample(src, src->last_left, value);
 	src->buffer_fraction += src->buffer_inc;
 	uint32_t base = render_is_audio_sync() ? 0 : src->read_end;
@@ -284,7 +434,7 @@ void render_put_mono_sample(audio_source *src, int16_t value)
 		src->buffer_fraction -= BUFFER_INC_RES;
 		interp_sample(src, src->last_left, value);
 		
-		if (((src->buffer_pos - base) & src->mask) >= sync_samples) {
+		if (((src->buffer_pos - base) & src->mask) >= src->mixer->output.sync_samples) {
 			render_do_audio_ready(src);
 		}
 		src->buffer_pos &= src->mask;
@@ -294,6 +444,9 @@ void render_put_mono_sample(audio_source *src, int16_t value)
 
 void render_put_stereo_sample(audio_source *src, int16_t left, int16_t right)
 {
+	if (src->discard) {
+		return;
+	}
 	left = lowpass_sample(src, src->last_left, left);
 	right = lowpass_sample(src, src->last_right, right);
 	src->buffer_fraction += src->buffer_inc;
@@ -305,7 +458,7 @@ void render_put_stereo_sample(audio_source *src, int16_t left, int16_t right)
 		interp_sample(src, src->last_left, left);
 		interp_sample(src, src->last_right, right);
 		
-		if (((src->buffer_pos - base) & src->mask)/2 >= sync_samples) {
+		if (((src->buffer_pos - base) & src->mask)/2 >= src->mixer->output.sync_samples) {
 			render_do_audio_ready(src);
 		}
 		src->buffer_pos &= src->mask;
@@ -314,13 +467,85 @@ void render_put_stereo_sample(audio_source *src, int16_t left, int16_t right)
 	src->last_right = right;
 }
 
+void render_put_mono_block(audio_source *src, int16_t *samples, uint32_t count)
+{
+	if (src->discard) {
+		return;
+	}
+	uint8_t is_sync = render_is_audio_sync();
+	uint32_t sync_samples = src->mixer->output.sync_samples;
+	uint64_t buffer_inc = src->buffer_inc;
+	int16_t last = src->last_left;
+	for (int16_t *end = samples + count; samples < end; samples++)
+	{
+		int16_t value = lowpass_sample(src, last, *samples);
+		src->buffer_fraction += buffer_inc;
+		if (src->buffer_fraction > BUFFER_INC_RES) {
+			uint32_t base = is_sync ? 0 : src->read_end;
+			do {
+				src->buffer_fraction -= BUFFER_INC_RES;
+				interp_sample(src, last, value);
+				
+				if (((src->buffer_pos - base) & src->mask) >= sync_samples) {
+					render_do_audio_ready(src);
+				}
+				src->buffer_pos &= src->mask;
+			} while (src->buffer_fraction > BUFFER_INC_RES);
+		}
+		last = value;
+	}
+	src->last_left = last;
+}
+
+void render_put_stereo_block(audio_source *src, int16_t *samples, uint32_t frames)
+{
+	if (src->discard) {
+		return;
+	}
+	uint8_t is_sync = render_is_audio_sync();
+	uint32_t sync_samples = src->mixer->output.sync_samples;
+	uint64_t buffer_inc = src->buffer_inc;
+	int16_t last_left = src->last_left, last_right = src->last_right;
+	for (int16_t *end = samples + frames * 2; samples < end; samples += 2)
+	{
+		int16_t left = lowpass_sample(src, last_left, samples[0]);
+		int16_t right = lowpass_sample(src, last_right, samples[1]);
+		src->buffer_fraction += buffer_inc;
+		if (src->buffer_fraction > BUFFER_INC_RES) {
+			uint32_t base = is_sync ? 0 : src->read_end;
+			do {
+				src->buffer_fraction -= BUFFER_INC_RES;
+				//same interpolation as interp_sample, but with the weight shared by both channels
+				int64_t weight = interp_weight(src);
+				int16_t out_left = (last_left * weight + left * (0x10000 - weight)) >> 16;
+				int16_t out_right = (last_right * weight + right * (0x10000 - weight)) >> 16;
+				src->back[src->buffer_pos++] = out_left;
+				src->back[src->buffer_pos++] = out_right;
+				if (src->hash_buf) {
+					hash_sample(src, out_left);
+					hash_sample(src, out_right);
+				}
+				
+				if (((src->buffer_pos - base) & src->mask)/2 >= sync_samples) {
+					render_do_audio_ready(src);
+				}
+				src->buffer_pos &= src->mask;
+			} while (src->buffer_fraction > BUFFER_INC_RES);
+		}
+		last_left = left;
+		last_right = right;
+	}
+	src->last_left = last_left;
+	src->last_right = last_right;
+}
+
 static void update_source(audio_source *src, double rc, uint8_t sync_changed)
 {
 	double alpha = src->dt / (src->dt + rc);
 	int32_t lowpass_alpha = (int32_t)(((double)0x10000) * alpha);
 	src->lowpass_alpha = lowpass_alpha;
 	if (sync_changed) {
-		uint32_t alloc_size = render_is_audio_sync() ? src->num_channels * buffer_samples : nearest_pow2(render_min_buffered() * 4 * src->num_channels);
+		uint32_t alloc_size = render_is_audio_sync() ? src->num_channels * src->mixer->output.buffer_samples : nearest_pow2(render_min_buffered() * 4 * src->num_channels);
 		src->back = realloc(src->back, alloc_size * sizeof(int16_t));
 		if (render_is_audio_sync()) {
 			src->front = malloc(alloc_size * sizeof(int16_t));
@@ -330,56 +555,54 @@ static void update_source(audio_source *src, double rc, uint8_t sync_changed)
 		}
 		src->mask = render_is_audio_sync() ? 0xFFFFFFFF : alloc_size-1;
 		src->read_start = 0;
-		src->read_end = render_is_audio_sync() ? buffer_samples * src->num_channels : 0;
+		src->read_end = render_is_audio_sync() ? src->mixer->output.buffer_samples * src->num_channels : 0;
 		src->buffer_pos = 0;
 	}
 }
 
-uint8_t old_audio_sync;
 void render_audio_initialized(render_audio_format format, uint32_t rate, uint8_t channels, uint32_t buffer_size, int sample_size_in)
 {
-	sample_rate = rate;
-	output_channels = channels;
-	buffer_samples = buffer_size;
-	sample_size = sample_size_in;
-	if (mix_buf) {
-		free(mix_buf);
-		mix_buf = NULL;
-	}
+	audio_mixer *mixer = get_mixer();
+	audio_output *output = &mixer->output;
+	output->sample_rate = rate;
+	output->channels = channels;
+	output->buffer_samples = buffer_size;
+	output->sample_size = sample_size_in;
 	switch(format)
 	{
 	case RENDER_AUDIO_S16:
-		convert = convert_s16;
-		mix_buf = calloc(output_channels * buffer_samples, sizeof(float));
+		output->convert = convert_s16;
+		output->need_mix_buf = 1;
 		break;
 	case RENDER_AUDIO_FLOAT:
-		convert = clamp_f32;
+		output->convert = clamp_f32;
+		output->need_mix_buf = 0;
 		break;
 	case RENDER_AUDIO_UNKNOWN:
-		convert = convert_null;
-		mix_buf = calloc(output_channels * buffer_samples, sizeof(float));
+		output->convert = convert_null;
+		output->need_mix_buf = 1;
 		break;
 	}
 	uint32_t syncs = render_audio_syncs_per_sec();
 	if (syncs) {
-		sync_samples = rate / syncs;
+		output->sync_samples = rate / syncs;
 	} else {
-		sync_samples = buffer_samples;
+		output->sync_samples = buffer_size;
 	}
 	char * gain_str = tern_find_path(config, "audio\0gain\0", TVAL_PTR).ptrval;
-	overall_gain_mult = db_to_mult(gain_str ? atof(gain_str) : 0.0f);
-	uint8_t sync_changed = old_audio_sync != render_is_audio_sync();
-	old_audio_sync = render_is_audio_sync();
+	output->gain_mult = db_to_mult(gain_str ? atof(gain_str) : 0.0f);
+	uint8_t sync_changed = output->audio_sync != render_is_audio_sync();
+	output->audio_sync = render_is_audio_sync();
 	double lowpass_cutoff = get_lowpass_cutoff(config);
 	double rc = (1.0 / lowpass_cutoff) / (2.0 * M_PI);
 	render_lock_audio();
-		for (uint8_t i = 0; i < num_audio_sources; i++)
+		for (uint8_t i = 0; i < mixer->num_sources; i++)
 		{
-			update_source(audio_sources[i], rc, sync_changed);
+			update_source(mixer->sources[i], rc, sync_changed);
 		}
 	render_unlock_audio();
-	for (uint8_t i = 0; i < num_inactive_audio_sources; i++)
+	for (uint8_t i = 0; i < mixer->num_inactive_sources; i++)
 	{
-		update_source(inactive_audio_sources[i], rc, sync_changed);
+		update_source(mixer->inactive_sources[i], rc, sync_changed);
 	}
 }
\ No newline at end of file
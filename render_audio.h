@@ -8,13 +8,20 @@ typedef enum {
 	RENDER_AUDIO_UNKNOWN
 } render_audio_format;
 
+typedef struct audio_mixer audio_mixer;
+
 typedef struct {
 	void     *opaque;
+	audio_mixer *mixer;
 	int16_t  *front;
 	int16_t  *back;
 	double   dt;
 	uint64_t buffer_fraction;
 	uint64_t buffer_inc;
+	double   buffer_inc_recip;
+	int16_t  *hash_buf; //output samples not yet hashed, NULL unless the mixer has hashing enabled
+	uint64_t hash;
+	uint32_t hash_count;
 	float    gain_mult;
 	uint32_t buffer_pos;
 	uint32_t read_start;
@@ -25,17 +32,31 @@ typedef struct {
 	int16_t  last_right;
 	uint8_t  num_channels;
 	uint8_t  front_populated;
+	uint8_t  discard; //samples put while this is set are dropped
 } audio_source;
 
 //public interface
 audio_source *render_audio_source(uint64_t master_clock, uint64_t sample_divider, uint8_t channels);
 void render_audio_source_gaindb(audio_source *src, float gain);
+//for frames that are emulated but never heard, drops everything put into src until turned off again
+void render_audio_source_discard(audio_source *src, uint8_t discard);
 void render_audio_adjust_clock(audio_source *src, uint64_t master_clock, uint64_t sample_divider);
 void render_put_mono_sample(audio_source *src, int16_t value);
 void render_put_stereo_sample(audio_source *src, int16_t left, int16_t right);
+//samples is count mono samples or frames pairs of interleaved left/right samples at the source's native rate
+void render_put_mono_block(audio_source *src, int16_t *samples, uint32_t count);
+void render_put_stereo_block(audio_source *src, int16_t *samples, uint32_t frames);
 void render_pause_source(audio_source *src);
 void render_resume_source(audio_source *src);
 void render_free_source(audio_source *src);
+//sources are created in the calling thread's mixer, threads without one share a default mixer
+audio_mixer *render_new_audio_mixer(void);
+audio_mixer *render_set_audio_mixer(audio_mixer *mixer);
+void render_free_audio_mixer(audio_mixer *mixer);
+//when enabled, each source of the calling thread's mixer keeps a running hash of its resampled
+//output as it is produced on the emulation thread, render_take_audio_hash combines and resets them
+void render_set_audio_hashing(uint8_t enabled);
+uint64_t render_take_audio_hash(void);
 //interface for render backends
 void render_audio_initialized(render_audio_format format, uint32_t rate, uint8_t channels, uint32_t buffer_size, int sample_size);
 int mix_and_convert(unsigned char *byte_stream, int len, int *min_remaining_out);
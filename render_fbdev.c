@@ -1300,7 +1300,7 @@ void render_save_screenshot(char *path)
 	screenshot_path = path;
 }
 
-uint8_t render_create_window(char *caption, uint32_t width, uint32_t height, window_close_handler close_handler)
+uint8_t render_create_window(char *caption, uint32_t width, uint32_t height, window_close_handler close_handler, void *close_data)
 {
 	//not supported under fbdev
 	return 0;
@@ -35,6 +35,7 @@ static SDL_Renderer *main_renderer;
 static SDL_Renderer **extra_renderers;
 static SDL_Texture  **sdl_textures;
 static window_close_handler *close_handlers;
+static void **close_data;
 static uint8_t num_textures;
 static SDL_Rect      main_clip;
 static SDL_GLContext *main_context;
@@ -903,7 +904,7 @@ static int32_t handle_event(SDL_Event *event)
 				{
 					if (SDL_GetWindowID(extra_windows[i]) == event->window.windowID) {
 						if (close_handlers[i]) {
-							close_handlers[i](i + FRAMEBUFFER_USER_START);
+							close_handlers[i](i + FRAMEBUFFER_USER_START, close_data[i]);
 						}
 						break;
 					}
@@ -1354,7 +1355,7 @@ void render_save_screenshot(char *path)
 	screenshot_path = path;
 }
 
-uint8_t render_create_window(char *caption, uint32_t width, uint32_t height, window_close_handler close_handler)
+uint8_t render_create_window(char *caption, uint32_t width, uint32_t height, window_close_handler close_handler, void *data)
 {
 	uint8_t win_idx = 0xFF;
 	for (int i = 0; i < num_textures - FRAMEBUFFER_USER_START; i++)
@@ -1371,6 +1372,7 @@ uint8_t render_create_window(char *caption, uint32_t width, uint32_t height, win
 		extra_windows = realloc(extra_windows, (num_textures - FRAMEBUFFER_USER_START) * sizeof(*extra_windows));
 		extra_renderers = realloc(extra_renderers, (num_textures - FRAMEBUFFER_USER_START) * sizeof(*extra_renderers));
 		close_handlers = realloc(close_handlers, (num_textures - FRAMEBUFFER_USER_START) * sizeof(*close_handlers));
+		close_data = realloc(close_data, (num_textures - FRAMEBUFFER_USER_START) * sizeof(*close_data));
 		win_idx = num_textures - FRAMEBUFFER_USER_START - 1;
 	}
 	extra_windows[win_idx] = SDL_CreateWindow(caption, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, 0);
@@ -1387,6 +1389,7 @@ uint8_t render_create_window(char *caption, uint32_t width, uint32_t height, win
 		goto fail_texture;
 	}
 	close_handlers[win_idx] = close_handler;
+	close_data[win_idx] = data;
 	return texture_idx;
 	
 fail_texture:
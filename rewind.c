@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rewind.h"
+#include "util.h"
+
+//unchanged bytes shorter than this are kept inside a literal rather than splitting it
+#define MIN_SAME_RUN 4
+//worst case growth of an encoded delta over the size of the state
+#define MAX_ENCODE_OVERHEAD 32
+
+static uint8_t *put_varint(uint8_t *out, size_t val)
+{
+	while (val >= 0x80)
+	{
+		*(out++) = val | 0x80;
+		val >>= 7;
+	}
+	*(out++) = val;
+	return out;
+}
+
+static size_t get_varint(uint8_t **in)
+{
+	size_t val = 0;
+	uint8_t shift = 0;
+	uint8_t byte;
+	do {
+		byte = *((*in)++);
+		val |= (size_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	return val;
+}
+
+//XORs two zero padded states together and run length encodes the result
+//tokens are a varint holding length << 1, with the low bit set for literals that are followed by the XORed bytes
+static size_t encode_delta(uint8_t *out, uint8_t *a, uint8_t *b, size_t size)
+{
+	uint8_t *start = out;
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t end = i;
+		for (; end + sizeof(uint64_t) <= size; end += sizeof(uint64_t))
+		{
+			uint64_t wa, wb;
+			memcpy(&wa, a + end, sizeof(wa));
+			memcpy(&wb, b + end, sizeof(wb));
+			if (wa != wb) {
+				break;
+			}
+		}
+		for (; end < size && a[end] == b[end]; end++)
+		{
+		}
+		if (end != i) {
+			out = put_varint(out, (end - i) << 1);
+			i = end;
+			if (i == size) {
+				break;
+			}
+		}
+		size_t same = 0;
+		for (end = i + 1; end < size && same < MIN_SAME_RUN; end++)
+		{
+			same = a[end] == b[end] ? same + 1 : 0;
+		}
+		end -= same;
+		out = put_varint(out, (end - i) << 1 | 1);
+		for (; i < end; i++)
+		{
+			*(out++) = a[i] ^ b[i];
+		}
+	}
+	return out - start;
+}
+
+static void apply_delta(uint8_t *state, uint8_t *delta, size_t size)
+{
+	uint8_t *end = delta + size;
+	size_t pos = 0;
+	while (delta < end)
+	{
+		size_t token = get_varint(&delta);
+		size_t len = token >> 1;
+		if (token & 1) {
+			for (size_t i = 0; i < len; i++)
+			{
+				state[pos + i] ^= delta[i];
+			}
+			delta += len;
+		}
+		pos += len;
+	}
+}
+
+static void resize_states(rewind_buffer *rw, size_t capacity)
+{
+	rw->head = realloc(rw->head, capacity);
+	rw->scratch = realloc(rw->scratch, capacity);
+	rw->encoded = realloc(rw->encoded, capacity + MAX_ENCODE_OVERHEAD);
+	//bytes past the end of the head state must stay zero for deltas between states of different sizes
+	memset(rw->head + rw->capacity, 0, capacity - rw->capacity);
+	rw->capacity = capacity;
+}
+
+rewind_buffer *rewind_new(system_header *system, size_t budget, uint32_t interval)
+{
+	if (!system->serialize_into) {
+		return NULL;
+	}
+	if (budget > UINT32_MAX) {
+		budget = UINT32_MAX;
+	}
+	rewind_buffer *rw = calloc(1, sizeof(rewind_buffer));
+	rw->system = system;
+	rw->budget = budget;
+	rw->interval = interval ? interval : 1;
+	rw->ring = malloc(budget);
+	rw->max_entries = 64;
+	rw->entries = malloc(rw->max_entries * sizeof(rewind_entry));
+	resize_states(rw, system->serialize_size(system));
+	return rw;
+}
+
+static rewind_entry *newest_entry(rewind_buffer *rw)
+{
+	return rw->entries + (rw->first_entry + rw->num_entries - 1) % rw->max_entries;
+}
+
+static void drop_oldest(rewind_buffer *rw)
+{
+	rw->first_entry = (rw->first_entry + 1) % rw->max_entries;
+	rw->num_entries--;
+}
+
+//finds room in the ring for size bytes, evicting the oldest deltas as needed
+static uint32_t alloc_ring(rewind_buffer *rw, size_t size)
+{
+	for (;;)
+	{
+		if (!rw->num_entries) {
+			return 0;
+		}
+		rewind_entry *newest = newest_entry(rw);
+		size_t end = newest->offset + newest->size;
+		size_t oldest = rw->entries[rw->first_entry].offset;
+		if (oldest >= end) {
+			if (oldest - end >= size) {
+				return end;
+			}
+		} else if (rw->budget - end >= size) {
+			return end;
+		} else if (oldest >= size) {
+			return 0;
+		}
+		drop_oldest(rw);
+	}
+}
+
+static void push_entry(rewind_buffer *rw, uint32_t offset, uint32_t size, uint32_t state_size)
+{
+	if (rw->num_entries == rw->max_entries) {
+		uint32_t old_max = rw->max_entries;
+		rw->max_entries *= 2;
+		rw->entries = realloc(rw->entries, rw->max_entries * sizeof(rewind_entry));
+		if (rw->first_entry + rw->num_entries > old_max) {
+			//keep the entries contiguous by moving the wrapped part past the old end
+			memcpy(rw->entries + old_max, rw->entries, (rw->first_entry + rw->num_entries - old_max) * sizeof(rewind_entry));
+		}
+	}
+	rewind_entry *entry = rw->entries + (rw->first_entry + rw->num_entries++) % rw->max_entries;
+	entry->offset = offset;
+	entry->size = size;
+	entry->state_size = state_size;
+}
+
+//makes the state in scratch the new head, storing the delta back to the old head
+static void add_state(rewind_buffer *rw, size_t size)
+{
+	memset(rw->scratch + size, 0, rw->capacity - size);
+	if (rw->has_head) {
+		size_t delta_size = encode_delta(rw->encoded, rw->head, rw->scratch, size > rw->head_size ? size : rw->head_size);
+		rw->delta_bytes += delta_size;
+		if (delta_size > rw->budget) {
+			//can't be stored at all, older snapshots are unreachable without it
+			rw->num_entries = 0;
+		} else {
+			uint32_t offset = alloc_ring(rw, delta_size);
+			memcpy(rw->ring + offset, rw->encoded, delta_size);
+			push_entry(rw, offset, delta_size, rw->head_size);
+		}
+	}
+	uint8_t *tmp = rw->head;
+	rw->head = rw->scratch;
+	rw->scratch = tmp;
+	rw->head_size = size;
+	rw->has_head = 1;
+	rw->head_restored = 0;
+	rw->snapshots++;
+}
+
+void rewind_snapshot(rewind_buffer *rw)
+{
+	size_t size = rw->system->serialize_into(rw->system, rw->scratch, rw->capacity);
+	if (!size) {
+		size_t bound = rw->system->serialize_size(rw->system);
+		resize_states(rw, bound > rw->capacity ? bound : rw->capacity * 2);
+		size = rw->system->serialize_into(rw->system, rw->scratch, rw->capacity);
+		if (!size) {
+			fatal_error("Save state does not fit in the size reported by the system\n");
+		}
+	}
+	add_state(rw, size);
+}
+
+uint8_t rewind_snapshot_due(rewind_buffer *rw)
+{
+	if (++rw->frame_counter >= rw->interval) {
+		rw->frame_counter = 0;
+		return 1;
+	}
+	return 0;
+}
+
+void rewind_frame(rewind_buffer *rw)
+{
+	if (rewind_snapshot_due(rw)) {
+		rewind_snapshot(rw);
+	}
+}
+
+uint8_t rewind_step(rewind_buffer *rw)
+{
+	if (!rw->has_head) {
+		return 0;
+	}
+	if (rw->head_restored) {
+		//the head snapshot has already been restored, step back to the one before it
+		if (!rw->num_entries) {
+			return 0;
+		}
+		rewind_entry *entry = newest_entry(rw);
+		apply_delta(rw->head, rw->ring + entry->offset, entry->size);
+		rw->head_size = entry->state_size;
+		rw->num_entries--;
+	}
+	rw->system->deserialize(rw->system, rw->head, rw->head_size);
+	rw->head_restored = 1;
+	rw->frame_counter = 0;
+	return 1;
+}
+
+uint32_t rewind_frames_available(rewind_buffer *rw)
+{
+	return (rw->num_entries + rw->has_head) * rw->interval;
+}
+
+void rewind_free(rewind_buffer *rw)
+{
+	free(rw->ring);
+	free(rw->entries);
+	free(rw->head);
+	free(rw->scratch);
+	free(rw->encoded);
+	free(rw);
+}
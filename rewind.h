@@ -0,0 +1,49 @@
+#ifndef REWIND_H_
+#define REWIND_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "system.h"
+
+typedef struct {
+	uint32_t offset;
+	uint32_t size;       //size of the encoded delta
+	uint32_t state_size; //size of the state the delta restores
+} rewind_entry;
+
+struct rewind_buffer {
+	system_header *system;
+	uint8_t       *ring;
+	rewind_entry  *entries;
+	//latest snapshot in full, older ones are reconstructed by applying deltas to it
+	uint8_t       *head;
+	uint8_t       *scratch;
+	uint8_t       *encoded;
+	size_t        budget;
+	size_t        capacity;
+	size_t        head_size;
+	uint64_t      delta_bytes; //total encoded size of all deltas ever taken, for stats
+	uint32_t      first_entry;
+	uint32_t      num_entries;
+	uint32_t      max_entries;
+	uint32_t      interval;
+	uint32_t      frame_counter;
+	uint32_t      snapshots;
+	uint8_t       has_head;
+	uint8_t       head_restored;
+};
+
+//budget is the number of bytes available for deltas, a snapshot is taken every interval frames
+rewind_buffer *rewind_new(system_header *system, size_t budget, uint32_t interval);
+//should be called between frames, never while the system is executing
+void rewind_frame(rewind_buffer *rw);
+void rewind_snapshot(rewind_buffer *rw);
+//counts a frame for systems that snapshot themselves, returns 1 when a snapshot is due
+uint8_t rewind_snapshot_due(rewind_buffer *rw);
+//restores the most recent snapshot, repeated calls step further back
+//returns 0 when there is nothing left to restore
+uint8_t rewind_step(rewind_buffer *rw);
+uint32_t rewind_frames_available(rewind_buffer *rw);
+void rewind_free(rewind_buffer *rw);
+
+#endif //REWIND_H_
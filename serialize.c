@@ -3,6 +3,9 @@
 #include <stdio.h>
 #include "serialize.h"
 #include "util.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 void init_serialize(serialize_buffer *buf)
 {
@@ -10,6 +13,16 @@ void init_serialize(serialize_buffer *buf)
 	buf->size = 0;
 	buf->current_section_start = 0;
 	buf->data = malloc(SERIALIZE_DEFAULT_SIZE);
+	buf->caller_owned = 0;
+}
+
+void init_serialize_into(serialize_buffer *buf, uint8_t *data, size_t storage)
+{
+	buf->storage = storage;
+	buf->size = 0;
+	buf->current_section_start = 0;
+	buf->data = data;
+	buf->caller_owned = 1;
 }
 
 static void reserve(serialize_buffer *buf, size_t amount)
@@ -21,7 +34,34 @@ static void reserve(serialize_buffer *buf, size_t amount)
 			//doublign isn't enough, increase by the precise amount needed
 			buf->storage += amount - (buf->storage - buf->size);
 		}
-		buf->data = realloc(buf->data, buf->storage + sizeof(*buf));
+		if (buf->caller_owned) {
+			//can't grow memory we don't own, move what we have so far to the heap
+			uint8_t *data = malloc(buf->storage + sizeof(*buf));
+			memcpy(data, buf->data, buf->size);
+			buf->data = data;
+			buf->caller_owned = 0;
+		} else {
+			buf->data = realloc(buf->data, buf->storage + sizeof(*buf));
+		}
+	}
+}
+
+//copies len 16-bit words while converting between host and big endian order
+static void swap_copy16(uint8_t *dst, uint16_t *src, size_t len)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	for (; i + 8 <= len; i += 8)
+	{
+		__m128i words = _mm_loadu_si128((__m128i *)(src + i));
+		words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+		_mm_storeu_si128((__m128i *)(dst + i * 2), words);
+	}
+#endif
+	for (; i < len; i++)
+	{
+		dst[i * 2] = src[i] >> 8;
+		dst[i * 2 + 1] = src[i];
 	}
 }
 
@@ -63,20 +103,63 @@ void save_buffer8(serialize_buffer *buf, void *val, size_t len)
 void save_buffer16(serialize_buffer *buf, uint16_t *val, size_t len)
 {
 	reserve(buf, len * sizeof(*val));
-	for(; len != 0; len--, val++) {
-		buf->data[buf->size++] = *val >> 8;
-		buf->data[buf->size++] = *val;
-	}
+	swap_copy16(buf->data + buf->size, val, len);
+	buf->size += len * sizeof(*val);
 }
 
 void save_buffer32(serialize_buffer *buf, uint32_t *val, size_t len)
 {
 	reserve(buf, len * sizeof(*val));
+	uint8_t *dst = buf->data + buf->size;
+	buf->size += len * sizeof(*val);
 	for(; len != 0; len--, val++) {
-		buf->data[buf->size++] = *val >> 24;
-		buf->data[buf->size++] = *val >> 16;
-		buf->data[buf->size++] = *val >> 8;
-		buf->data[buf->size++] = *val;
+		*(dst++) = *val >> 24;
+		*(dst++) = *val >> 16;
+		*(dst++) = *val >> 8;
+		*(dst++) = *val;
+	}
+}
+
+static uint32_t count_pages(size_t bytes, uint8_t page_shift, uint8_t *dirty)
+{
+	uint32_t pages = bytes >> page_shift;
+	if (!dirty) {
+		return pages;
+	}
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < pages; i++)
+	{
+		count += dirty[i] != 0;
+	}
+	return count;
+}
+
+void save_pages8(serialize_buffer *buf, uint8_t *val, size_t len, uint8_t page_shift, uint8_t *dirty)
+{
+	uint32_t pages = len >> page_shift;
+	save_int8(buf, page_shift);
+	save_int16(buf, count_pages(len, page_shift, dirty));
+	for (uint32_t i = 0; i < pages; i++)
+	{
+		if (!dirty || dirty[i]) {
+			save_int16(buf, i);
+			save_buffer8(buf, val + (i << page_shift), 1 << page_shift);
+		}
+	}
+}
+
+void save_pages16(serialize_buffer *buf, uint16_t *val, size_t len, uint8_t page_shift, uint8_t *dirty)
+{
+	uint32_t pages = (len * sizeof(*val)) >> page_shift;
+	uint32_t page_words = (1 << page_shift) / sizeof(*val);
+	save_int8(buf, page_shift);
+	save_int16(buf, count_pages(len * sizeof(*val), page_shift, dirty));
+	for (uint32_t i = 0; i < pages; i++)
+	{
+		if (!dirty || dirty[i]) {
+			save_int16(buf, i);
+			save_buffer16(buf, val + i * page_words, page_words);
+		}
 	}
 }
 
@@ -180,23 +263,63 @@ void load_buffer16(deserialize_buffer *buf, uint16_t *dst, size_t len)
 	if ((buf->size - buf->cur_pos) < len * sizeof(uint16_t)) {
 		fatal_error("Failed to load required buffer of size %d\n", len);
 	}
-	for(; len != 0; len--, dst++) {
-		uint16_t value = buf->data[buf->cur_pos++] << 8;
-		value |= buf->data[buf->cur_pos++];
-		*dst = value;
+	uint8_t *src = buf->data + buf->cur_pos;
+	buf->cur_pos += len * sizeof(uint16_t);
+	size_t i = 0;
+#ifdef __SSE2__
+	for (; i + 8 <= len; i += 8)
+	{
+		__m128i words = _mm_loadu_si128((__m128i *)(src + i * 2));
+		words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+		_mm_storeu_si128((__m128i *)(dst + i), words);
+	}
+#endif
+	for (; i < len; i++)
+	{
+		dst[i] = src[i * 2] << 8 | src[i * 2 + 1];
 	}
 }
+
+uint32_t load_pages8(deserialize_buffer *buf, uint8_t *dst, size_t len)
+{
+	uint8_t page_shift = load_int8(buf);
+	uint32_t pages = load_int16(buf);
+	for (uint32_t i = 0; i < pages; i++)
+	{
+		size_t start = (size_t)load_int16(buf) << page_shift;
+		if (start + (1 << page_shift) > len) {
+			fatal_error("State has a page at offset %X past the end of a %d byte buffer\n", (uint32_t)start, (uint32_t)len);
+		}
+		load_buffer8(buf, dst + start, 1 << page_shift);
+	}
+	return pages;
+}
+
+uint32_t load_pages16(deserialize_buffer *buf, uint16_t *dst, size_t len)
+{
+	uint8_t page_shift = load_int8(buf);
+	uint32_t pages = load_int16(buf);
+	size_t page_words = (1 << page_shift) / sizeof(*dst);
+	for (uint32_t i = 0; i < pages; i++)
+	{
+		size_t start = load_int16(buf) * page_words;
+		if (start + page_words > len) {
+			fatal_error("State has a page at offset %X past the end of a %d word buffer\n", (uint32_t)start, (uint32_t)len);
+		}
+		load_buffer16(buf, dst + start, page_words);
+	}
+	return pages;
+}
+
 void load_buffer32(deserialize_buffer *buf, uint32_t *dst, size_t len)
 {
 	if ((buf->size - buf->cur_pos) < len * sizeof(uint32_t)) {
 		fatal_error("Failed to load required buffer of size %d\n", len);
 	}
-	for(; len != 0; len--, dst++) {
-		uint32_t value = buf->data[buf->cur_pos++] << 24;
-		value |= buf->data[buf->cur_pos++] << 16;
-		value |= buf->data[buf->cur_pos++] << 8;
-		value |= buf->data[buf->cur_pos++];
-		*dst = value;
+	uint8_t *src = buf->data + buf->cur_pos;
+	buf->cur_pos += len * sizeof(uint32_t);
+	for(; len != 0; len--, dst++, src += 4) {
+		*dst = (uint32_t)src[0] << 24 | src[1] << 16 | src[2] << 8 | src[3];
 	}
 }
 
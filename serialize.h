@@ -13,6 +13,7 @@ typedef struct {
 	size_t  storage;
 	size_t  current_section_start;
 	uint8_t *data;
+	uint8_t caller_owned;
 } serialize_buffer;
 
 typedef struct deserialize_buffer deserialize_buffer;
@@ -47,10 +48,17 @@ enum {
 	SECTION_MAPPER,
 	SECTION_EEPROM,
 	SECTION_CART_RAM,
-	SECTION_TMSS
+	SECTION_TMSS,
+	SECTION_CHECKPOINT,
+	SECTION_MAIN_RAM_PAGES,
+	SECTION_SOUND_RAM_PAGES,
+	SECTION_VRAM_PAGES
 };
 
 void init_serialize(serialize_buffer *buf);
+//serializes into a caller-provided buffer, if it turns out to be too small the state continues
+//in a heap buffer so buf->data != data afterwards signals overflow and must be freed by the caller
+void init_serialize_into(serialize_buffer *buf, uint8_t *data, size_t storage);
 void save_int32(serialize_buffer *buf, uint32_t val);
 void save_int16(serialize_buffer *buf, uint16_t val);
 void save_int8(serialize_buffer *buf, uint8_t val);
@@ -58,6 +66,10 @@ void save_string(serialize_buffer *buf, char *val);
 void save_buffer8(serialize_buffer *buf, void *val, size_t len);
 void save_buffer16(serialize_buffer *buf, uint16_t *val, size_t len);
 void save_buffer32(serialize_buffer *buf, uint32_t *val, size_t len);
+//saves the pages of val that have a nonzero byte in dirty, or all of them if dirty is NULL
+//page_shift is log2 of the page size in bytes, len is in elements like the save_buffer functions
+void save_pages8(serialize_buffer *buf, uint8_t *val, size_t len, uint8_t page_shift, uint8_t *dirty);
+void save_pages16(serialize_buffer *buf, uint16_t *val, size_t len, uint8_t page_shift, uint8_t *dirty);
 void start_section(serialize_buffer *buf, uint16_t section_id);
 void end_section(serialize_buffer *buf);
 void register_section_handler(deserialize_buffer *buf, section_handler handler, uint16_t section_id);
@@ -68,6 +80,9 @@ uint8_t load_int8(deserialize_buffer *buf);
 void load_buffer8(deserialize_buffer *buf, void *dst, size_t len);
 void load_buffer16(deserialize_buffer *buf, uint16_t *dst, size_t len);
 void load_buffer32(deserialize_buffer *buf, uint32_t *dst, size_t len);
+//loads pages saved by save_pages8/save_pages16 into dst, returns the number of pages loaded
+uint32_t load_pages8(deserialize_buffer *buf, uint8_t *dst, size_t len);
+uint32_t load_pages16(deserialize_buffer *buf, uint16_t *dst, size_t len);
 int load_section(deserialize_buffer *buf);
 uint8_t save_to_file(serialize_buffer *buf, char *path);
 uint8_t load_from_file(deserialize_buffer *buf, char *path);
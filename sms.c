@@ -8,11 +8,11 @@
 #include "debug.h"
 #include "saves.h"
 #include "bindings.h"
+#include "rewind.h"
 
 #ifdef NEW_CORE
 #define Z80_CYCLE cycles
 #define Z80_OPTS opts
-#define z80_handle_code_write(...)
 #else
 #define Z80_CYCLE current_cycle
 #define Z80_OPTS options
@@ -261,6 +261,29 @@ static uint8_t *serialize(system_header *sys, size_t *size_out)
 	return state.data;
 }
 
+static size_t serialize_into(system_header *sys, uint8_t *dest, size_t max_size)
+{
+	sms_context *sms = (sms_context *)sys;
+	serialize_buffer state;
+	init_serialize_into(&state, dest, max_size);
+	sms_serialize(sms, &state);
+	if (state.data != dest) {
+		free(state.data);
+		return 0;
+	}
+	return state.size;
+}
+
+static size_t serialize_size(system_header *sys)
+{
+	sms_context *sms = (sms_context *)sys;
+	serialize_buffer state;
+	init_serialize(&state);
+	sms_serialize(sms, &state);
+	free(state.data);
+	return state.size + VDP_MAX_FIFO_SERIALIZE_SIZE;
+}
+
 static void ram_deserialize(deserialize_buffer *buf, void *vsms)
 {
 	sms_context *sms = vsms;
@@ -321,12 +344,13 @@ void sms_deserialize(deserialize_buffer *buf, sms_context *sms)
 	buf->handlers = NULL;
 }
 
-static void deserialize(system_header *sys, uint8_t *data, size_t size)
+static uint8_t deserialize(system_header *sys, uint8_t *data, size_t size)
 {
 	sms_context *sms = (sms_context *)sys;
 	deserialize_buffer buffer;
 	init_deserialize(&buffer, data, size);
 	sms_deserialize(&buffer, sms);
+	return 1;
 }
 
 static void save_state(sms_context *sms, uint8_t slot)
@@ -417,6 +441,21 @@ static void run_sms(system_header *system)
 			save_state(sms, system->save_state - 1);
 			system->save_state = 0;
 		}
+		if (system->rewind && sms->vdp->frame != sms->last_frame) {
+			if (system->rewinding) {
+				if (rewind_step(system->rewind)) {
+					target_cycle = sms->z80->Z80_CYCLE;
+				}
+			} else if (rewind_snapshot_due(system->rewind)) {
+				while (!sms->z80->pc) {
+					//advance Z80 to an instruction boundary
+					z80_run(sms->z80, sms->z80->Z80_CYCLE + 1);
+				}
+				rewind_snapshot(system->rewind);
+			}
+			//the frame counter comes back with a restored state so this has to be read after stepping
+			sms->last_frame = sms->vdp->frame;
+		}
 		
 		target_cycle += 3420*16;
 		if (target_cycle > 0x10000000) {
@@ -661,6 +700,8 @@ sms_context *alloc_configure_sms(system_media *media, uint32_t opts, uint8_t for
 	sms->header.keyboard_up = keyboard_up;
 	sms->header.config_updated = config_updated;
 	sms->header.serialize = serialize;
+	sms->header.serialize_into = serialize_into;
+	sms->header.serialize_size = serialize_size;
 	sms->header.deserialize = deserialize;
 	sms->header.type = SYSTEM_SMS;
 	
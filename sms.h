@@ -24,6 +24,7 @@ typedef struct {
 	uint32_t      rom_size;
 	uint32_t      master_clock;
 	uint32_t      normal_clock;
+	uint32_t      last_frame;
 	uint8_t       should_return;
 	uint8_t       ram[SMS_RAM_SIZE];
 	uint8_t       bank_regs[4];
@@ -5,6 +5,7 @@
 #include "system_header.h"
 
 typedef struct system_media system_media;
+typedef struct rewind_buffer rewind_buffer;
 
 typedef enum {
 	SYSTEM_UNKNOWN,
@@ -31,11 +32,17 @@ typedef void (*system_u8_u8_fun)(system_header *, uint8_t, uint8_t);
 typedef void (*system_mabs_fun)(system_header *, uint8_t, uint16_t, uint16_t);
 typedef void (*system_mrel_fun)(system_header *, uint8_t, int32_t, int32_t);
 typedef uint8_t *(*system_ptrszt_fun_rptr8)(system_header *, size_t *);
-typedef void (*system_ptr8_sizet_fun)(system_header *, uint8_t *, size_t);
+typedef uint8_t (*system_ptr8_sizet_fun_r8)(system_header *, uint8_t *, size_t);
+typedef size_t (*system_ptr8_sizet_fun_rsizet)(system_header *, uint8_t *, size_t);
+typedef size_t (*system_fun_rsizet)(system_header *);
+typedef size_t (*system_ptr8_sizet_u8_fun_rsizet)(system_header *, uint8_t *, size_t, uint8_t);
+//called once per completed frame with hashes of the frame and of the audio mixed since the previous one
+typedef void (*system_frame_hash_fun)(system_header *, uint32_t frame, uint64_t video_hash, uint64_t audio_hash);
 
 #include "arena.h"
 #include "romdb.h"
 #include "event_log.h"
+#include "bench.h"
 
 struct system_header {
 	system_header           *next_context;
@@ -60,11 +67,25 @@ struct system_header {
 	system_u8_fun           keyboard_up;
 	system_fun              config_updated;
 	system_ptrszt_fun_rptr8 serialize;
-	system_ptr8_sizet_fun   deserialize;
+	//writes the state directly into a caller-provided buffer, returns the size or 0 if it didn't fit
+	system_ptr8_sizet_fun_rsizet serialize_into;
+	//upper bound on the size of a serialized state for the current game
+	system_fun_rsizet       serialize_size;
+	//like serialize_into, but starts a new checkpoint, when incremental is set only memory pages written
+	//since the previous checkpoint are included and the state can only be loaded on top of that checkpoint
+	system_ptr8_sizet_u8_fun_rsizet serialize_checkpoint;
+	//returns 0 if the state was rejected and nothing was changed
+	system_ptr8_sizet_fun_r8 deserialize;
 	system_str_fun          start_vgm_log;
 	system_fun              stop_vgm_log;
+	system_frame_hash_fun   frame_hash;
+	bench_state             *bench; //non-NULL while a benchmark is timing this system
+	//mixes any audio the system has put off generating, called by the VDP right before it outputs a frame
+	system_fun              flush_audio;
 	rom_info                info;
 	arena                   *arena;
+	//history kept for the frontend, the system adds a snapshot to it between frames when set
+	rewind_buffer           *rewind;
 	char                    *next_rom;
 	char                    *save_dir;
 	uint8_t                 enter_debugger;
@@ -74,6 +95,8 @@ struct system_header {
 	uint8_t                 has_keyboard;
 	uint8_t                 vgm_logging;
 	uint8_t                 force_release;
+	uint8_t                 rewinding; //set by the frontend while it wants the system to step back through rewind
+	uint8_t                 run_ahead; //frames the system emulates past each real one to hide input latency, set by the frontend
 	debugger_type           debugger_type;
 	system_type             type;
 };
@@ -88,6 +111,8 @@ struct system_media {
 };
 
 #define OPT_ADDRESS_LOG (1U << 31U)
+//track RAM writes so serialize_checkpoint can leave out unchanged pages
+#define OPT_CHECKPOINTS (1U << 30U)
 
 system_type detect_system_type(system_media *media);
 system_header *alloc_config_system(system_type stype, system_media *media, uint32_t opts, uint8_t force_region);
@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "gen_arm64.h"
+
+typedef int32_t (*fib_fun)(int32_t);
+
+void fatal_error(char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	exit(1);
+}
+
+int main(int arc, char **argv)
+{
+	code_info code;
+	init_code_info(&code);
+	uint32_t *fib = code.cur;
+	subi(&code, r0, r0, 2, SZ_W, SET_COND);
+	uint32_t *recurse = code.cur + 3;
+	b_cc(&code, recurse, CC_GE);
+	movi(&code, r0, 1, SZ_W);
+	rts(&code);
+	pushp(&code, r19, lr);
+	mov(&code, r19, r0, SZ_W);
+	bl(&code, fib);
+	mov(&code, r1, r0, SZ_W);
+	addi(&code, r0, r19, 1, SZ_W, NO_COND);
+	mov(&code, r19, r1, SZ_W);
+	bl(&code, fib);
+	add(&code, r0, r19, r0, SZ_W, NO_COND);
+	popp(&code, r19, lr);
+	rts(&code);
+	__builtin___clear_cache((char *)fib, (char *)code.cur);
+
+	fib_fun fibc = (fib_fun)fib;
+	printf("fib(10): %d\n", fibc(10));
+
+	return 0;
+}
@@ -0,0 +1,282 @@
+#!/usr/bin/env python3
+#Checks that blastem-batch gives the same video and audio hashes no matter how many
+#emulated systems run at once. A generated ROM that keeps the 68K, Z80, VDP, YM2612
+#and PSG busy is run 16 times on a single worker and then on 16 concurrent workers.
+#Also checks that input script events on the same frame are applied in script order
+#and that malformed input scripts are rejected, and that the incremental checkpoints taken
+#with -c are smaller than a full one and load back to the same state.
+#usage: test_batch.py [path to blastem-batch]
+import os
+import struct
+import subprocess
+import tempfile
+from sys import argv, exit
+
+INSTANCES = 16
+FRAMES = 300
+
+class Assembler:
+	def __init__(self):
+		self.items = []
+		self.labels = {}
+
+	def w(self, *words):
+		for word in words:
+			self.items.append(('w', word))
+
+	def l(self, value):
+		self.w(value >> 16, value & 0xFFFF)
+
+	def label(self, name):
+		self.items.append(('label', name))
+
+	def rel16(self, name):
+		self.items.append(('rel16', name))
+
+	def abs32(self, name):
+		self.items.append(('abs32', name))
+
+	def assemble(self, base):
+		pc = base
+		for item in self.items:
+			if item[0] == 'label':
+				self.labels[item[1]] = pc
+			else:
+				pc += 4 if item[0] == 'abs32' else 2
+		out = bytearray()
+		pc = base
+		for item in self.items:
+			if item[0] == 'w':
+				out += struct.pack('>H', item[1] & 0xFFFF)
+			elif item[0] == 'rel16':
+				out += struct.pack('>h', self.labels[item[1]] - pc)
+			elif item[0] == 'abs32':
+				out += struct.pack('>I', self.labels[item[1]])
+			pc = base + len(out)
+		return out
+
+#YM2612 register/value pairs for a looping two channel patch
+YM_INIT = [
+	0x22,0x08, 0x27,0x00, 0x2B,0x80, 0xB0,0x07, 0xB4,0xC0, 0x30,0x71, 0x34,0x32, 0x38,0x04, 0x3C,0x01,
+	0x40,0x10, 0x44,0x20, 0x48,0x18, 0x4C,0x08, 0x50,0x1F, 0x54,0x5F, 0x58,0x9F, 0x5C,0xDF,
+	0x60,0x05, 0x64,0x86, 0x68,0x07, 0x6C,0x03, 0x70,0x02, 0x74,0x02, 0x78,0x02, 0x7C,0x02,
+	0x80,0x2F, 0x84,0x4F, 0x88,0x1F, 0x8C,0x8F, 0x90,0x00, 0x94,0x08, 0x98,0x00, 0x9C,0x0C,
+	0xA4,0x22, 0xA0,0x69, 0xB1,0x34, 0xB5,0xC0, 0x31,0x01, 0x35,0x02, 0x39,0x03, 0x3D,0x01,
+	0x41,0x00, 0x45,0x10, 0x49,0x08, 0x4D,0x10, 0x51,0x1F, 0x55,0x1F, 0x59,0x1F, 0x5D,0x1F,
+	0x61,0x08, 0x65,0x08, 0x69,0x08, 0x6D,0x08, 0x71,0x04, 0x75,0x04, 0x79,0x04, 0x7D,0x04,
+	0x81,0x3F, 0x85,0x3F, 0x89,0x3F, 0x8D,0x3F, 0xA5,0x1A, 0xA1,0x40, 0x28,0xF0
+]
+
+#Z80 program: writes YM_INIT (at 0x100), then loops streaming DAC data, changing PSG
+#tone and toggling key on based on a counter. Assembled by hand
+Z80_PROG = (
+	'F3 310020 210001 06%02X 7E 320040 23 7E 320140 23 10F4 3E00 0609 320060 10FB'
+	' 210080 0E00 3E2A 320040 7E 320140 23 0C 20F3 7D E60F F680 32117F 7C E63F 32117F'
+	' 3E92 32117F 3E28 320040 7C E6F0 F601 320140 7C B7 20CF 2680 18CB'
+)
+
+def build_rom():
+	a = Assembler()
+	a.label('start')
+	a.w(0x46FC, 0x2700)                   #move #$2700, sr
+	a.w(0x41F9); a.l(0xC00004)            #lea $C00004, a0
+	a.w(0x43F9); a.l(0xC00000)            #lea $C00000, a1
+	for reg in [0x8014, 0x8174, 0x8230, 0x8334, 0x8407, 0x855E, 0x8700, 0x8A10, 0x8B00, 0x8C81, 0x8D3F, 0x8F02, 0x9001, 0x9100, 0x9200]:
+		a.w(0x30BC, reg)                  #move.w #reg, (a0)
+	#fill CRAM, VRAM and the plane maps
+	a.w(0x20BC); a.l(0xC0000000)
+	a.w(0x703F, 0x7200)
+	a.label('cram')
+	a.w(0x3281, 0x0641, 0x0123, 0x51C8); a.rel16('cram')
+	a.w(0x20BC); a.l(0x40000000)
+	a.w(0x303C, 0x07FF, 0x223C); a.l(0x12345678)
+	a.label('tiles')
+	a.w(0x2281, 0xE799, 0xD280, 0x51C8); a.rel16('tiles')
+	a.w(0x20BC); a.l(0x40000003)
+	a.w(0x303C, 4095)
+	a.label('maps')
+	a.w(0x3280, 0x51C8); a.rel16('maps')
+	a.w(0x20BC); a.l(0x7C000002)
+	a.w(0x45F9); a.abs32('sprites')
+	a.w(0x303C, 319)
+	a.label('sat')
+	a.w(0x329A, 0x51C8); a.rel16('sat')
+	#load and start the Z80 program
+	a.w(0x33FC, 0x0100); a.l(0xA11100)
+	a.w(0x33FC, 0x0100); a.l(0xA11200)
+	a.w(0x45F9); a.abs32('zprog')
+	a.w(0x47F9); a.l(0xA00000)
+	a.w(0x303C, 0x1FF)
+	a.label('zcopy')
+	a.w(0x16DA, 0x51C8); a.rel16('zcopy')
+	a.w(0x33FC, 0x0000); a.l(0xA11200)
+	a.w(0x33FC, 0x0000); a.l(0xA11100)
+	a.w(0x33FC, 0x0100); a.l(0xA11200)
+	a.w(0x46FC, 0x2000)
+	#main loop: wait for vblank, then scroll, DMA and do some ALU work
+	a.label('main')
+	a.w(0x3439); a.l(0xFF0000)
+	a.label('wait')
+	a.w(0xB479); a.l(0xFF0000)
+	a.w(0x6700); a.rel16('wait')
+	#background color follows the pad 1 buttons so input changes the video hash
+	a.w(0x1C39); a.l(0xA10003)            #move.b $A10003, d6
+	a.w(0x0246, 0x003F, 0x0046, 0x8700)   #andi.w #$3F, d6; ori.w #$8700, d6
+	a.w(0x3086)                           #move.w d6, (a0)
+	a.w(0x20BC); a.l(0x7C000003)
+	a.w(0x3602, 0xD643, 0x3283, 0x3602, 0x4443, 0x3283)
+	a.w(0x20BC); a.l(0x40000010)
+	a.w(0x3282, 0x3602, 0xE243, 0x3283)
+	a.w(0x20BC); a.l(0x93009402)
+	a.w(0x20BC); a.l(0x95009608)
+	a.w(0x30BC, 0x9700)
+	a.w(0x20BC); a.l(0x60000080)
+	a.w(0x383C, 300)
+	a.label('alu')
+	a.w(0x2A04, 0xCAC4, 0xDC85, 0xB986, 0xE28E)
+	a.w(0x4EB9); a.abs32('sub')
+	a.w(0x51CC); a.rel16('alu')
+	a.w(0x6000); a.rel16('main')
+	a.label('sub')
+	a.w(0x5287, 0x4E75)
+	a.label('vint')
+	a.w(0x5279); a.l(0xFF0000)
+	a.w(0x4E73)
+	a.label('sprites')
+	for i in range(80):
+		link = i + 1 if i < 79 else 0
+		a.w(128 + (i * 7) % 240, ((i % 16) << 8) | link, ((i * 13) & 0xFFFF) | ((i & 3) << 13), 128 + (i * 37) % 320)
+	a.label('zprog')
+	zprog = bytearray(0x200)
+	code = bytes.fromhex((Z80_PROG % (len(YM_INIT) // 2)).replace(' ', ''))
+	zprog[:len(code)] = code
+	zprog[0x100:0x100 + len(YM_INIT)] = bytes(YM_INIT)
+	for i in range(0, len(zprog), 2):
+		a.w(zprog[i] << 8 | zprog[i + 1])
+
+	rom = bytearray(0x20000)
+	code = a.assemble(0x200)
+	rom[0x200:0x200 + len(code)] = code
+	struct.pack_into('>II', rom, 0, 0x00FFFE00, 0x200)
+	for vector in range(2, 64):
+		struct.pack_into('>I', rom, vector * 4, a.labels['vint'])
+	rom[0x100:0x110] = b'SEGA GENESIS    '
+	struct.pack_into('>II', rom, 0x1A0, 0, len(rom) - 1)
+	rom[0x1F0:0x1F3] = b'JUE'
+	#pseudo-random data for the DMA source and Z80 bank reads
+	x = 1
+	for i in range(0x4000, len(rom)):
+		x = (x * 1103515245 + 12345) & 0x7FFFFFFF
+		rom[i] = (x >> 16) & 0xFF
+	return rom
+
+def run_batch(batch, job_list, threads, out_path, expect_failure=False, args=[], columns=5):
+	result = subprocess.run([batch, '-j', str(threads), '-o', out_path] + args + [job_list], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+	if expect_failure:
+		return result.returncode != 0
+	if result.returncode:
+		print('blastem-batch exited with status', result.returncode)
+		exit(1)
+	with open(out_path) as f:
+		#rom, status, frames, video hash and audio hash, timing columns are ignored by default
+		return [tuple(line.split('\t')[:columns]) for line in f.read().splitlines()[1:]]
+
+def write_file(path, contents):
+	with open(path, 'w') as f:
+		f.write(contents)
+	return path
+
+#several presses and releases per frame where only the last one should stick, and the
+#same input with just the final state of each frame
+def input_scripts():
+	noisy = []
+	final = []
+	for frame in range(10, FRAMES, 10):
+		down = (frame // 10) % 2
+		order = ['down', 'up'] * 8
+		if not down:
+			order.reverse()
+		for button in ('b', 'c', 'left'):
+			noisy += ['%d 1 %s %s' % (frame, button, state) for state in order]
+			final.append('%d 1 %s %s' % (frame, button, order[-1]))
+	return '\n'.join(noisy) + '\n', '\n'.join(final) + '\n'
+
+def check_input_order(batch, tmp, rom_path, no_input):
+	noisy, final = input_scripts()
+	job_list = write_file(os.path.join(tmp, 'input_jobs.txt'), '%s frames=%d input=%s\n%s frames=%d input=%s\n' % (
+		rom_path, FRAMES, write_file(os.path.join(tmp, 'noisy.txt'), noisy),
+		rom_path, FRAMES, write_file(os.path.join(tmp, 'final.txt'), final)
+	))
+	results = run_batch(batch, job_list, 2, os.path.join(tmp, 'input.txt'))
+	if results[0][1:] != results[1][1:]:
+		print('Same frame input events were not applied in script order', results)
+		return False
+	if results[1][3] == no_input[3]:
+		print('Input script had no effect on the video hash')
+		return False
+	return True
+
+def check_bad_script(batch, tmp, rom_path):
+	job_list = write_file(os.path.join(tmp, 'bad_jobs.txt'), '%s frames=10 input=%s\n' % (
+		rom_path, write_file(os.path.join(tmp, 'bad.txt'), '5 1 b pressed\n')
+	))
+	if not run_batch(batch, job_list, 1, os.path.join(tmp, 'bad.txt.out'), True):
+		print('Input script with an invalid button state was accepted')
+		return False
+	return True
+
+#blastem-batch reports checkpoint_mismatch if replaying the checkpoints doesn't give
+#back the state a second run of the job reached with full checkpoints
+def check_checkpoints(batch, tmp, rom_path, no_input):
+	_, final = input_scripts()
+	job_list = write_file(os.path.join(tmp, 'checkpoint_jobs.txt'), '%s frames=%d\n%s frames=%d input=%s\n' % (
+		rom_path, FRAMES, rom_path, FRAMES, write_file(os.path.join(tmp, 'checkpoint_input.txt'), final)
+	))
+	results = run_batch(batch, job_list, 2, os.path.join(tmp, 'checkpoint.txt'), args=['-c', '7'], columns=None)
+	if results[0][:5] != no_input:
+		print('Checkpoints changed the results or did not match', results[0], 'expected', no_input)
+		return False
+	if results[1][1] != 'ok':
+		print('Checkpoints with input did not match', results[1])
+		return False
+	for result in results:
+		#full_checkpoint_bytes and avg_checkpoint_bytes are second and third from last
+		if float(result[-2]) >= float(result[-3]):
+			print('Incremental checkpoints averaged', result[-2], 'bytes, a full one is', result[-3])
+			return False
+	return True
+
+def main():
+	batch = argv[1] if len(argv) > 1 else './blastem-batch'
+	with tempfile.TemporaryDirectory() as tmp:
+		rom_path = os.path.join(tmp, 'batch_test.bin')
+		with open(rom_path, 'wb') as f:
+			f.write(build_rom())
+		job_list = os.path.join(tmp, 'jobs.txt')
+		with open(job_list, 'w') as f:
+			f.write(('%s frames=%d\n' % (rom_path, FRAMES)) * INSTANCES)
+		serial = run_batch(batch, job_list, 1, os.path.join(tmp, 'serial.txt'))
+		parallel = run_batch(batch, job_list, INSTANCES, os.path.join(tmp, 'parallel.txt'))
+		failed = not check_input_order(batch, tmp, rom_path, serial[0])
+		failed = not check_bad_script(batch, tmp, rom_path) or failed
+		failed = not check_checkpoints(batch, tmp, rom_path, serial[0]) or failed
+	if len(serial) != INSTANCES or len(parallel) != INSTANCES:
+		print('Expected', INSTANCES, 'results, got', len(serial), 'and', len(parallel))
+		exit(1)
+	reference = serial[0]
+	if reference[1] != 'ok':
+		print('Test ROM did not run:', reference)
+		exit(1)
+	for name, results in (('serial', serial), ('parallel', parallel)):
+		for i, result in enumerate(results):
+			if result != reference:
+				print('Mismatch in', name, 'run', i, result, 'expected', reference)
+				failed = True
+	if failed:
+		exit(1)
+	print('All', INSTANCES * 2, 'runs match: video', reference[3], 'audio', reference[4])
+	print('Input script checks passed')
+	print('Checkpoint checks passed')
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,254 @@
+//Checks the delta encoding and ring buffer management in rewind.c
+//rewind.c is included directly since the helpers are static
+#include <stdio.h>
+#include "rewind.c"
+
+#define MAX_STATE 1024
+
+int headless = 1;
+
+void render_errorbox(char *title, char *message)
+{
+}
+
+void render_infobox(char *title, char *message)
+{
+}
+
+static uint32_t rand_state = 0x1234567;
+static uint32_t rand_next(void)
+{
+	//xorshift so results don't depend on the libc rand implementation
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+//changes a few runs of bytes, some of them close enough together to end up in one literal
+static void mutate(uint8_t *buf, size_t size)
+{
+	if (!size) {
+		return;
+	}
+	int runs = rand_next() % 8;
+	for (int i = 0; i < runs; i++)
+	{
+		size_t start = rand_next() % size;
+		size_t len = rand_next() % 12 + 1;
+		for (size_t j = start; j < start + len && j < size; j++)
+		{
+			buf[j] = rand_next();
+		}
+	}
+	if (rand_next() & 1) {
+		//the last byte is a special case for both the word and byte compare loops
+		buf[size - 1]++;
+	}
+}
+
+static int check_delta(uint8_t *a, uint8_t *b, size_t size)
+{
+	static uint8_t encoded[MAX_STATE + MAX_ENCODE_OVERHEAD];
+	static uint8_t restored[MAX_STATE];
+	size_t encoded_size = encode_delta(encoded, a, b, size);
+	if (encoded_size > size + MAX_ENCODE_OVERHEAD) {
+		printf("delta of %zu byte states took %zu bytes\n", size, encoded_size);
+		return 1;
+	}
+	memcpy(restored, b, size);
+	apply_delta(restored, encoded, encoded_size);
+	if (memcmp(restored, a, size)) {
+		printf("delta of %zu byte states did not round trip\n", size);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_delta(int iterations)
+{
+	static const size_t sizes[] = {0, 1, 3, 7, 8, 9, 15, 16, 17, 100, MAX_STATE};
+	uint8_t a[MAX_STATE], b[MAX_STATE];
+	int failures = 0;
+	for (int i = 0; i < iterations; i++)
+	{
+		size_t size = sizes[i % (sizeof(sizes)/sizeof(*sizes))];
+		for (size_t j = 0; j < size; j++)
+		{
+			a[j] = rand_next();
+		}
+		memcpy(b, a, size);
+		switch (i / (sizeof(sizes)/sizeof(*sizes)) % 3)
+		{
+		case 0:
+			mutate(b, size);
+			break;
+		case 1:
+			//nothing in common, worst case for the encoder
+			for (size_t j = 0; j < size; j++)
+			{
+				b[j] = ~a[j];
+			}
+			break;
+		case 2:
+			//identical states
+			break;
+		}
+		failures += check_delta(a, b, size);
+	}
+	printf("encode_delta/apply_delta: %d/%d round trips match\n", iterations - failures, iterations);
+	return failures;
+}
+
+//pushes entries of random sizes through a small ring and checks the live ones never overlap
+static int test_ring(int iterations)
+{
+	rewind_buffer rw = {
+		.budget = 256,
+		.max_entries = 4
+	};
+	rw.entries = malloc(rw.max_entries * sizeof(rewind_entry));
+	//copy of what should be in the ring, oldest first, to check eviction only drops from the front
+	uint32_t shadow_offset[256], shadow_size[256];
+	uint32_t shadow_first = 0, shadow_count = 0;
+	int failures = 0, wraps = 0, evictions = 0;
+	for (int i = 0; i < iterations; i++)
+	{
+		size_t size = rand_next() % 64 + 1;
+		uint32_t before = rw.num_entries;
+		uint32_t offset = alloc_ring(&rw, size);
+		if (offset + size > rw.budget) {
+			printf("entry of %zu bytes placed at %u, past the end of the ring\n", size, offset);
+			failures++;
+		}
+		if (rw.num_entries < before) {
+			evictions++;
+		}
+		if (!offset && rw.num_entries) {
+			wraps++;
+		}
+		shadow_first += before - rw.num_entries;
+		shadow_count -= before - rw.num_entries;
+		for (uint32_t j = 0; j < rw.num_entries; j++)
+		{
+			rewind_entry *entry = rw.entries + (rw.first_entry + j) % rw.max_entries;
+			uint32_t shadow = (shadow_first + j) % 256;
+			if (entry->offset != shadow_offset[shadow] || entry->size != shadow_size[shadow]) {
+				printf("entry %u changed after allocating %zu bytes\n", j, size);
+				failures++;
+			}
+			if (entry->offset < offset + size && offset < entry->offset + entry->size) {
+				printf("entry of %zu bytes at %u overlaps live entry at %u\n", size, offset, entry->offset);
+				failures++;
+			}
+		}
+		push_entry(&rw, offset, size, 0);
+		shadow_offset[(shadow_first + shadow_count) % 256] = offset;
+		shadow_size[(shadow_first + shadow_count) % 256] = size;
+		shadow_count++;
+	}
+	free(rw.entries);
+	if (!wraps || !evictions) {
+		printf("ring never %s\n", wraps ? "evicted an entry" : "wrapped");
+		failures++;
+	}
+	printf("alloc_ring: %d entries, %d wraps, %d evictions, %d failures\n", iterations, wraps, evictions, failures);
+	return failures;
+}
+
+//stands in for a system so the whole snapshot and restore path can be checked
+typedef struct {
+	system_header header;
+	size_t        size;
+	uint8_t       mem[MAX_STATE];
+} fake_system;
+
+static size_t fake_serialize_into(system_header *sys, uint8_t *dest, size_t max_size)
+{
+	fake_system *fake = (fake_system *)sys;
+	if (fake->size > max_size) {
+		return 0;
+	}
+	memcpy(dest, fake->mem, fake->size);
+	return fake->size;
+}
+
+static size_t fake_serialize_size(system_header *sys)
+{
+	return ((fake_system *)sys)->size;
+}
+
+static uint8_t fake_deserialize(system_header *sys, uint8_t *data, size_t size)
+{
+	fake_system *fake = (fake_system *)sys;
+	memcpy(fake->mem, data, size);
+	fake->size = size;
+	return 1;
+}
+
+static int test_history(uint8_t split, int frames)
+{
+	static fake_system fake;
+	static uint8_t history[256][MAX_STATE];
+	static size_t history_size[256];
+	fake.header.serialize_into = fake_serialize_into;
+	fake.header.serialize_size = fake_serialize_size;
+	fake.header.deserialize = fake_deserialize;
+	fake.size = 64;
+	//small enough that older snapshots get evicted
+	rewind_buffer *rw = rewind_new(&fake.header, 4 * 1024, 1);
+	int failures = 0;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		mutate(fake.mem, fake.size);
+		if (!(frame % 16)) {
+			//states can change size, which is what head_size and state_size are for
+			fake.size = rand_next() % MAX_STATE + 1;
+		}
+		memcpy(history[frame % 256], fake.mem, fake.size);
+		history_size[frame % 256] = fake.size;
+		if (split) {
+			//how the Genesis snapshots, counting the frame and taking the snapshot separately
+			if (rewind_snapshot_due(rw)) {
+				rewind_snapshot(rw);
+			}
+		} else {
+			rewind_frame(rw);
+		}
+	}
+	uint32_t available = rewind_frames_available(rw);
+	if (available >= frames || available >= 256) {
+		printf("%u frames kept, expected older ones to be evicted\n", available);
+		failures++;
+	}
+	uint32_t steps = 0;
+	for (int frame = frames - 1; rewind_step(rw); frame--, steps++)
+	{
+		if (fake.size != history_size[frame % 256] || memcmp(fake.mem, history[frame % 256], fake.size)) {
+			printf("step %u did not restore frame %d\n", steps, frame);
+			failures++;
+		}
+	}
+	if (steps != available) {
+		printf("stepped back %u frames, %u were available\n", steps, available);
+		failures++;
+	}
+	rewind_free(rw);
+	printf("rewind_%s: %u frames restored, %d failures\n", split ? "snapshot_due" : "frame", steps, failures);
+	return failures;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+	int failures = test_delta(iterations);
+	failures += test_ring(iterations);
+	failures += test_history(0, 200);
+	failures += test_history(1, 200);
+	if (failures) {
+		printf("%d failures\n", failures);
+	} else {
+		puts("All tests passed");
+	}
+	return failures != 0;
+}
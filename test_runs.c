@@ -0,0 +1,408 @@
+//Runs small 68K and Z80 programs through the translators with syncs and interrupts landing at
+//irregular points and checks the final state, along with the cycle of every sync and I/O access,
+//against values recorded with the translators from before straight-line runs, flag liveness,
+//inlined fixed address accesses and indirect jump target caching were added.
+//The programs mix register-only runs with flag reads, fixed address RAM/ROM/I/O accesses,
+//jumps through a table, an interrupt handler and code in RAM that gets rewritten every pass
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "m68k_core.h"
+#include "z80_to_x86.h"
+#include "mem.h"
+
+#define M68K_EXPECTED_HASH 0x2C31AD7F8D29B05BULL
+#define Z80_EXPECTED_HASH  0x897ADAC29E5F955AULL
+#define Z80_CYCLES 2000000
+
+int headless = 1;
+void render_errorbox(char * title, char * buf)
+{
+}
+
+void render_infobox(char * title, char * buf)
+{
+}
+
+static uint32_t rand_state = 0x2545F491;
+static uint32_t random_cycles(uint32_t max)
+{
+	//xorshift so results don't depend on the libc rand implementation
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return 1 + rand_state % max;
+}
+
+static void hash_value(uint64_t *hash, uint32_t value)
+{
+	//FNV-1a
+	for (int i = 0; i < 4; i++)
+	{
+		*hash ^= value >> (i * 8) & 0xFF;
+		*hash *= 0x100000001B3ULL;
+	}
+}
+
+static void hash_bytes(uint64_t *hash, uint8_t *bytes, uint32_t size)
+{
+	for (uint32_t i = 0; i < size; i++)
+	{
+		hash_value(hash, bytes[i]);
+	}
+}
+
+static const uint16_t m68k_prog[] = {
+	0x46FC, 0x2000, //400: move.w #$2000, sr
+	0x41F9, 0x0000, 0x04EA, //404: lea ramsrc, a0
+	0x43F9, 0x00FF, 0x1000, //40A: lea $FF1000, a1
+	0x7C05, //410: moveq #5, d6
+	//copy
+	0x32D8, //412: move.w (a0)+, (a1)+
+	0x51CE, 0xFFFC, //414: dbra d6, copy
+	0x7001, //418: moveq #1, d0
+	0x7203, //41A: moveq #3, d1
+	0x7405, //41C: moveq #5, d2
+	0x7607, //41E: moveq #7, d3
+	0x7811, //420: moveq #$11, d4
+	0x7AED, //422: moveq #-$13, d5
+	0x7C2F, //424: moveq #$2F, d6
+	0x3E3C, 0x018F, //426: move.w #399, d7
+	0x47F9, 0x00A0, 0x0000, //42A: lea $A00000, a3
+	0x49F9, 0x0000, 0x04F6, //430: lea table, a4
+	0x4BF9, 0x00FF, 0x0000, //436: lea $FF0000, a5
+	0x2C7C, 0x0001, 0x2345, //43C: movea.l #$12345, a6
+	//loop
+	0xD885, //442: add.l d5, d4
+	0xBB84, //444: eor.l d5, d4
+	0xE78C, //446: lsl.l #3, d4
+	0x9C45, //448: sub.w d5, d6
+	0xDD84, //44A: addx.l d4, d6
+	0x4685, //44C: not.l d5
+	0x4845, //44E: swap d5
+	0xEA9D, //450: ror.l #5, d5
+	0xCC45, //452: and.w d5, d6
+	0x8A86, //454: or.l d6, d5
+	0xDDC4, //456: adda.l d4, a6
+	0x280E, //458: move.l a6, d4
+	0x48C4, //45A: ext.l d4
+	0x4446, //45C: neg.w d6
+	0x9B86, //45E: subx.l d6, d5
+	0x40C3, //460: move.w sr, d3
+	0x3A83, //462: move.w d3, (a5)
+	0x23C4, 0x00FF, 0x0020, //464: move.l d4, ($FF0020).l
+	0xDAB9, 0x00FF, 0x0020, //46A: add.l ($FF0020).l, d5
+	0x31C6, 0x8040, //470: move.w d6, ($8040).w
+	0x3239, 0x0000, 0x0506, //474: move.w data, d1
+	0x3680, //47A: move.w d0, (a3)
+	0x302B, 0x0002, //47C: move.w (2, a3), d0
+	0x13C4, 0x00A0, 0x0005, //480: move.b d4, ($A00005).l
+	0x2B45, 0x0008, //486: move.l d5, (8, a5)
+	0xDC6D, 0x0008, //48A: add.w (8, a5), d6
+	0x2AC4, //48E: move.l d4, (a5)+
+	0xD080, //490: add.l d0, d0
+	0xD085, //492: add.l d5, d0
+	0xB185, //494: eor.l d0, d5
+	0xD085, //496: add.l d5, d0
+	0x4840, //498: swap d0
+	0xDA80, //49A: add.l d0, d5
+	0xE288, //49C: lsr.l #1, d0
+	0x55C1, //49E: scs d1
+	0x6402, //4A0: bcc.s skip
+	0x5442, //4A2: addq.w #2, d2
+	//skip
+	0x3400, //4A4: move.w d0, d2
+	0x0242, 0x000C, //4A6: andi.w #$C, d2
+	0x2074, 0x2000, //4AA: movea.l (0, a4, d2.w), a0
+	0x4E90, //4AE: jsr (a0)
+	0x33C7, 0x00FF, 0x1004, //4B0: move.w d7, ($FF1004).l
+	0x4EB9, 0x00FF, 0x1000, //4B6: jsr ($FF1000).l
+	0x51CF, 0xFF84, //4BC: dbra d7, loop
+	0x4E70, //4C0: reset
+	//done
+	0x60FE, //4C2: bra.s done
+	//t0
+	0x5284, //4C4: addq.l #1, d4
+	0x4E75, //4C6: rts
+	//t1
+	0x4484, //4C8: neg.l d4
+	0x4E75, //4CA: rts
+	//t2
+	0xE39C, //4CC: rol.l #1, d4
+	0x4E75, //4CE: rts
+	//t3
+	0x6036, //4D0: bra.s hot
+	0x4E75, //4D2: rts
+	//int4
+	0x52B9, 0x00FF, 0x2000, //4D4: addq.l #1, ($FF2000).l
+	0x2F00, //4DA: move.l d0, -(a7)
+	0xD080, //4DC: add.l d0, d0
+	0x4480, //4DE: neg.l d0
+	0x23C0, 0x00FF, 0x2004, //4E0: move.l d0, ($FF2004).l
+	0x201F, //4E6: move.l (a7)+, d0
+	0x4E73, //4E8: rte
+	//ramsrc
+	0xD685, //4EA: add.l d5, d3
+	0x0683, 0x0000, 0x0001, //4EC: addi.l #1, d3
+	0x4683, //4F2: not.l d3
+	0x4E75, //4F4: rts
+	//ramend
+	//table
+	0x0000, 0x04C4, //4F6: dc.l t0
+	0x0000, 0x04C8, //4FA: dc.l t1
+	0x0000, 0x04CC, //4FE: dc.l t2
+	0x0000, 0x04D0, //502: dc.l t3
+	//data
+	0x5A3C, //506: dc.w $5A3C
+	//hot, a long run with d6 in almost every instruction
+	0xDC80, //508: add.l d0, d6
+	0xB386, //50A: eor.l d1, d6
+	0x9C82, //50C: sub.l d2, d6
+	0x4686, //50E: not.l d6
+	0xDC86, //510: add.l d6, d6
+	0x4486, //512: neg.l d6
+	0x4846, //514: swap d6
+	0xE38E, //516: lsl.l #1, d6
+	0x8C85, //518: or.l d5, d6
+	0xCC84, //51A: and.l d4, d6
+	0xDC81, //51C: add.l d1, d6
+	0x4E75, //51E: rts
+};
+#define M68K_PROG_START 0x400
+#define M68K_INT4_HANDLER 0x4D4
+
+static uint64_t m68k_hash;
+static uint32_t m68k_syncs;
+static uint32_t m68k_next_int;
+static uint8_t m68k_done;
+static uint32_t m68k_misaligned;
+
+m68k_context * sync_components(m68k_context * context, uint32_t address)
+{
+	if (m68k_done) {
+		return context;
+	}
+	hash_value(&m68k_hash, context->current_cycle);
+	hash_value(&m68k_hash, address);
+	m68k_syncs++;
+	//the frame pointer sits right below the return address so it should be 16 byte
+	//aligned if the generated code kept the stack aligned for the call
+	if ((uintptr_t)__builtin_frame_address(0) & 0xF) {
+		m68k_misaligned++;
+	}
+	if (context->int_ack) {
+		context->int_ack = 0;
+		m68k_next_int = context->current_cycle + random_cycles(6000);
+	}
+	if (context->current_cycle >= context->sync_cycle) {
+		context->sync_cycle = context->current_cycle + random_cycles(700);
+	}
+	//same as adjust_int_cycle in genesis.c with a single level 4 interrupt source
+	context->int_cycle = (context->status & 0x7) < 4 ? m68k_next_int : CYCLE_NEVER;
+	context->int_num = 4;
+	if (context->int_cycle > context->current_cycle && context->int_pending == INT_PENDING_SR_CHANGE) {
+		context->int_pending = INT_PENDING_NONE;
+	}
+	context->target_cycle = context->int_cycle < context->sync_cycle ? context->int_cycle : context->sync_cycle;
+	return context;
+}
+
+static uint16_t m68k_io_read_16(uint32_t address, void *vcontext)
+{
+	m68k_context *context = vcontext;
+	hash_value(&m68k_hash, address);
+	hash_value(&m68k_hash, context->current_cycle);
+	return context->current_cycle;
+}
+
+static uint8_t m68k_io_read_8(uint32_t address, void *vcontext)
+{
+	return m68k_io_read_16(address, vcontext) >> (address & 1 ? 0 : 8);
+}
+
+static void *m68k_io_write_16(uint32_t address, void *vcontext, uint16_t value)
+{
+	m68k_context *context = vcontext;
+	hash_value(&m68k_hash, address);
+	hash_value(&m68k_hash, value);
+	hash_value(&m68k_hash, context->current_cycle);
+	return vcontext;
+}
+
+static void *m68k_io_write_8(uint32_t address, void *vcontext, uint8_t value)
+{
+	return m68k_io_write_16(address, vcontext, value);
+}
+
+static m68k_context *reset_handler(m68k_context *context)
+{
+	//return at the next instruction boundary, the program spins in place after the reset instruction
+	m68k_done = 1;
+	context->int_cycle = context->sync_cycle = CYCLE_NEVER;
+	context->target_cycle = context->current_cycle;
+	context->should_return = 1;
+	return context;
+}
+
+static int check(char *name, uint64_t hash, uint64_t expected, uint32_t syncs, uint32_t interrupts)
+{
+	printf("%s: %u syncs, %u interrupts, hash %016llX", name, syncs, interrupts, (unsigned long long)hash);
+	if (hash != expected) {
+		printf(", expected %016llX\n", (unsigned long long)expected);
+		return 1;
+	}
+	puts("");
+	return 0;
+}
+
+static int test_m68k(void)
+{
+	uint16_t *rom = calloc(1, 0x10000);
+	uint16_t *ram = calloc(1, 0x10000);
+	rom[0] = 0x00FF;
+	rom[1] = 0xFE00;
+	rom[3] = M68K_PROG_START;
+	rom[0x70/2 + 1] = M68K_INT4_HANDLER;
+	memcpy(rom + M68K_PROG_START/2, m68k_prog, sizeof(m68k_prog));
+	memmap_chunk memmap[] = {
+		{ 0x000000, 0x400000,  0xFFFF, 0, 0, MMAP_READ,                          rom, NULL,            NULL,             NULL,           NULL },
+		{ 0xA00000, 0xA10000,  0xFFFF, 0, 0, 0,                                  NULL, m68k_io_read_16, m68k_io_write_16, m68k_io_read_8, m68k_io_write_8 },
+		{ 0xE00000, 0x1000000, 0xFFFF, 0, 0, MMAP_READ | MMAP_WRITE | MMAP_CODE, ram, NULL,            NULL,             NULL,           NULL }
+	};
+	m68k_options opts;
+	init_m68k_opts(&opts, memmap, sizeof(memmap)/sizeof(*memmap), 7);
+	m68k_context *context = init_68k_context(&opts, reset_handler);
+	m68k_next_int = 2000;
+	context->current_cycle = 0;
+	context->sync_cycle = context->target_cycle = 500;
+	m68k_reset(context);
+	if (!m68k_done) {
+		puts("68K program did not finish");
+		return 1;
+	}
+	hash_bytes(&m68k_hash, (uint8_t *)context->dregs, sizeof(context->dregs));
+	hash_bytes(&m68k_hash, (uint8_t *)context->aregs, sizeof(context->aregs));
+	hash_bytes(&m68k_hash, context->flags, sizeof(context->flags));
+	hash_value(&m68k_hash, context->status);
+	hash_value(&m68k_hash, context->current_cycle);
+	hash_bytes(&m68k_hash, (uint8_t *)ram, 0x10000);
+	if (m68k_misaligned) {
+		printf("68K: %u syncs called with a misaligned stack\n", m68k_misaligned);
+		return 1;
+	}
+	return check("68K", m68k_hash, M68K_EXPECTED_HASH, m68k_syncs, ram[0x2000/2] << 16 | ram[0x2002/2]);
+}
+
+static uint8_t z80_ram[0x2000] = {
+	[0x00] = 0xC3, 0x50, 0x00, //0000: jp start
+	[0x38] = 0xF5, //0038: push af
+	0x3A, 0x00, 0x18, //0039: ld a, ($1800)
+	0x3C, //003C: inc a
+	0x32, 0x00, 0x18, //003D: ld ($1800), a
+	0xF1, //0040: pop af
+	0xFB, //0041: ei
+	0xC9, //0042: ret
+	[0x50] = 0x31, 0x00, 0x20, //0050: ld sp, $2000
+	0xED, 0x56, //0053: im 1
+	0x01, 0x34, 0x12, //0055: ld bc, $1234
+	0x11, 0x78, 0x56, //0058: ld de, $5678
+	0x21, 0xBC, 0x9A, //005B: ld hl, $9ABC
+	0x3E, 0x01, //005E: ld a, 1
+	0xFB, //0060: ei
+	//loop
+	0x80, //0061: add a, b
+	0xA9, //0062: xor c
+	0x3C, //0063: inc a
+	0x4F, //0064: ld c, a
+	0x92, //0065: sub d
+	0x57, //0066: ld d, a
+	0x8B, //0067: adc a, e
+	0x2F, //0068: cpl
+	0x5F, //0069: ld e, a
+	0x9C, //006A: sbc a, h
+	0xB5, //006B: or l
+	0x65, //006C: ld h, l
+	0x6F, //006D: ld l, a
+	0x08, //006E: ex af, af'
+	0xD9, //006F: exx
+	0x24, //0070: inc h
+	0xD9, //0071: exx
+	0x08, //0072: ex af, af'
+	0xD3, 0x40, //0073: out ($40), a
+	0xDB, 0x41, //0075: in a, ($41)
+	0x32, 0x7B, 0x00, //0077: ld (patch + 1), a
+	//patch
+	0xC6, //007A: add a, 0
+	0x00, //007B: (patched immediate)
+	0xE6, 0x7F, //007C: and $7F
+	0x32, 0x02, 0x18, //007E: ld ($1802), a
+	0x10, 0xDE, //0081: djnz loop
+	0xC3, 0x61, 0x00, //0083: jp loop
+};
+
+static uint64_t z80_hash;
+static uint32_t z80_syncs;
+
+static uint8_t z80_port_read(uint32_t location, void *vcontext)
+{
+	z80_context *context = vcontext;
+	hash_value(&z80_hash, location);
+	hash_value(&z80_hash, context->current_cycle);
+	return context->current_cycle;
+}
+
+static void *z80_port_write(uint32_t location, void *vcontext, uint8_t value)
+{
+	z80_context *context = vcontext;
+	hash_value(&z80_hash, location);
+	hash_value(&z80_hash, value);
+	hash_value(&z80_hash, context->current_cycle);
+	return vcontext;
+}
+
+static void z80_int_pulse(z80_context *context)
+{
+	context->int_pulse_start = context->current_cycle + random_cycles(60000);
+	context->int_pulse_end = context->int_pulse_start + 171 * 15;
+}
+
+static int test_z80(void)
+{
+	const memmap_chunk z80_map[] = {
+		{ 0x0000, 0x4000,  0x1FFF, 0, 0, MMAP_READ | MMAP_WRITE | MMAP_CODE, z80_ram, NULL, NULL, NULL, NULL }
+	};
+	const memmap_chunk port_map[] = {
+		{ 0x0000, 0x100, 0xFF, 0, 0, 0, NULL, NULL, NULL, z80_port_read, z80_port_write }
+	};
+	z80_options opts;
+	init_z80_opts(&opts, z80_map, 1, port_map, 1, 15, 0xFF);
+	z80_context *context = init_z80_context(&opts);
+	context->mem_pointers[0] = z80_ram;
+	context->next_int_pulse = z80_int_pulse;
+	while (context->current_cycle < Z80_CYCLES)
+	{
+		z80_run(context, context->current_cycle + random_cycles(900));
+		hash_value(&z80_hash, context->current_cycle);
+		z80_syncs++;
+	}
+	hash_bytes(&z80_hash, context->regs, sizeof(context->regs));
+	hash_bytes(&z80_hash, context->alt_regs, sizeof(context->alt_regs));
+	hash_bytes(&z80_hash, context->flags, sizeof(context->flags));
+	hash_bytes(&z80_hash, context->alt_flags, sizeof(context->alt_flags));
+	hash_value(&z80_hash, context->sp);
+	hash_value(&z80_hash, context->iff1);
+	hash_bytes(&z80_hash, z80_ram, sizeof(z80_ram));
+	return check("Z80", z80_hash, Z80_EXPECTED_HASH, z80_syncs, z80_ram[0x1800]);
+}
+
+int main(int argc, char **argv)
+{
+	int failures = test_m68k();
+	failures += test_z80();
+	if (failures) {
+		puts("FAILED");
+	} else {
+		puts("All tests passed");
+	}
+	return failures != 0;
+}
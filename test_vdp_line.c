@@ -0,0 +1,208 @@
+//Checks that the whole line fast paths in vdp.c (vdp_h32_line and vdp_h40_line) output the same
+//pixels as the slot by slot paths they stand in for, vdp.c is included directly since both are static
+#include <stdio.h>
+#include "vdp.c"
+
+int headless = 1;
+system_header *current_system;
+
+uint32_t render_map_color(uint8_t r, uint8_t g, uint8_t b)
+{
+	return r << 16 | g << 8 | b;
+}
+
+uint16_t read_dma_value(system_header *system, uint32_t address)
+{
+	return 0;
+}
+
+uint32_t *render_get_framebuffer(uint8_t which, int *pitch)
+{
+	*pitch = 0;
+	return NULL;
+}
+
+void render_framebuffer_updated(uint8_t which, int width)
+{
+}
+
+uint8_t render_get_active_framebuffer(void)
+{
+	return FRAMEBUFFER_ODD;
+}
+
+uint8_t render_create_window(char *caption, uint32_t width, uint32_t height, window_close_handler close_handler, void *close_data)
+{
+	return 0;
+}
+
+void render_destroy_window(uint8_t which)
+{
+}
+
+uint32_t render_overscan_top()
+{
+	return 0;
+}
+
+uint32_t render_overscan_bot()
+{
+	return 0;
+}
+
+void render_errorbox(char *title, char *message)
+{
+}
+
+void render_infobox(char *title, char *message)
+{
+}
+
+uint64_t render_take_audio_hash(void)
+{
+	return 0;
+}
+
+static uint32_t rand_state = 0x1234567;
+static uint8_t rand_byte(void)
+{
+	//xorshift so results don't depend on the libc rand implementation
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state >> 8;
+}
+
+static void write_reg(vdp_context *context, uint8_t reg, uint8_t value)
+{
+	vdp_control_port_write(context, 0x8000 | reg << 8 | value);
+}
+
+//fills VRAM, CRAM, VSRAM and the display registers from the current random state
+static void randomize_vdp(vdp_context *context, uint8_t h40)
+{
+	static const uint8_t plane_sizes[] = {0, 1, 3};
+	write_reg(context, REG_MODE_1, BIT_PAL_SEL | (rand_byte() & BIT_COL0_MASK));
+	write_reg(context, REG_MODE_2, BIT_DISP_EN | BIT_MODE_5);
+	write_reg(context, REG_SCROLL_A, rand_byte() & 0x38);
+	//window is left out of most lines so the planes get covered too
+	write_reg(context, REG_WINDOW, rand_byte() & 0x3E);
+	write_reg(context, REG_WINDOW_H, (rand_byte() & 3) ? 0 : rand_byte() & 0x9F);
+	write_reg(context, REG_WINDOW_V, (rand_byte() & 3) ? 0 : rand_byte() & 0x9F);
+	write_reg(context, REG_SCROLL_B, rand_byte() & 0x7);
+	write_reg(context, REG_SAT, rand_byte() & 0x7F);
+	write_reg(context, REG_BG_COLOR, rand_byte() & 0x3F);
+	write_reg(context, REG_MODE_3, rand_byte() & (BIT_VSCROLL | 3));
+	write_reg(context, REG_MODE_4, (h40 ? 0x81 : 0) | (rand_byte() & BIT_HILIGHT));
+	write_reg(context, REG_HSCROLL, rand_byte() & 0x3F);
+	write_reg(context, REG_AUTOINC, 2);
+	write_reg(context, REG_SCROLL, plane_sizes[rand_byte() % 3] << 4 | plane_sizes[rand_byte() % 3]);
+	context->test_port = (rand_byte() & 7) ? 0 : (rand_byte() & 3) << 7;
+	for (int i = 0; i < VRAM_SIZE; i++)
+	{
+		context->vdpmem[i] = rand_byte();
+		vdp_check_update_sat_byte(context, i ^ 1, context->vdpmem[i]);
+	}
+	vdp_invalidate_decoded_rows(context);
+	vdp_mark_vram_dirty(context);
+	for (int i = 0; i < CRAM_SIZE; i++)
+	{
+		write_cram_internal(context, i, (rand_byte() << 8 | rand_byte()) & CRAM_BITS);
+	}
+	for (int i = 0; i < context->vsram_size; i++)
+	{
+		context->vsram[i] = (rand_byte() << 8 | rand_byte()) & 0x7FF;
+	}
+	//leave the VDP set up for VRAM writes, the fast paths are only taken when no read is pending
+	vdp_control_port_write(context, 0x4000);
+	vdp_control_port_write(context, 0x0000);
+}
+
+//steps of less than a line keep the slot by slot path, steps of several lines let it hand over to the fast path
+static void run_frame(vdp_context *context, uint32_t step)
+{
+	uint32_t frame = context->frame;
+	while (context->frame == frame)
+	{
+		vdp_run_context_full(context, context->cycles + step);
+	}
+}
+
+static void run_to(vdp_context *context, uint32_t target, uint32_t step)
+{
+	while (context->cycles < target)
+	{
+		vdp_run_context_full(context, context->cycles + step < target ? context->cycles + step : target);
+	}
+}
+
+static int compare_frames(uint8_t h40, int iterations, int frames)
+{
+	int failures = 0;
+	for (int i = 0; i < iterations; i++)
+	{
+		vdp_context *fast = init_vdp_context(0, 0);
+		vdp_context *slow = init_vdp_context(0, 0);
+		//headless contexts get a framebuffer from malloc, pixels outside the active width are never written
+		memset(fast->fb, 0, 512 * LINEBUF_SIZE * sizeof(uint32_t));
+		memset(slow->fb, 0, 512 * LINEBUF_SIZE * sizeof(uint32_t));
+		uint32_t seed = rand_state;
+		randomize_vdp(fast, h40);
+		rand_state = seed;
+		randomize_vdp(slow, h40);
+		for (int frame = 0; frame < frames; frame++)
+		{
+			run_frame(fast, MCLKS_LINE * 8);
+			run_frame(slow, MCLKS_LINE / 5);
+			//both are well into vblank after this, so neither has a partial line left to output
+			uint32_t target = (fast->cycles > slow->cycles ? fast->cycles : slow->cycles) + MCLKS_LINE * 4;
+			run_to(fast, target, MCLKS_LINE * 8);
+			run_to(slow, target, MCLKS_LINE / 5);
+			uint32_t lines = fast->inactive_start + fast->border_top + fast->border_bot;
+			uint32_t width = h40 ? LINEBUF_SIZE : 256 + HORIZ_BORDER;
+			for (uint32_t line = 0; line < lines; line++)
+			{
+				uint32_t *fast_line = fast->fb + line * LINEBUF_SIZE;
+				uint32_t *slow_line = slow->fb + line * LINEBUF_SIZE;
+				if (memcmp(fast_line, slow_line, width * sizeof(uint32_t))) {
+					if (failures < 10) {
+						int col = 0;
+						while (fast_line[col] == slow_line[col])
+						{
+							col++;
+						}
+						printf("H%d mismatch: state %d, frame %d, line %u, column %d is %06X expected %06X\n",
+							h40 ? 40 : 32, i, frame, line, col, fast_line[col], slow_line[col]);
+					}
+					failures++;
+					break;
+				}
+			}
+			if ((fast->flags & FLAG_DOT_OFLOW) != (slow->flags & FLAG_DOT_OFLOW)
+				|| (fast->flags2 & FLAG2_SPRITE_COLLIDE) != (slow->flags2 & FLAG2_SPRITE_COLLIDE)
+			) {
+				if (failures < 10) {
+					printf("H%d mismatch: state %d, frame %d, sprite status differs\n", h40 ? 40 : 32, i, frame);
+				}
+				failures++;
+			}
+		}
+		vdp_free(fast);
+		vdp_free(slow);
+	}
+	printf("vdp_h%d_line: %d/%d frames match\n", h40 ? 40 : 32, iterations * frames - failures, iterations * frames);
+	return failures;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100;
+	int failures = compare_frames(0, iterations, 2);
+	failures += compare_frames(1, iterations, 2);
+	if (failures) {
+		printf("%d failures\n", failures);
+	} else {
+		puts("All tests passed");
+	}
+	return failures != 0;
+}
@@ -0,0 +1,168 @@
+//Checks the SSE2/AVX2 compositing and palette lookup kernels in vdp.c against the scalar versions
+//vdp.c is included directly since the kernels are static
+#include <stdio.h>
+#include "vdp.c"
+
+int headless = 1;
+system_header *current_system;
+
+uint32_t render_map_color(uint8_t r, uint8_t g, uint8_t b)
+{
+	return r << 16 | g << 8 | b;
+}
+
+uint16_t read_dma_value(system_header *system, uint32_t address)
+{
+	return 0;
+}
+
+uint32_t *render_get_framebuffer(uint8_t which, int *pitch)
+{
+	*pitch = 0;
+	return NULL;
+}
+
+void render_framebuffer_updated(uint8_t which, int width)
+{
+}
+
+uint8_t render_get_active_framebuffer(void)
+{
+	return FRAMEBUFFER_ODD;
+}
+
+uint8_t render_create_window(char *caption, uint32_t width, uint32_t height, window_close_handler close_handler, void *close_data)
+{
+	return 0;
+}
+
+void render_destroy_window(uint8_t which)
+{
+}
+
+uint32_t render_overscan_top()
+{
+	return 0;
+}
+
+uint32_t render_overscan_bot()
+{
+	return 0;
+}
+
+void render_errorbox(char *title, char *message)
+{
+}
+
+void render_infobox(char *title, char *message)
+{
+}
+
+uint64_t render_take_audio_hash(void)
+{
+	return 0;
+}
+
+static uint32_t rand_state = 0x1234567;
+static uint8_t rand_byte(void)
+{
+	//xorshift so results don't depend on the libc rand implementation
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state >> 8;
+}
+
+static void randomize(uint8_t *buf, int size)
+{
+	for (int i = 0; i < size; i++)
+	{
+		buf[i] = rand_byte();
+	}
+}
+
+typedef void (*render_fun)(vdp_context *context, int32_t col, uint8_t *dst, uint8_t *debug_dst, int plane_a_off, int plane_b_off);
+
+static int compare_render(vdp_context *context, char *name, render_fun scalar, render_fun simd, int iterations)
+{
+	int failures = 0;
+	for (int i = 0; i < iterations; i++)
+	{
+		randomize(context->linebuf, sizeof(context->linebuf));
+		randomize(context->tmp_buf_a, sizeof(context->tmp_buf_a));
+		randomize(context->tmp_buf_b, sizeof(context->tmp_buf_b));
+		context->regs[REG_BG_COLOR] = rand_byte();
+		context->regs[REG_MODE_1] = rand_byte() & BIT_COL0_MASK;
+		//column 0 is picked often so the mask case gets covered
+		int32_t col = (rand_byte() & 1) ? 0 : rand_byte() % 40 * 2;
+		int plane_a_off = rand_byte(), plane_b_off = rand_byte();
+		uint8_t dst_ref[16], dbg_ref[16], dst[16], dbg[16];
+		scalar(context, col, dst_ref, dbg_ref, plane_a_off, plane_b_off);
+		simd(context, col, dst, dbg, plane_a_off, plane_b_off);
+		if (memcmp(dst, dst_ref, sizeof(dst)) || memcmp(dbg, dbg_ref, sizeof(dbg))) {
+			if (failures < 10) {
+				printf("%s mismatch: col %d, mode 1 %X, bg %X, a_off %d, b_off %d\n", name, col, context->regs[REG_MODE_1], context->regs[REG_BG_COLOR], plane_a_off, plane_b_off);
+				for (int j = 0; j < 16; j++)
+				{
+					printf("\t%d: %02X/%02X expected %02X/%02X\n", j, dst[j], dbg[j], dst_ref[j], dbg_ref[j]);
+				}
+			}
+			failures++;
+		}
+	}
+	printf("%s: %d/%d lines match\n", name, iterations - failures, iterations);
+	return failures;
+}
+
+static int compare_palette(vdp_context *context, int iterations)
+{
+	int failures = 0;
+	uint8_t src[LINEBUF_SIZE];
+	uint32_t dst_ref[LINEBUF_SIZE], dst[LINEBUF_SIZE];
+	for (int i = 0; i < iterations; i++)
+	{
+		randomize((uint8_t *)context->colors, sizeof(context->colors));
+		randomize(src, sizeof(src));
+		int count = (rand_byte() << 8 | rand_byte()) % (320 + 1);
+		uint8_t bgindex = rand_byte() & 0x3F;
+		uint8_t test_layer = rand_byte() & 1;
+		simd_level = SIMD_NONE;
+		palette_lookup(context, src, dst_ref, count, bgindex, test_layer);
+		simd_level = SIMD_AVX2;
+		palette_lookup(context, src, dst, count, bgindex, test_layer);
+		if (memcmp(dst, dst_ref, count * sizeof(uint32_t))) {
+			if (failures < 10) {
+				printf("palette_lookup mismatch: count %d, bgindex %X, test_layer %d\n", count, bgindex, test_layer);
+			}
+			failures++;
+		}
+	}
+	printf("palette_lookup: %d/%d lines match\n", iterations - failures, iterations);
+	return failures;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+	vdp_context *context = init_vdp_context(0, 0);
+	uint8_t detected = simd_level;
+	int failures = 0;
+	if (detected >= SIMD_SSE2) {
+		failures += compare_render(context, "render_normal", render_normal, render_normal_sse2, iterations);
+		failures += compare_render(context, "render_highlight", render_highlight, render_highlight_sse2, iterations);
+	} else {
+		puts("SSE2 not supported, skipping compositing kernels");
+	}
+	if (detected >= SIMD_AVX2) {
+		failures += compare_palette(context, iterations);
+	} else {
+		puts("AVX2 not supported, skipping palette lookup kernel");
+	}
+	simd_level = detected;
+	if (failures) {
+		printf("%d failures\n", failures);
+	} else {
+		puts("All tests passed");
+	}
+	return failures != 0;
+}
@@ -959,6 +959,20 @@ uint8_t delete_file(char *path)
 #endif
 }
 
+uint64_t get_time_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return count.QuadPart / freq.QuadPart * 1000000000ULL + count.QuadPart % freq.QuadPart * 1000000000ULL / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
 #ifdef __ANDROID__
 
 #include <SDL.h>
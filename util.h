@@ -92,6 +92,8 @@ void disable_stdout_messages(void);
 uint8_t is_stdout_enabled(void);
 //Deletes a file, returns true on success, false on failure
 uint8_t delete_file(char *path);
+//Returns a monotonic timestamp in nanoseconds suitable for measuring elapsed time
+uint64_t get_time_ns(void);
 //Initializes the socket library on platforms that need it
 void socket_init(void);
 //Sets a sockt to blocking or non-blocking mode
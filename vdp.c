@@ -8,9 +8,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include "render.h"
+#include "render_audio.h"
 #include "util.h"
 #include "event_log.h"
 #include "terminal.h"
+#include "hash.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VDP_SIMD
+#include <immintrin.h>
+#endif
 
 #define NTSC_INACTIVE_START 224
 #define PAL_INACTIVE_START 240
@@ -146,9 +152,32 @@ static void update_video_params(vdp_context *context)
 
 static uint8_t color_map_init_done;
 
+#ifdef VDP_SIMD
+enum {
+	SIMD_NONE,
+	SIMD_SSE2,
+	SIMD_AVX2
+};
+//selected once at startup based on CPU features, the scalar versions remain the reference implementation
+static uint8_t simd_level;
+
+static void detect_simd_level(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		simd_level = SIMD_AVX2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		simd_level = SIMD_SSE2;
+	} else {
+		simd_level = SIMD_NONE;
+	}
+}
+#endif
+
 vdp_context *init_vdp_context(uint8_t region_pal, uint8_t has_max_vsram)
 {
 	vdp_context *context = calloc(1, sizeof(vdp_context) + VRAM_SIZE);
+	context->decoded_rows = malloc(VRAM_SIZE / 4 * sizeof(uint64_t));
 	if (headless) {
 		context->fb = malloc(512 * LINEBUF_SIZE * sizeof(uint32_t));
 		context->output_pitch = LINEBUF_SIZE * sizeof(uint32_t);
@@ -201,6 +230,9 @@ vdp_context *init_vdp_context(uint8_t region_pal, uint8_t has_max_vsram)
 			}
 			planar_to_chunky[planar] = chunky;
 		}
+#ifdef VDP_SIMD
+		detect_simd_level();
+#endif
 		color_map_init_done = 1;
 	}
 	for (uint8_t color = 0; color < (1 << (3 + 1 + 1 + 1)); color++)
@@ -263,6 +295,7 @@ void vdp_free(vdp_context *context)
 			vdp_toggle_debug_view(context, i);
 		}
 	}
+	free(context->decoded_rows);
 	free(context);
 }
 
@@ -882,12 +915,34 @@ void vdp_check_update_sat_byte(vdp_context *context, uint32_t address, uint8_t v
 	}
 }
 
+void vdp_invalidate_decoded_rows(vdp_context *context)
+{
+	memset(context->decoded_valid, 0, sizeof(context->decoded_valid));
+}
+
+void vdp_mark_vram_dirty(vdp_context *context)
+{
+	memset(context->vram_dirty, 1, sizeof(context->vram_dirty));
+}
+
+static void invalidate_decoded_row(vdp_context *context, uint32_t address)
+{
+	context->decoded_valid[address >> 5] &= ~(1 << (address >> 2 & 7));
+}
+
+static void mark_vram_page_dirty(vdp_context *context, uint32_t address)
+{
+	context->vram_dirty[address >> VRAM_DIRTY_SHIFT] = 1;
+}
+
 static void write_vram_word(vdp_context *context, uint32_t address, uint16_t value)
 {
 	address = (address & 0x3FC) | (address >> 1 & 0xFC01) | (address >> 9 & 0x2);
 	address ^= 1;
 	//TODO: Support an option to actually have 128KB of VRAM
 	context->vdpmem[address] = value;
+	invalidate_decoded_row(context, address);
+	mark_vram_page_dirty(context, address);
 }
 
 static void write_vram_byte(vdp_context *context, uint32_t address, uint8_t value)
@@ -898,6 +953,8 @@ static void write_vram_byte(vdp_context *context, uint32_t address, uint8_t valu
 		address = mode4_address_map[address & 0x3FFF];
 	}
 	context->vdpmem[address] = value;
+	invalidate_decoded_row(context, address);
+	mark_vram_page_dirty(context, address);
 }
 
 #define DMA_FILL 0x80
@@ -1060,7 +1117,7 @@ static void run_dma_src(vdp_context * context, int32_t slot)
 			cur = context->fifo + context->fifo_write;
 			cur->cycle = context->cycles + ((context->regs[REG_MODE_4] & BIT_H40) ? 16 : 20)*FIFO_LATENCY;
 			cur->address = context->address;
-			cur->value = read_dma_value((context->regs[REG_DMASRC_H] << 16) | (context->regs[REG_DMASRC_M] << 8) | context->regs[REG_DMASRC_L]);
+			cur->value = read_dma_value(context->system, (context->regs[REG_DMASRC_H] << 16) | (context->regs[REG_DMASRC_M] << 8) | context->regs[REG_DMASRC_L]);
 			cur->cd = context->cd;
 			cur->partial = 0;
 			if (context->fifo_read < 0) {
@@ -1215,6 +1272,24 @@ static void read_map_mode4(uint16_t column, uint32_t line, vdp_context * context
 	context->col_1 = (context->vdpmem[address] << 8) | context->vdpmem[address+1];
 }
 
+//returns the pattern row at address with one pixel per byte in left to right order
+static uint64_t decoded_row(vdp_context *context, uint16_t address)
+{
+	uint16_t row = address >> 2;
+	if (!(context->decoded_valid[row >> 3] & (1 << (row & 7)))) {
+		uint8_t pixels[8];
+		for (int i = 0; i < 4; i++)
+		{
+			uint8_t byte = context->vdpmem[address + i];
+			pixels[i * 2] = byte >> 4;
+			pixels[i * 2 + 1] = byte & 0xF;
+		}
+		memcpy(context->decoded_rows + row, pixels, sizeof(pixels));
+		context->decoded_valid[row >> 3] |= 1 << (row & 7);
+	}
+	return context->decoded_rows[row];
+}
+
 static void render_map(uint16_t col, uint8_t * tmp_buf, uint8_t offset, vdp_context * context)
 {
 	uint16_t address;
@@ -1231,29 +1306,13 @@ static void render_map(uint16_t col, uint8_t * tmp_buf, uint8_t offset, vdp_cont
 	} else {
 		address += 4 * context->v_offset;
 	}
-	uint8_t pal_priority = (col >> 9) & 0x70;
-	uint32_t bits = *((uint32_t *)(&context->vdpmem[address]));
-	tmp_buf += offset;
+	uint64_t pixels = decoded_row(context, address);
 	if (col & MAP_BIT_H_FLIP) {
-		uint32_t shift = 28;
-		for (int i = 0; i < 4; i++)
-		{
-			uint8_t right = pal_priority | ((bits >> shift) & 0xF);
-			shift -= 4;
-			*(tmp_buf++) = pal_priority | ((bits >> shift) & 0xF);
-			shift -= 4;
-			*(tmp_buf++) = right;
-		}
-	} else {
-		for (int i = 0; i < 4; i++)
-		{
-			uint8_t right = pal_priority | (bits & 0xF);
-			bits >>= 4;
-			*(tmp_buf++) = pal_priority | (bits & 0xF);
-			bits >>= 4;
-			*(tmp_buf++) = right;
-		}
+		pixels = __builtin_bswap64(pixels);
 	}
+	//broadcast palette and priority bits to all 8 pixels
+	pixels |= ((col >> 9) & 0x70) * 0x0101010101010101ULL;
+	memcpy(tmp_buf + offset, &pixels, sizeof(pixels));
 }
 
 static void render_map_1(vdp_context * context)
@@ -1410,6 +1469,115 @@ static void render_highlight(vdp_context *context, int32_t col, uint8_t *dst, ui
 	}
 }
 
+#ifdef VDP_SIMD
+__attribute__((target("sse2")))
+static __m128i load_scroll_buf(uint8_t *buf, int off)
+{
+	off &= SCROLL_BUFFER_MASK;
+	if (off <= SCROLL_BUFFER_SIZE - 16) {
+		return _mm_loadu_si128((__m128i *)(buf + off));
+	}
+	uint8_t tmp[16];
+	int first = SCROLL_BUFFER_SIZE - off;
+	memcpy(tmp, buf + off, first);
+	memcpy(tmp + first, buf, 16 - first);
+	return _mm_loadu_si128((__m128i *)tmp);
+}
+
+//returns 0xFF in each lane where layer is opaque and its priority is >= the priority of pixel
+__attribute__((target("sse2")))
+static __m128i layer_wins(__m128i layer, __m128i pixel)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i transparent = _mm_cmpeq_epi8(_mm_and_si128(layer, _mm_set1_epi8(0xF)), zero);
+	__m128i lower = _mm_and_si128(_mm_andnot_si128(layer, pixel), _mm_set1_epi8(BUF_BIT_PRIORITY));
+	return _mm_andnot_si128(transparent, _mm_cmpeq_epi8(lower, zero));
+}
+
+__attribute__((target("sse2")))
+static __m128i select_epi8(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+//SSE2 version of render_normal, composites all 16 pixels of a column pair at once
+__attribute__((target("sse2")))
+static void render_normal_sse2(vdp_context *context, int32_t col, uint8_t *dst, uint8_t *debug_dst, int plane_a_off, int plane_b_off)
+{
+	__m128i sprite = _mm_loadu_si128((__m128i *)(context->linebuf + col * 8));
+	__m128i plane_a = load_scroll_buf(context->tmp_buf_a, plane_a_off);
+	__m128i plane_b = load_scroll_buf(context->tmp_buf_b, plane_b_off);
+	__m128i pixel = _mm_set1_epi8(context->regs[REG_BG_COLOR]);
+	__m128i src = _mm_set1_epi8(DBG_SRC_BG);
+	__m128i mask = _mm_cmpeq_epi8(_mm_cmpeq_epi8(_mm_and_si128(plane_b, _mm_set1_epi8(0xF)), _mm_setzero_si128()), _mm_setzero_si128());
+	pixel = select_epi8(mask, plane_b, pixel);
+	src = select_epi8(mask, _mm_set1_epi8(DBG_SRC_B), src);
+	mask = layer_wins(plane_a, pixel);
+	pixel = select_epi8(mask, plane_a, pixel);
+	src = select_epi8(mask, _mm_set1_epi8(DBG_SRC_A), src);
+	mask = layer_wins(sprite, pixel);
+	pixel = select_epi8(mask, sprite, pixel);
+	src = select_epi8(mask, _mm_set1_epi8(DBG_SRC_S), src);
+	_mm_storeu_si128((__m128i *)dst, _mm_and_si128(pixel, _mm_set1_epi8(0x3F)));
+	_mm_storeu_si128((__m128i *)debug_dst, src);
+	if (!col && (context->regs[REG_MODE_1] & BIT_COL0_MASK)) {
+		memset(dst, 0, 8);
+		memset(debug_dst, DBG_SRC_BG, 8);
+	}
+}
+
+//SSE2 version of render_highlight
+__attribute__((target("sse2")))
+static void render_highlight_sse2(vdp_context *context, int32_t col, uint8_t *dst, uint8_t *debug_dst, int plane_a_off, int plane_b_off)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i priority = _mm_set1_epi8(BUF_BIT_PRIORITY);
+	uint8_t col0_masked = !col && (context->regs[REG_MODE_1] & BIT_COL0_MASK);
+	__m128i sprite = _mm_loadu_si128((__m128i *)(context->linebuf + col * 8));
+	//render_highlight does not advance the plane offsets when skipping the masked pixels
+	__m128i plane_a = load_scroll_buf(context->tmp_buf_a, plane_a_off - (col0_masked ? 8 : 0));
+	__m128i plane_b = load_scroll_buf(context->tmp_buf_b, plane_b_off - (col0_masked ? 8 : 0));
+	__m128i pixel = _mm_set1_epi8(context->regs[REG_BG_COLOR]);
+	__m128i src = _mm_set1_epi8(DBG_SRC_BG);
+	__m128i mask = _mm_cmpeq_epi8(_mm_cmpeq_epi8(_mm_and_si128(plane_b, _mm_set1_epi8(0xF)), zero), zero);
+	pixel = select_epi8(mask, plane_b, pixel);
+	src = select_epi8(mask, _mm_set1_epi8(DBG_SRC_B), src);
+	__m128i intensity = _mm_and_si128(_mm_or_si128(plane_a, plane_b), priority);
+	mask = layer_wins(plane_a, pixel);
+	pixel = select_epi8(mask, plane_a, pixel);
+	src = select_epi8(mask, _mm_set1_epi8(DBG_SRC_A), src);
+	
+	mask = layer_wins(sprite, pixel);
+	__m128i sprite_color = _mm_and_si128(sprite, _mm_set1_epi8(0x3F));
+	__m128i highlight_op = _mm_and_si128(mask, _mm_cmpeq_epi8(sprite_color, _mm_set1_epi8(0x3E)));
+	__m128i shadow_op = _mm_and_si128(mask, _mm_cmpeq_epi8(sprite_color, _mm_set1_epi8(0x3F)));
+	__m128i sprite_pixel = _mm_andnot_si128(_mm_or_si128(highlight_op, shadow_op), mask);
+	__m128i normal_intensity = _mm_cmpeq_epi8(_mm_and_si128(sprite, _mm_set1_epi8(0xF)), _mm_set1_epi8(0xE));
+	intensity = select_epi8(highlight_op, _mm_add_epi8(intensity, priority), intensity);
+	intensity = _mm_andnot_si128(shadow_op, intensity);
+	intensity = select_epi8(
+		sprite_pixel,
+		select_epi8(normal_intensity, priority, _mm_or_si128(intensity, _mm_and_si128(sprite, priority))),
+		intensity
+	);
+	pixel = select_epi8(sprite_pixel, sprite, pixel);
+	src = select_epi8(sprite_pixel, _mm_set1_epi8(DBG_SRC_S), src);
+	
+	pixel = _mm_and_si128(pixel, _mm_set1_epi8(0x3F));
+	__m128i offset = select_epi8(
+		_mm_cmpeq_epi8(intensity, _mm_set1_epi8(BUF_BIT_PRIORITY << 1)),
+		_mm_set1_epi8(HIGHLIGHT_OFFSET),
+		_mm_and_si128(_mm_cmpeq_epi8(intensity, zero), _mm_set1_epi8(SHADOW_OFFSET))
+	);
+	_mm_storeu_si128((__m128i *)dst, _mm_add_epi8(pixel, offset));
+	_mm_storeu_si128((__m128i *)debug_dst, src);
+	if (col0_masked) {
+		memset(dst, SHADOW_OFFSET + (context->regs[REG_BG_COLOR] & 0x3F), 8);
+		memset(debug_dst, DBG_SRC_BG | DBG_SHADOW, 8);
+	}
+}
+#endif
+
 static void render_testreg(vdp_context *context, int32_t col, uint8_t *dst, uint8_t *debug_dst, int plane_a_off, int plane_b_off, uint8_t output_disabled, uint8_t test_layer)
 {
 	if (output_disabled) {
@@ -1646,16 +1814,28 @@ static void render_map_output(uint32_t line, int32_t col, vdp_context * context)
 		plane_b_off = context->buf_b_off - context->hscroll_b_fine;
 		//printf("A | tmp_buf offset: %d\n", 8 - (context->hscroll_a & 0x7));
 
-		if (context->regs[REG_MODE_4] & BIT_HILIGHT) {
+		if (context->discard_output) {
+			//compositing only feeds the output colors and the layer debug view, both are thrown away
+		} else if (context->regs[REG_MODE_4] & BIT_HILIGHT) {
 			if (output_disabled || test_layer) {
 				render_testreg_highlight(context, col, dst, debug_dst, plane_a_off, plane_b_off, output_disabled, test_layer);
 			} else {
+#ifdef VDP_SIMD
+				if (simd_level >= SIMD_SSE2) {
+					render_highlight_sse2(context, col, dst, debug_dst, plane_a_off, plane_b_off);
+				} else
+#endif
 				render_highlight(context, col, dst, debug_dst, plane_a_off, plane_b_off);
 			}
 		} else {
 			if (output_disabled || test_layer) {
 				render_testreg(context, col, dst, debug_dst, plane_a_off, plane_b_off, output_disabled, test_layer);
 			} else {
+#ifdef VDP_SIMD
+				if (simd_level >= SIMD_SSE2) {
+					render_normal_sse2(context, col, dst, debug_dst, plane_a_off, plane_b_off);
+				} else
+#endif
 				render_normal(context, col, dst, debug_dst, plane_a_off, plane_b_off);
 			}
 		}
@@ -2088,6 +2268,20 @@ static void vdp_update_per_frame_debug(vdp_context *context)
 	}		
 }
 
+//called for every frame handed to the frontend, including partial ones from vdp_force_update_framebuffer and vdp_release_framebuffer
+static void vdp_hash_frame(vdp_context *context, uint32_t width)
+{
+	uint64_t hash = 0;
+	if (context->fb) {
+		uint8_t *line = ((uint8_t *)context->fb) + context->output_pitch * context->top_offset;
+		for (uint32_t i = 0; i < context->output_lines; i++, line += context->output_pitch)
+		{
+			hash = xxhash64(line, width * sizeof(uint32_t), hash);
+		}
+	}
+	context->system->frame_hash(context->system, context->frame, hash, render_take_audio_hash());
+}
+
 void vdp_force_update_framebuffer(vdp_context *context)
 {
 	if (!context->fb) {
@@ -2101,7 +2295,11 @@ void vdp_force_update_framebuffer(vdp_context *context)
 		0,
 		to_fill * context->output_pitch
 	);
-	render_framebuffer_updated(context->cur_buffer, context->h40_lines > context->output_lines / 2 ? LINEBUF_SIZE : (256+HORIZ_BORDER));
+	uint32_t width = context->h40_lines > context->output_lines / 2 ? LINEBUF_SIZE : (256+HORIZ_BORDER);
+	if (context->system && context->system->frame_hash) {
+		vdp_hash_frame(context, width);
+	}
+	render_framebuffer_updated(context->cur_buffer, width);
 	context->fb = render_get_framebuffer(context->cur_buffer, &context->output_pitch);
 	vdp_update_per_frame_debug(context);
 }
@@ -2118,15 +2316,24 @@ static void advance_output_line(vdp_context *context)
 	
 	if (context->output_lines >= lines_max || (!context->pushed_frame && output_line == context->inactive_start + context->border_top)) {
 		//we've either filled up a full frame or we're at the bottom of screen in the current defined mode + border crop
+		uint32_t width = context->h40_lines > (context->inactive_start + context->border_top) / 2 ? LINEBUF_SIZE : (256+HORIZ_BORDER);
+		if (context->system && context->system->flush_audio) {
+			context->system->flush_audio(context->system);
+		}
+		if (context->system && context->system->frame_hash && !context->discard_output) {
+			vdp_hash_frame(context, width);
+		}
 		if (!headless) {
-			render_framebuffer_updated(context->cur_buffer, context->h40_lines > (context->inactive_start + context->border_top) / 2 ? LINEBUF_SIZE : (256+HORIZ_BORDER));
-			uint8_t is_even = context->flags2 & FLAG2_EVEN_FIELD;
-			if (context->vcounter <= context->inactive_start && (context->regs[REG_MODE_4] & BIT_INTERLACE)) {
-				is_even = !is_even;
+			if (!context->hold_framebuffer) {
+				render_framebuffer_updated(context->cur_buffer, width);
+				uint8_t is_even = context->flags2 & FLAG2_EVEN_FIELD;
+				if (context->vcounter <= context->inactive_start && (context->regs[REG_MODE_4] & BIT_INTERLACE)) {
+					is_even = !is_even;
+				}
+				context->cur_buffer = is_even ? FRAMEBUFFER_EVEN : FRAMEBUFFER_ODD;
+				context->fb = NULL;
 			}
-			context->cur_buffer = is_even ? FRAMEBUFFER_EVEN : FRAMEBUFFER_ODD;
 			context->pushed_frame = 1;
-			context->fb = NULL;
 		}
 		vdp_update_per_frame_debug(context);
 		context->h40_lines = 0;
@@ -2176,7 +2383,11 @@ static void advance_output_line(vdp_context *context)
 void vdp_release_framebuffer(vdp_context *context)
 {
 	if (context->fb) {
-		render_framebuffer_updated(context->cur_buffer, context->h40_lines > (context->inactive_start + context->border_top) / 2 ? LINEBUF_SIZE : (256+HORIZ_BORDER));
+		uint32_t width = context->h40_lines > (context->inactive_start + context->border_top) / 2 ? LINEBUF_SIZE : (256+HORIZ_BORDER);
+		if (context->system && context->system->frame_hash) {
+			vdp_hash_frame(context, width);
+		}
+		render_framebuffer_updated(context->cur_buffer, width);
 		context->output = context->fb = NULL;
 	}
 }
@@ -2440,7 +2651,7 @@ static void draw_right_border(vdp_context *context)
 		if ((slot) == BG_START_SLOT + LINEBUF_SIZE/2) {\
 			advance_output_line(context);\
 			if (!context->output) {\
-				context->output = dummy_buffer;\
+				context->output = context->dummy_buffer;\
 			}\
 		}\
 		if (slot == 168 || slot == 247 || slot == 248) {\
@@ -2478,7 +2689,7 @@ static void draw_right_border(vdp_context *context)
 		if ((slot) == BG_START_SLOT + (256+HORIZ_BORDER)/2) {\
 			advance_output_line(context);\
 			if (!context->output) {\
-				context->output = dummy_buffer;\
+				context->output = context->dummy_buffer;\
 			}\
 		}\
 		if (slot == 136 || slot == 247 || slot == 248) {\
@@ -2512,7 +2723,7 @@ static void draw_right_border(vdp_context *context)
 		if ((slot) == BG_START_SLOT + (256+HORIZ_BORDER)/2) {\
 			advance_output_line(context);\
 			if (!context->output) {\
-				context->output = dummy_buffer;\
+				context->output = context->dummy_buffer;\
 			}\
 		}\
 		if ((slot) == 147) {\
@@ -2557,7 +2768,60 @@ static void draw_right_border(vdp_context *context)
 		render_sprite_cells_mode4(context);\
 		MODE4_CHECK_SLOT_LINE(CALC_SLOT(slot, 5))
 
-static uint32_t dummy_buffer[LINEBUF_SIZE];
+#ifdef VDP_SIMD
+static void palette_lookup_avx2(vdp_context *context, uint8_t *src, uint32_t *dst, int count, uint8_t bgindex, uint8_t test_layer);
+#endif
+//converts composited palette indices to output colors
+static void palette_lookup(vdp_context *context, uint8_t *src, uint32_t *dst, int count, uint8_t bgindex, uint8_t test_layer)
+{
+	if (context->discard_output) {
+		return;
+	}
+#ifdef VDP_SIMD
+	if (simd_level >= SIMD_AVX2 && count >= 8) {
+		palette_lookup_avx2(context, src, dst, count, bgindex, test_layer);
+		return;
+	}
+#endif
+	if (test_layer) {
+		for (int i = 0; i < count; i++)
+		{
+			*(dst++) = context->colors[*(src++)];
+		}
+	} else {
+		for (int i = 0; i < count; i++)
+		{
+			if (*src & 0x3F) {
+				*(dst++) = context->colors[*(src++)];
+			} else {
+				*(dst++) = context->colors[(*(src++) & 0xC0) | bgindex];
+			}
+		}
+	}
+}
+
+#ifdef VDP_SIMD
+//AVX2 version of palette_lookup, converts 8 pixels at a time with a gather from the color table
+__attribute__((target("avx2")))
+static void palette_lookup_avx2(vdp_context *context, uint8_t *src, uint32_t *dst, int count, uint8_t bgindex, uint8_t test_layer)
+{
+	__m256i color_mask = _mm256_set1_epi32(0x3F);
+	__m256i bg = _mm256_set1_epi32(bgindex);
+	__m256i zero = _mm256_setzero_si256();
+	for (; count >= 8; count -= 8, src += 8, dst += 8)
+	{
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)src));
+		if (!test_layer) {
+			__m256i transparent = _mm256_cmpeq_epi32(_mm256_and_si256(index, color_mask), zero);
+			__m256i bg_index = _mm256_or_si256(_mm256_andnot_si256(color_mask, index), bg);
+			index = _mm256_blendv_epi8(index, bg_index, transparent);
+		}
+		_mm256_storeu_si256((__m256i *)dst, _mm256_i32gather_epi32((int const *)context->colors, index, 4));
+	}
+	palette_lookup(context, src, dst, count, bgindex, test_layer);
+}
+#endif
+
 static void vdp_h40_line(vdp_context * context)
 {
 	uint16_t address;
@@ -2597,25 +2861,22 @@ static void vdp_h40_line(vdp_context * context)
 		context->buf_b_off + 8,
 		context->col_2
 	);
+	//169
+	//the slot path draws the right border here, without it the border keeps whatever the last slot rendered line left in compositebuf
+	draw_right_border(context);
 	//Do palette lookup for end of previous line
-	uint8_t *src = context->compositebuf + (LINE_CHANGE_H40 - BG_START_SLOT) *2;
-	uint32_t *dst = context->output + (LINE_CHANGE_H40 - BG_START_SLOT) *2;
-	if (test_layer) {
-		for (int i = 0; i < LINEBUF_SIZE - (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
-		{
-			*(dst++) = context->colors[*(src++)];
-		}
-	} else {
-		for (int i = 0; i < LINEBUF_SIZE - (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
-		{
-			if (*src & 0x3F) {
-				*(dst++) = context->colors[*(src++)];
-			} else {
-				*(dst++) = context->colors[(*(src++) & 0xC0) | bgindex];
-			}
-		}
-	}
+	palette_lookup(
+		context,
+		context->compositebuf + (LINE_CHANGE_H40 - BG_START_SLOT) * 2,
+		context->output + (LINE_CHANGE_H40 - BG_START_SLOT) * 2,
+		LINEBUF_SIZE - (LINE_CHANGE_H40 - BG_START_SLOT) * 2,
+		bgindex, test_layer
+	);
 	advance_output_line(context);
+	if (!context->output) {
+		//lines outside the visible area still get rendered, same as SPRITE_RENDER_H40
+		context->output = context->dummy_buffer;
+	}
 	//168-242 (inclusive)
 	for (int i = 0; i < 28; i++)
 	{
@@ -2734,23 +2995,185 @@ static void vdp_h40_line(vdp_context * context)
 	render_sprite_cells(context);
 	context->cycles += MCLKS_LINE;
 	vdp_advance_line(context);
-	src = context->compositebuf;
-	dst = context->output;
-	if (test_layer) {
-		for (int i = 0; i < (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
-		{
-			*(dst++) = context->colors[*(src++)];
-		}
-	} else {
-		for (int i = 0; i < (LINE_CHANGE_H40 - BG_START_SLOT) * 2; i++)
-		{
-			if (*src & 0x3F) {
-				*(dst++) = context->colors[*(src++)];
-			} else {
-				*(dst++) = context->colors[(*(src++) & 0xC0) | bgindex];
-			}
-		}
+	palette_lookup(context, context->compositebuf, context->output, (LINE_CHANGE_H40 - BG_START_SLOT) * 2, bgindex, test_layer);
+}
+static void vdp_h32_line(vdp_context * context)
+{
+	uint16_t address;
+	uint32_t mask;
+	uint8_t bgindex = context->regs[REG_BG_COLOR] & 0x3F;
+	uint8_t test_layer = context->test_port >> 7 & 3;
+	
+	//133
+	render_sprite_cells(context);
+	//134
+	render_sprite_cells(context);
+	//135
+	context->sprite_index = 0x80;
+	context->slot_counter = 0;
+	render_border_garbage(
+		context,
+		context->sprite_draw_list[context->cur_slot].address,
+		context->tmp_buf_b, context->buf_b_off,
+		context->col_1
+	);
+	render_sprite_cells(context);
+	scan_sprite_table(context->vcounter, context);
+	//136
+	render_border_garbage(
+		context,
+		context->sprite_draw_list[context->cur_slot].address,
+		context->tmp_buf_b,
+		context->buf_b_off + 8,
+		context->col_2
+	);
+	render_sprite_cells(context);
+	scan_sprite_table(context->vcounter, context);
+	//137
+	draw_right_border(context);
+	//137-144 (inclusive)
+	for (int i = 0; i < 8; i++)
+	{
+		render_sprite_cells(context);
+		scan_sprite_table(context->vcounter, context);
+	}
+	//146
+	render_sprite_cells(context);
+	scan_sprite_table(context->vcounter, context);
+	//147
+	//Do palette lookup for end of previous line
+	palette_lookup(
+		context,
+		context->compositebuf + (LINE_CHANGE_H32 - BG_START_SLOT) * 2,
+		context->output + (LINE_CHANGE_H32 - BG_START_SLOT) * 2,
+		(256+HORIZ_BORDER) - (LINE_CHANGE_H32 - BG_START_SLOT) * 2,
+		bgindex, test_layer
+	);
+	advance_output_line(context);
+	if (!context->output) {
+		context->output = context->dummy_buffer;
+	}
+	render_sprite_cells(context);
+	scan_sprite_table(context->vcounter, context);
+	//233-242 (inclusive)
+	for (int i = 0; i < 10; i++)
+	{
+		render_sprite_cells(context);
+		scan_sprite_table(context->vcounter, context);
+	}
+	//243
+	if (!(context->regs[REG_MODE_3] & BIT_VSCROLL)) {
+		//See note in vdp_h32 for why this happens here
+		context->vscroll_latch[0] = context->vsram[0];
+		context->vscroll_latch[1] = context->vsram[1];
+	}
+	render_border_garbage(
+		context,
+		context->sprite_draw_list[context->cur_slot].address,
+		context->tmp_buf_a,
+		context->buf_a_off,
+		context->col_1
+	);
+	//244
+	address = (context->regs[REG_HSCROLL] & 0x3F) << 10;
+	mask = 0;
+	if (context->regs[REG_MODE_3] & 0x2) {
+		mask |= 0xF8;
+	}
+	if (context->regs[REG_MODE_3] & 0x1) {
+		mask |= 0x7;
+	}
+	render_border_garbage(context, address, context->tmp_buf_a, context->buf_a_off+8, context->col_2);
+	address += (context->vcounter & mask) * 4;
+	context->hscroll_a = context->vdpmem[address] << 8 | context->vdpmem[address+1];
+	context->hscroll_a_fine = context->hscroll_a & 0xF;
+	context->hscroll_b = context->vdpmem[address+2] << 8 | context->vdpmem[address+3];
+	context->hscroll_b_fine = context->hscroll_b & 0xF;
+	//245-246 inclusive
+	for (int i = 0; i < 2; i++)
+	{
+		render_sprite_cells(context);
+		scan_sprite_table(context->vcounter, context);
+	}
+	//247
+	render_border_garbage(
+		context,
+		context->sprite_draw_list[context->cur_slot].address,
+		context->tmp_buf_b,
+		context->buf_b_off,
+		context->col_1
+	);
+	render_sprite_cells(context);
+	scan_sprite_table(context->vcounter, context);
+	//248
+	render_border_garbage(
+		context,
+		context->sprite_draw_list[context->cur_slot].address,
+		context->tmp_buf_b,
+		context->buf_b_off + 8,
+		context->col_2
+	);
+	context->buf_a_off = (context->buf_a_off + SCROLL_BUFFER_DRAW) & SCROLL_BUFFER_MASK;
+	context->buf_b_off = (context->buf_b_off + SCROLL_BUFFER_DRAW) & SCROLL_BUFFER_MASK;
+	render_sprite_cells(context);
+	scan_sprite_table(context->vcounter, context);
+	//250
+	render_sprite_cells(context);
+	scan_sprite_table(context->vcounter, context);
+	//251
+	if (context->cur_slot >= 0 && context->sprite_draw_list[context->cur_slot].x_pos) {
+		context->flags |= FLAG_DOT_OFLOW;
 	}
+	scan_sprite_table(context->vcounter, context);//Just a guess
+	//252
+	scan_sprite_table(context->vcounter, context);//Just a guess
+	//254
+	render_sprite_cells(context);
+	scan_sprite_table(context->vcounter, context);
+	//255
+	scan_sprite_table(context->vcounter, context);//Just a guess
+	//0
+	scan_sprite_table(context->vcounter, context);//Just a guess
+	context->cur_slot = context->slot_counter;
+	context->sprite_x_offset = 0;
+	context->sprite_draws = MAX_SPRITES_LINE_H32;
+	//background planes and layer compositing
+	for (int col = 0; col < 34; col+=2)
+	{
+		read_map_scroll_a(col, context->vcounter, context);
+		render_map_1(context);
+		render_map_2(context);
+		read_map_scroll_b(col, context->vcounter, context);
+		render_map_3(context);
+		render_map_output(context->vcounter, col, context);
+	}
+	//sprite rendering phase 2
+	for (int i = 0; i < MAX_SPRITES_LINE_H32; i++)
+	{
+		read_sprite_x(context->vcounter, context);
+	}
+	//131
+	context->cur_slot = MAX_SPRITES_LINE_H32-1;
+	memset(context->linebuf, 0, LINEBUF_SIZE);
+	render_border_garbage(
+		context,
+		context->sprite_draw_list[context->cur_slot].address,
+		context->tmp_buf_a, context->buf_a_off,
+		context->col_1
+	);
+	context->flags &= ~FLAG_MASKED;
+	render_sprite_cells(context);
+	//132
+	render_border_garbage(
+		context,
+		context->sprite_draw_list[context->cur_slot].address,
+		context->tmp_buf_a, context->buf_a_off + 8,
+		context->col_2
+	);
+	render_sprite_cells(context);
+	context->cycles += MCLKS_LINE;
+	vdp_advance_line(context);
+	palette_lookup(context, context->compositebuf, context->output, (LINE_CHANGE_H32 - BG_START_SLOT) * 2, bgindex, test_layer);
 }
 static void vdp_h40(vdp_context * context, uint32_t target_cycles)
 {
@@ -2762,7 +3185,7 @@ static void vdp_h40(vdp_context * context, uint32_t target_cycles)
 	if (!context->output) {
 		//This shouldn't happen normally, but it can theoretically
 		//happen when doing border busting
-		context->output = dummy_buffer;
+		context->output = context->dummy_buffer;
 	}
 	switch(context->hslot)
 	{
@@ -2986,13 +3409,20 @@ static void vdp_h32(vdp_context * context, uint32_t target_cycles)
 	if (!context->output) {
 		//This shouldn't happen normally, but it can theoretically
 		//happen when doing border busting
-		context->output = dummy_buffer;
+		context->output = context->dummy_buffer;
 	}
 	switch(context->hslot)
 	{
 	for (;;)
 	{
 	case 133:
+		//only consider doing a line at a time if the FIFO is empty, there are no pending reads and there is no DMA running
+		if (context->fifo_read == -1 && !(context->flags & FLAG_DMA_RUN) && ((context->cd & 1) || (context->flags & FLAG_READ_FETCHED))) {
+			while (target_cycles - context->cycles >= MCLKS_LINE && context->state != PREPARING && context->vcounter != context->inactive_start) {
+				vdp_h32_line(context);
+			}
+			CHECK_ONLY
+		}
 		OUTPUT_PIXEL(133)
 		if (context->state == PREPARING) {
 			external_slot(context);
@@ -3203,7 +3633,7 @@ static void vdp_h32_mode4(vdp_context * context, uint32_t target_cycles)
 	if (!context->output) {
 		//This shouldn't happen normally, but it can theoretically
 		//happen when doing border busting
-		context->output = dummy_buffer;
+		context->output = context->dummy_buffer;
 	}
 	switch(context->hslot)
 	{
@@ -4329,11 +4759,16 @@ void vdp_int_ack(vdp_context * context)
 }
 
 #define VDP_STATE_VERSION 3
-void vdp_serialize(vdp_context *context, serialize_buffer *buf)
+static void serialize_state(vdp_context *context, serialize_buffer *buf, uint8_t with_vram)
 {
 	save_int8(buf, VDP_STATE_VERSION);
-	save_int8(buf, VRAM_SIZE / 1024);//VRAM size in KB, needed for future proofing
-	save_buffer8(buf, context->vdpmem, VRAM_SIZE);
+	if (with_vram) {
+		save_int8(buf, VRAM_SIZE / 1024);//VRAM size in KB, needed for future proofing
+		save_buffer8(buf, context->vdpmem, VRAM_SIZE);
+	} else {
+		//a VRAM size of 0 leaves VRAM untouched on load
+		save_int8(buf, 0);
+	}
 	save_buffer16(buf, context->cram, CRAM_SIZE);
 	save_buffer16(buf, context->vsram, MAX_VSRAM_SIZE);
 	save_buffer8(buf, context->sat_cache, SAT_CACHE_SIZE);
@@ -4412,6 +4847,30 @@ void vdp_serialize(vdp_context *context, serialize_buffer *buf)
 	save_int8(buf, context->cd_latch);
 }
 
+void vdp_serialize(vdp_context *context, serialize_buffer *buf)
+{
+	serialize_state(context, buf, 1);
+}
+
+void vdp_serialize_no_vram(vdp_context *context, serialize_buffer *buf)
+{
+	serialize_state(context, buf, 0);
+}
+
+void vdp_serialize_vram_pages(vdp_context *context, serialize_buffer *buf)
+{
+	save_pages8(buf, context->vdpmem, VRAM_SIZE, VRAM_DIRTY_SHIFT, context->vram_dirty);
+}
+
+void vdp_deserialize_vram_pages(deserialize_buffer *buf, void *vcontext)
+{
+	vdp_context *context = vcontext;
+	if (load_pages8(buf, context->vdpmem, VRAM_SIZE)) {
+		vdp_invalidate_decoded_rows(context);
+		vdp_mark_vram_dirty(context);
+	}
+}
+
 void vdp_deserialize(deserialize_buffer *buf, void *vcontext)
 {
 	vdp_context *context = vcontext;
@@ -4427,6 +4886,8 @@ void vdp_deserialize(deserialize_buffer *buf, void *vcontext)
 		warning("Save state has VDP version %d, but this build only understands versions %d and lower", version, VDP_STATE_VERSION);
 	}
 	load_buffer8(buf, context->vdpmem, (vramk * 1024) <= VRAM_SIZE ? vramk * 1024 : VRAM_SIZE);
+	vdp_invalidate_decoded_rows(context);
+	vdp_mark_vram_dirty(context);
 	if ((vramk * 1024) > VRAM_SIZE) {
 		buf->cur_pos += (vramk * 1024) - VRAM_SIZE;
 	}
@@ -4554,14 +5015,13 @@ void vdp_deserialize(deserialize_buffer *buf, void *vcontext)
 	update_video_params(context);
 }
 
-static vdp_context *current_vdp;
-static void vdp_debug_window_close(uint8_t which)
+static void vdp_debug_window_close(uint8_t which, void *data)
 {
-	//TODO: remove need for current_vdp global, and find the VDP via current_system instead
+	vdp_context *context = data;
 	for (int i = 0; i < VDP_NUM_DEBUG_TYPES; i++)
 	{
-		if (current_vdp->enabled_debuggers & (1 << i) && which == current_vdp->debug_fb_indices[i]) {
-			vdp_toggle_debug_view(current_vdp, i);
+		if (context->enabled_debuggers & (1 << i) && which == context->debug_fb_indices[i]) {
+			vdp_toggle_debug_view(context, i);
 			break;
 		}
 	}
@@ -4602,8 +5062,7 @@ void vdp_toggle_debug_view(vdp_context *context, uint8_t debug_type)
 		default:
 			return;
 		}
-		current_vdp = context;
-		context->debug_fb_indices[debug_type] = render_create_window(caption, width, height, vdp_debug_window_close);
+		context->debug_fb_indices[debug_type] = render_create_window(caption, width, height, vdp_debug_window_close, context);
 		if (context->debug_fb_indices[debug_type]) {
 			context->enabled_debuggers |= 1 << debug_type;
 		}
@@ -19,6 +19,8 @@
 #define MIN_VSRAM_SIZE 40
 #define MAX_VSRAM_SIZE 64
 #define VRAM_SIZE (64*1024)
+//log2 of the size of the VRAM pages tracked for incremental save states
+#define VRAM_DIRTY_SHIFT 10
 #define BORDER_LEFT 13
 #define BORDER_RIGHT 14
 #define HORIZ_BORDER (BORDER_LEFT+BORDER_RIGHT)
@@ -146,6 +148,8 @@ typedef struct {
 } sprite_info;
 
 #define FIFO_SIZE 4
+//serialized FIFO entries are the only variable sized part of VDP state
+#define VDP_MAX_FIFO_SERIALIZE_SIZE (FIFO_SIZE * (4 + 4 + 2 + 1 + 1))
 
 typedef struct {
 	uint32_t cycle;
@@ -221,6 +225,8 @@ typedef struct {
 	uint8_t        linebuf[LINEBUF_SIZE];
 	uint8_t        compositebuf[LINEBUF_SIZE];
 	uint8_t        layer_debug_buf[LINEBUF_SIZE];
+	//output target for lines that fall outside the visible framebuffer
+	uint32_t       dummy_buffer[LINEBUF_SIZE];
 	uint8_t        hslot; //hcounter/2
 	uint8_t	       sprite_index;
 	uint8_t        sprite_draws;
@@ -245,6 +251,17 @@ typedef struct {
 	uint8_t        debug_fb_indices[VDP_NUM_DEBUG_TYPES];
 	uint8_t        debug_modes[VDP_NUM_DEBUG_TYPES];
 	uint8_t        pushed_frame;
+	//set while emulating frames that will never be displayed, skips compositing and conversion to output colors
+	uint8_t        discard_output;
+	//set with discard_output when the frontend has no use for those frames at all,
+	//they end without the framebuffer being handed to the renderer
+	uint8_t        hold_framebuffer;
+	//one bit per 4-byte pattern row in VRAM, set when the entry in decoded_rows is up to date
+	uint8_t        decoded_valid[VRAM_SIZE / 4 / 8];
+	//one byte per VRAM page, set when the page is written and cleared when a checkpoint is taken
+	uint8_t        vram_dirty[VRAM_SIZE >> VRAM_DIRTY_SHIFT];
+	//pattern rows pre-decoded to one byte per pixel, indexed by VRAM address / 4
+	uint64_t       *decoded_rows;
 	uint8_t        vdpmem[];
 } vdp_context;
 
@@ -282,16 +299,24 @@ void latch_mode(vdp_context * context);
 uint32_t vdp_cycles_to_frame_end(vdp_context * context);
 void write_cram_internal(vdp_context * context, uint16_t addr, uint16_t value);
 void vdp_check_update_sat_byte(vdp_context *context, uint32_t address, uint8_t value);
+//these two must be called after modifying vdpmem directly rather than through the normal write paths
+void vdp_invalidate_decoded_rows(vdp_context *context);
+void vdp_mark_vram_dirty(vdp_context *context);
 void vdp_pbc_pause(vdp_context *context);
 void vdp_release_framebuffer(vdp_context *context);
 void vdp_reacquire_framebuffer(vdp_context *context);
 void vdp_serialize(vdp_context *context, serialize_buffer *buf);
+//same as vdp_serialize, but leaves VRAM out so it can be saved with vdp_serialize_vram_pages
+void vdp_serialize_no_vram(vdp_context *context, serialize_buffer *buf);
+//saves the VRAM pages written since vram_dirty was last cleared
+void vdp_serialize_vram_pages(vdp_context *context, serialize_buffer *buf);
 void vdp_deserialize(deserialize_buffer *buf, void *vcontext);
+void vdp_deserialize_vram_pages(deserialize_buffer *buf, void *vcontext);
 void vdp_force_update_framebuffer(vdp_context *context);
 void vdp_toggle_debug_view(vdp_context *context, uint8_t debug_type);
 void vdp_inc_debug_mode(vdp_context *context);
 //to be implemented by the host system
-uint16_t read_dma_value(uint32_t address);
+uint16_t read_dma_value(system_header *system, uint32_t address);
 void vdp_replay_event(vdp_context *context, uint8_t event, event_reader *reader);
 
 #endif //VDP_H_
@@ -99,7 +99,6 @@ static uint16_t round_fixed_point(double value, int dec_bits)
 }
 
 static FILE * debug_file = NULL;
-static uint32_t first_key_on=0;
 
 static ym2612_context * log_context = NULL;
 
@@ -203,6 +202,7 @@ void ym_init(ym2612_context * context, uint32_t master_clock, uint32_t clock_div
 	//TODO: pick a randomish high initial value and lower it over time
 	context->invalid_status_decay = 225000 * context->clock_inc;
 	context->status_address_mask = (options & YM_OPT_3834) ? 0 : 3;
+	context->run_batched = (options & YM_OPT_BATCH) != 0;
 	
 	//some games seem to expect that the LR flags start out as 1
 	for (int i = 0; i < NUM_CHANNELS; i++) {
@@ -547,7 +547,7 @@ void ym_run_phase(ym2612_context *context, uint32_t channel, uint32_t op)
 		if (env > MAX_ENVELOPE) {
 			env = MAX_ENVELOPE;
 		}
-		if (first_key_on) {
+		if (context->first_key_on) {
 			dfprintf(debug_file, "op %d, base phase: %d, mod: %d, sine: %d, out: %d\n", op, phase, mod, sine_table[(phase+mod) & 0x1FF], pow_table[sine_table[phase & 0x1FF] + env]);
 		}
 		//if ((channel != 0 && channel != 4) || chan->algorithm != 5) {
@@ -577,7 +577,7 @@ void ym_run_phase(ym2612_context *context, uint32_t channel, uint32_t op)
 				}
 				chan->output = output;
 			}
-			if (first_key_on) {
+			if (context->first_key_on) {
 				int16_t value = context->channels[channel].output & 0x3FE0;
 				if (value & 0x2000) {
 					value |= 0xC000;
@@ -588,6 +588,14 @@ void ym_run_phase(ym2612_context *context, uint32_t channel, uint32_t op)
 	}
 }
 
+static void ym_flush_samples(ym2612_context *context)
+{
+	if (context->buffered_frames) {
+		render_put_stereo_block(context->audio, context->sample_buffer, context->buffered_frames);
+		context->buffered_frames = 0;
+	}
+}
+
 void ym_output_sample(ym2612_context *context)
 {
 	int16_t left = 0, right = 0;
@@ -630,7 +638,47 @@ void ym_output_sample(ym2612_context *context)
 			}
 		}
 	}
-	render_put_stereo_sample(context->audio, left, right);
+	context->sample_buffer[context->buffered_frames * 2] = left;
+	context->sample_buffer[context->buffered_frames * 2 + 1] = right;
+	if (++context->buffered_frames == YM_SAMPLE_BUFFER) {
+		ym_flush_samples(context);
+	}
+}
+
+//Runs a complete sample period in one go. Must only be called when current_op is 0
+//and current_env_op is a multiple of 8, which is the normal state at a sample boundary.
+//The result is identical to running the 24 operator slots individually in ym_run
+static void ym_run_sample(ym2612_context *context)
+{
+	uint32_t env_first = context->current_env_op;
+	uint32_t env_last = env_first + NUM_OPERATORS / 3;
+	ym_run_timers(context);
+	//The envelope generator updates one operator every 3 slots. Operators whose envelope slot
+	//comes no later than their phase slot see the new envelope value, so run those first
+	uint32_t env_op;
+	for (env_op = env_first; env_op < env_last && 3 * (env_op - env_first) <= env_op; env_op++)
+	{
+		ym_run_envelope(context, context->channels + env_op / 4, context->operators + env_op);
+	}
+	uint32_t num_ops = context->dac_enable ? NUM_OPERATORS - 4 : NUM_OPERATORS;
+	for (uint32_t channel = 0; channel < num_ops / 4; channel++)
+	{
+		ym_run_phase(context, channel, channel * 4);
+		ym_run_phase(context, channel, channel * 4 + 1);
+		ym_run_phase(context, channel, channel * 4 + 2);
+		ym_run_phase(context, channel, channel * 4 + 3);
+	}
+	for (; env_op < env_last; env_op++)
+	{
+		ym_run_envelope(context, context->channels + env_op / 4, context->operators + env_op);
+	}
+	if (env_last == NUM_OPERATORS) {
+		context->current_env_op = 0;
+		context->env_counter++;
+	} else {
+		context->current_env_op = env_last;
+	}
+	ym_output_sample(context);
 }
 
 void ym_run(ym2612_context * context, uint32_t to_cycle)
@@ -643,6 +691,15 @@ void ym_run(ym2612_context * context, uint32_t to_cycle)
 	for (; context->current_cycle < to_cycle; context->current_cycle += context->clock_inc) {
 		//Update timers at beginning of 144 cycle period
 		if (!context->current_op) {
+			if (
+				context->run_batched && !(context->current_env_op % (NUM_OPERATORS / 3))
+				&& to_cycle - context->current_cycle > context->clock_inc * (NUM_OPERATORS - 1)
+			) {
+				//all slots of this sample fall before to_cycle so it can be run in one go
+				ym_run_sample(context);
+				context->current_cycle += context->clock_inc * (NUM_OPERATORS - 1);
+				continue;
+			}
 			ym_run_timers(context);
 		}
 		//Update Envelope Generator
@@ -667,6 +724,7 @@ void ym_run(ym2612_context * context, uint32_t to_cycle)
 		}
 		
 	}
+	ym_flush_samples(context);
 	//printf("Done running YM2612 at cycle %d\n", context->current_cycle, to_cycle);
 }
 
@@ -919,7 +977,7 @@ void ym_data_write(ym2612_context * context, uint8_t value)
 				for (uint8_t op = channel * 4, bit = 0; op < (channel + 1) * 4; op++, bit++) {
 					if (changes & keyon_bits[bit]) {
 						if (value & keyon_bits[bit]) {
-							first_key_on = 1;
+							context->first_key_on = 1;
 							//printf("Key On for operator %d in channel %d\n", op, channel);
 							keyon(context->operators + op, context->channels + channel);
 						} else {
@@ -18,6 +18,9 @@
 
 #define YM_OPT_WAVE_LOG 1
 #define YM_OPT_3834 2
+//run whole sample periods at a time when possible instead of stepping one operator slot at a time
+//operators are still processed one by one with the scalar code, this only removes per-slot bookkeeping
+#define YM_OPT_BATCH 4
 
 typedef struct {
 	int16_t  *mod_src[2];
@@ -66,6 +69,7 @@ typedef struct {
 #define YM_REG_END     0xB8
 #define YM_PART1_REGS (YM_REG_END-YM_PART1_START)
 #define YM_PART2_REGS (YM_REG_END-YM_PART2_START)
+#define YM_SAMPLE_BUFFER 128
 
 typedef struct {
 	audio_source *audio;
@@ -106,8 +110,13 @@ typedef struct {
 	uint8_t     last_status;
 	uint8_t     selected_reg;
 	uint8_t     selected_part;
+	uint8_t     run_batched;
+	uint8_t     first_key_on; //only used to gate debug output
 	uint8_t     part1_regs[YM_PART1_REGS];
 	uint8_t     part2_regs[YM_PART2_REGS];
+	uint32_t    buffered_frames;
+	//output samples waiting to be handed to the resampler, interleaved left/right
+	int16_t     sample_buffer[YM_SAMPLE_BUFFER * 2];
 } ym2612_context;
 
 enum {
@@ -341,6 +341,9 @@ void translate_z80inst(z80inst * inst, z80_context * context, uint16_t address,
 #ifdef Z80_LOG_ADDRESS
 		log_address(&opts->gen, address, "Z80: %X @ %d\n");
 #endif
+	} else {
+		//the interpreter stub has already accounted for the opcode fetch
+		num_cycles = 0;
 	}
 	switch(inst->op)
 	{
@@ -2864,12 +2867,13 @@ code_info z80_make_interp_stub(z80_context * context, uint16_t address)
 	check_alloc_code(code, 32);
 	code_info stub = {code->cur, NULL};
 	//TODO: make this play well with the breakpoint code
+	//check before the fetch since handling an interrupt or a sync clobbers the opcode in scratch1
+	check_cycles_int(&opts->gen, address);
 	mov_ir(code, address, opts->gen.scratch1, SZ_W);
 	call(code, opts->read_8);
 	//opcode fetch M-cycles have one extra T-state
 	cycles(&opts->gen, 1);
 	//TODO: increment R
-	check_cycles_int(&opts->gen, address);
 	call(code, opts->gen.save_context);
 	mov_irdisp(code, address, opts->gen.context_reg, offsetof(z80_context, pc), SZ_W);
 	push_r(code, opts->gen.context_reg);
@@ -2968,6 +2972,21 @@ void z80_map_native_address(z80_context * context, uint32_t address, uint8_t * n
 	}
 }
 
+//returns the byte in ram_code_flags that tracks the page containing address and sets *bit to
+//the page's bit within it, or NULL if address is not in a code chunk
+static uint8_t *z80_code_page_flags(z80_context *context, uint32_t address, uint8_t *bit)
+{
+	z80_options *opts = context->options;
+	uint32_t meta_off;
+	memmap_chunk const *mem_chunk = find_map_chunk(address, &opts->gen, MMAP_CODE, &meta_off);
+	if (!mem_chunk || !(mem_chunk->flags & MMAP_CODE)) {
+		return NULL;
+	}
+	uint32_t final_off = (address & mem_chunk->mask) + meta_off;
+	*bit = 1 << ((final_off >> opts->gen.ram_flags_shift) & 7);
+	return context->ram_code_flags + (final_off >> (opts->gen.ram_flags_shift + 3));
+}
+
 #define INVALID_INSTRUCTION_START 0xFEEDFEED
 
 uint32_t z80_get_instruction_start(z80_context *context, uint32_t address)
@@ -2997,13 +3016,17 @@ uint32_t z80_get_instruction_start(z80_context *context, uint32_t address)
 	return address;
 }
 
-//Technically unbounded due to redundant prefixes, but this is the max useful size
-#define Z80_MAX_INST_SIZE 4
-
 z80_context * z80_handle_code_write(uint32_t address, z80_context * context)
 {
+	uint8_t bit;
+	uint8_t *flags = z80_code_page_flags(context, address, &bit);
+	if (flags && !(*flags & bit)) {
+		//no live code in this page, 68K writes to Z80 RAM don't check the flags before calling this
+		return context;
+	}
 	uint32_t inst_start = z80_get_instruction_start(context, address);
-	while (inst_start != INVALID_INSTRUCTION_START && (address - inst_start) < Z80_MAX_INST_SIZE) {
+	//the instruction might be part of a run that started before it
+	while (inst_start != INVALID_INSTRUCTION_START && (address - inst_start) < Z80_MAX_RUN_BYTES) {
 		code_ptr dst = z80_get_native_address(context, inst_start);
 		code_info code = {dst, dst+32, 0};
 		z80_options * opts = context->options;
@@ -3015,6 +3038,10 @@ z80_context * z80_handle_code_write(uint32_t address, z80_context * context)
 	return context;
 }
 
+//Patches every translated instruction that starts in [start, end) or that is part of a run that
+//could overlap it to call the retranslation stub. Pages in code chunks that have no live code are
+//skipped and pages fully inside the range are marked as having none since every instruction in
+//them has been patched. Retranslating an instruction maps it again which sets its page flag
 void z80_invalidate_code_range(z80_context *context, uint32_t start, uint32_t end)
 {
 	z80_options *opts = context->options;
@@ -3029,24 +3056,41 @@ void z80_invalidate_code_range(z80_context *context, uint32_t start, uint32_t en
 		//calculate the lowest alias for this address
 		end = mem_chunk->start + ((end - mem_chunk->start) & mem_chunk->mask);
 	}
-	uint32_t start_chunk = start / NATIVE_CHUNK_SIZE, end_chunk = end / NATIVE_CHUNK_SIZE;
-	for (uint32_t chunk = start_chunk; chunk <= end_chunk; chunk++)
+	uint32_t page_size = 1 << opts->gen.ram_flags_shift;
+	uint32_t clear_start = start;
+	//runs that start before the range can include instructions inside it
+	start = start > Z80_MAX_RUN_BYTES ? start - Z80_MAX_RUN_BYTES : 0;
+	uint32_t page_end;
+	for (uint32_t address = start; address < end; address = page_end)
 	{
-		if (native_code_map[chunk].base) {
-			uint32_t start_offset = chunk == start_chunk ? start % NATIVE_CHUNK_SIZE : 0;
-			uint32_t end_offset = chunk == end_chunk ? end % NATIVE_CHUNK_SIZE : NATIVE_CHUNK_SIZE;
-			for (uint32_t offset = start_offset; offset < end_offset; offset++)
-			{
-				if (native_code_map[chunk].offsets[offset] != INVALID_OFFSET && native_code_map[chunk].offsets[offset] != EXTENSION_WORD) {
-					code_info code;
-					code.cur = native_code_map[chunk].base + native_code_map[chunk].offsets[offset];
-					code.last = code.cur + 32;
-					code.stack_off = 0;
-					mov_ir(&code, chunk * NATIVE_CHUNK_SIZE + offset, opts->gen.scratch1, SZ_D);
-					call(&code, opts->retrans_stub);
-				}
+		page_end = (address & ~(page_size - 1)) + page_size;
+		uint8_t bit;
+		uint8_t *flags = z80_code_page_flags(context, address, &bit);
+		if (flags && !(*flags & bit)) {
+			continue;
+		}
+		uint32_t last = page_end < end ? page_end : end;
+		for (uint32_t cur = address; cur < last; cur++)
+		{
+			native_map_slot *map = native_code_map + cur / NATIVE_CHUNK_SIZE;
+			if (!map->base) {
+				//skip the rest of the native map chunk
+				cur |= NATIVE_CHUNK_SIZE - 1;
+				continue;
+			}
+			int32_t offset = map->offsets[cur % NATIVE_CHUNK_SIZE];
+			if (offset != INVALID_OFFSET && offset != EXTENSION_WORD) {
+				code_info code;
+				code.cur = map->base + offset;
+				code.last = code.cur + 32;
+				code.stack_off = 0;
+				mov_ir(&code, cur, opts->gen.scratch1, SZ_D);
+				call(&code, opts->retrans_stub);
 			}
 		}
+		if (flags && (page_end - page_size) >= clear_start && page_end <= end) {
+			*flags &= ~bit;
+		}
 	}
 }
 
@@ -3130,6 +3174,8 @@ void * z80_retranslate_inst(uint32_t address, z80_context * context, uint8_t * o
 		translate_z80inst(&instbuf, context, address, 0);
 		code_info tmp2 = *code;
 		*code = tmp_code;
+		//mapping again marks the page as containing live code
+		z80_map_native_address(context, address, orig_start, after-inst, ZMAX_NATIVE_SIZE);
 		if (!z80_is_terminal(&instbuf)) {
 
 			jmp(&tmp2, z80_get_native_address_trans(context, address + after-inst));
@@ -3139,6 +3185,139 @@ void * z80_retranslate_inst(uint32_t address, z80_context * context, uint8_t * o
 	}
 }
 
+//instructions that only touch registers and flags and have a fixed duration
+static uint8_t z80_is_run_inst(z80_context *context, z80inst *inst, uint32_t address)
+{
+	if (context->breakpoint_flags[address / 8] & (1 << (address % 8))) {
+		return 0;
+	}
+	uint8_t mode = inst->addr_mode & 0x1F;
+	if (mode != Z80_REG && mode != Z80_IMMED && mode != Z80_UNUSED) {
+		return 0;
+	}
+	switch (inst->op)
+	{
+	case Z80_LD:
+		return inst->reg != Z80_I && inst->reg != Z80_R && inst->reg != Z80_USE_IMMED
+			&& (mode != Z80_REG || (inst->ea_reg != Z80_I && inst->ea_reg != Z80_R));
+	case Z80_EX:
+		return mode == Z80_REG;
+	case Z80_ADD:
+	case Z80_ADC:
+	case Z80_SUB:
+	case Z80_SBC:
+	case Z80_AND:
+	case Z80_OR:
+	case Z80_XOR:
+	case Z80_CP:
+	case Z80_INC:
+	case Z80_DEC:
+	case Z80_CPL:
+	case Z80_NEG:
+	case Z80_CCF:
+	case Z80_SCF:
+	case Z80_NOP:
+	case Z80_EXX:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+//Decodes the instructions that follow run[0] in its run, addresses[0] is the address of run[0]
+//and address the one after it. Returns the number of instructions in the run and fills in
+//addresses up to the address following it
+static uint32_t z80_decode_run(z80_context *context, z80inst *run, uint32_t *addresses, uint32_t address)
+{
+	z80_options *opts = context->options;
+	uint32_t num = 1;
+	memmap_chunk const *chunk = find_map_chunk(addresses[0], &opts->gen, 0, NULL);
+	while (num < Z80_MAX_RUN && address < 0x10000)
+	{
+		if (z80_get_native_address(context, address) || find_map_chunk(address, &opts->gen, 0, NULL) != chunk) {
+			break;
+		}
+		uint8_t *encoded = get_native_pointer(address, (void **)context->mem_pointers, &opts->gen);
+		if (!encoded) {
+			break;
+		}
+		uint8_t *next = z80_decode(encoded, run + num);
+		uint32_t after = address + (next - encoded);
+		if (!z80_is_run_inst(context, run + num, address) || after - addresses[0] > Z80_MAX_RUN_BYTES) {
+			break;
+		}
+		addresses[num++] = address;
+		address = after;
+	}
+	addresses[num] = address;
+	return num;
+}
+
+//Translates a run of register-only instructions starting with first, see check_cycles_run in backend.h.
+//Returns the address after the run or 0 if there was no run at this address
+static uint32_t translate_z80_run(z80_context *context, z80inst *first, uint32_t first_address, uint32_t address)
+{
+	z80_options *opts = context->options;
+	code_info *code = &opts->gen.code;
+	z80inst run[Z80_MAX_RUN];
+	uint32_t addresses[Z80_MAX_RUN + 1];
+	run[0] = *first;
+	addresses[0] = first_address;
+	uint32_t num = z80_decode_run(context, run, addresses, address);
+	if (num < 2) {
+		return 0;
+	}
+	address = addresses[num];
+
+	code_ptr start = code->cur;
+	check_cycles_int(&opts->gen, first_address);
+	code_ptr check = check_cycles_run(&opts->gen);
+	for (uint32_t i = 0; i < num; i++)
+	{
+		z80inst inst = run[i];
+		translate_z80inst(&inst, context, addresses[i], 0);
+	}
+	end_cycles_run(&opts->gen, check);
+	check_code_prologue(code);
+	code_ptr dest = z80_get_native_address(context, address);
+	if (!dest) {
+		opts->gen.deferred = defer_address(opts->gen.deferred, address, code->cur + 1);
+		dest = code->cur + 256;
+	}
+	jmp(code, dest);
+	z80_map_native_address(context, first_address, start, address - first_address, code->cur - start);
+	run_fallback_stub(&opts->gen, check, first_address);
+	*first = run[num - 1];
+	return address;
+}
+
+static code_ptr z80_translate_run_fallback(z80_context *context, uint32_t address, code_ptr stub)
+{
+	z80_options *opts = context->options;
+	code_info *code = &opts->gen.code;
+	z80inst run[Z80_MAX_RUN];
+	uint32_t addresses[Z80_MAX_RUN + 1];
+	uint8_t *encoded = get_native_pointer(address, (void **)context->mem_pointers, &opts->gen);
+	uint8_t *next = z80_decode(encoded, run);
+	addresses[0] = address;
+	uint32_t num = z80_decode_run(context, run, addresses, address + (next - encoded));
+	code_ptr dest = z80_get_native_address_trans(context, addresses[num] & 0xFFFF);
+	check_code_prologue(code);
+	code_ptr start = code->cur + check_cycles_int_size(&opts->gen, address);
+	translate_z80inst(run, context, address, 0);
+	for (uint32_t i = 1; i < num; i++)
+	{
+		check_code_prologue(code);
+		code_ptr inst_start = code->cur;
+		translate_z80inst(run + i, context, addresses[i], 0);
+		z80_map_native_address(context, addresses[i], inst_start, addresses[i + 1] - addresses[i], code->cur - inst_start);
+	}
+	jmp(code, dest);
+	z80_handle_deferred(context);
+	patch_run_fallback(stub, start);
+	return start;
+}
+
 void translate_z80_stream(z80_context * context, uint32_t address)
 {
 	char disbuf[80];
@@ -3176,6 +3355,15 @@ void translate_z80_stream(z80_context * context, uint32_t address)
 				printf("%X\t%s\n", address, disbuf);
 			}
 			#endif
+			//code that enters a run after its first instruction is translated an instruction at a time
+			//until it gets back to mapped code, the same as the fallback for the run, see backend.h
+			if (z80_is_run_inst(context, &inst, address) && z80_get_instruction_start(context, address) == INVALID_INSTRUCTION_START) {
+				uint32_t after_run = translate_z80_run(context, &inst, address, address + (next-encoded));
+				if (after_run) {
+					address = after_run & 0xFFFF;
+					continue;
+				}
+			}
 			code_ptr start = opts->gen.code.cur;
 			translate_z80inst(&inst, context, address, 0);
 			z80_map_native_address(context, address, start, next-encoded, opts->gen.code.cur - start);
@@ -3204,6 +3392,10 @@ void init_z80_opts(z80_options * options, memmap_chunk const * chunks, uint32_t
 	options->gen.mem_ptr_off = offsetof(z80_context, mem_pointers);
 	options->gen.ram_flags_off = offsetof(z80_context, ram_code_flags);
 	options->gen.ram_flags_shift = 7;
+	//dirty page flags follow the code flags at the end of the context when anything asks for them
+	if (tracks_dirty_pages(&options->gen)) {
+		options->gen.dirty_flags_off = ram_size(&options->gen) / (1 << options->gen.ram_flags_shift) / 8;
+	}
 
 	options->flags = 0;
 #ifdef X86_64
@@ -3334,6 +3526,15 @@ void init_z80_opts(z80_options * options, memmap_chunk const * chunks, uint32_t
 	call(code, options->gen.load_context);
 	retn(code);
 
+	options->gen.run_fallback = code->cur;
+	call(code, options->gen.save_context);
+	push_r(code, options->gen.context_reg);
+	call_args(code, (code_ptr)z80_translate_run_fallback, 3, options->gen.context_reg, options->gen.scratch1, options->gen.scratch2);
+	mov_rr(code, RAX, options->gen.scratch1, SZ_PTR);
+	pop_r(code, options->gen.context_reg);
+	call(code, options->gen.load_context);
+	retn(code);
+
 	uint32_t tmp_stack_off;
 
 	options->gen.handle_cycle_limit = code->cur;
@@ -3622,7 +3823,9 @@ void init_z80_opts(z80_options * options, memmap_chunk const * chunks, uint32_t
 
 z80_context *init_z80_context(z80_options * options)
 {
-	size_t ctx_size = sizeof(z80_context) + ram_size(&options->gen) / (1 << options->gen.ram_flags_shift) / 8;
+	//room for the code flags and the dirty page flags if there are any
+	uint32_t pages = ram_size(&options->gen) / (1 << options->gen.ram_flags_shift);
+	size_t ctx_size = sizeof(z80_context) + pages / 8 + (options->gen.dirty_flags_off ? pages : 0);
 	z80_context *context = calloc(1, ctx_size);
 	context->options = options;
 	context->int_cycle = CYCLE_NEVER;
@@ -3858,6 +4061,8 @@ void zinsert_breakpoint(z80_context * context, uint16_t address, uint8_t * bp_ha
 		if (!context->bp_stub) {
 			zcreate_stub(context);
 		}
+		//a run starting before this address would skip over the breakpoint
+		z80_invalidate_code_range(context, address, address);
 		uint8_t * native = z80_get_native_address(context, address);
 		if (native) {
 			zbreakpoint_patch(context, address, native);
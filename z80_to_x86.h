@@ -15,6 +15,9 @@
 #else
 #define ZMAX_NATIVE_SIZE 160
 #endif
+//limits for straight-line runs that share a single cycle limit check
+#define Z80_MAX_RUN 16
+#define Z80_MAX_RUN_BYTES 16
 
 enum {
 	ZF_C = 0,
@@ -11,6 +11,37 @@ void z80_read_8(z80_context *context)
 	}
 }
 
+static z80_decoded *z80_get_decoded(z80_context *context)
+{
+	z80_decoded *page = context->decoded[context->pc >> 10];
+	return page ? page + (context->pc & 0x3FF) : NULL;
+}
+
+static uint8_t z80_fill_decoded(z80_context *context, z80_decoded *decoded)
+{
+	uint32_t offset = context->pc & 0x3FF;
+	if (offset > 0x400 - sizeof(decoded->stream)) {
+		//instructions that might run into the next page are left to the normal fetch path
+		return 0;
+	}
+	memcpy(decoded->stream, context->fastread[context->pc >> 10] + offset, sizeof(decoded->stream));
+	return 1;
+}
+
+static void z80_invalidate_decoded(z80_context *context, uint32_t address)
+{
+	z80_decoded *page = context->decoded[address >> 10 & 0x3F];
+	if (page) {
+		//clear every entry whose copy of the stream includes this byte
+		uint32_t offset = address & 0x3FF;
+		uint32_t first = offset >= sizeof(page->stream) ? offset - (sizeof(page->stream) - 1) : 0;
+		for (; first <= offset; first++)
+		{
+			page[first].handler = 0;
+		}
+	}
+}
+
 void z80_write_8(z80_context *context)
 {
 	context->cycles += 3 * context->opts->gen.clock_divider;
@@ -20,6 +51,7 @@ void z80_write_8(z80_context *context)
 	} else {
 		write_byte(context->scratch2, context->scratch1, (void **)context->mem_pointers, &context->opts->gen, context);
 	}
+	z80_invalidate_decoded(context, context->scratch2);
 }
 
 void z80_io_read8(z80_context *context)
@@ -81,7 +113,9 @@ void z80_options_free(z80_options *opts)
 
 z80_context * init_z80_context(z80_options *options)
 {
-	z80_context *context = calloc(1, sizeof(z80_context));
+	//room for a decoded entry per address after the context
+	z80_context *context = calloc(1, sizeof(z80_context) + 0x10000 * sizeof(z80_decoded));
+	context->decoded_pool = (z80_decoded *)(context + 1);
 	context->opts = options;
 	context->io_map = (memmap_chunk *)tmp_io_chunks;
 	context->io_chunks = tmp_num_io_chunks;
@@ -179,6 +213,7 @@ uint8_t z80_get_busack(z80_context * context, uint32_t cycle)
 
 void z80_invalidate_code_range(z80_context *context, uint32_t startA, uint32_t endA)
 {
+	uint32_t first_page = startA >> 10;
 	for(startA &= ~0x3FF; startA < endA; startA += 1024)
 	{
 		uint8_t *start = get_native_pointer(startA, (void**)context->mem_pointers, &context->opts->gen);
@@ -198,6 +233,34 @@ void z80_invalidate_code_range(z80_context *context, uint32_t startA, uint32_t e
 		}
 		context->fastwrite[startA >> 10] = start;
 	}
+	uint32_t end_page = startA >> 10;
+	//pages that read the same memory share their decoded entries so a write through either clears them
+	for (uint32_t page = 0; page < 64; page++)
+	{
+		z80_decoded *decoded = NULL;
+		if (context->fastread[page]) {
+			for (uint32_t other = 0; other < page; other++)
+			{
+				if (context->fastread[other] == context->fastread[page]) {
+					decoded = context->decoded[other];
+					break;
+				}
+			}
+			if (!decoded) {
+				decoded = context->decoded_pool + page * 1024;
+			}
+			if (decoded != context->decoded[page] || (page >= first_page && page < end_page)) {
+				memset(decoded, 0, 1024 * sizeof(z80_decoded));
+			}
+		}
+		context->decoded[page] = decoded;
+	}
+}
+
+z80_context *z80_handle_code_write(uint32_t address, z80_context *context)
+{
+	z80_invalidate_decoded(context, address);
+	return context;
 }
 
 void z80_adjust_cycles(z80_context * context, uint32_t deduction)